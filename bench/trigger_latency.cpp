@@ -0,0 +1,160 @@
+// Measures TriggerBox::sendTrigger from call to byte-on-wire using a pty pair as the trigger box.
+// SimpleSerialOutput writes to the slave side, a reader thread timestamps bytes arriving on the master.
+#include <fcntl.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <termios.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <sstream>
+#include <thread>
+#include <vector>
+#include <cxxopts.hpp>
+#include "basic_serial.hpp"
+
+using Clock = std::chrono::steady_clock;
+
+struct Arrival {
+    unsigned char byte;
+    Clock::time_point t;
+};
+
+class PtyPair {
+public:
+    PtyPair() {
+        master = posix_openpt(O_RDWR | O_NOCTTY);
+        if (master < 0 || grantpt(master) != 0 || unlockpt(master) != 0)
+            throw std::runtime_error("could not open a pseudo-terminal");
+        termios tio;
+        tcgetattr(master, &tio);
+        cfmakeraw(&tio);
+        tcsetattr(master, TCSANOW, &tio);
+        slave_path = ptsname(master);
+    }
+    ~PtyPair() {close(master);}
+    int master;
+    std::string slave_path;
+};
+
+class MasterReader {
+public:
+    MasterReader(int fd, size_t expected) : fd(fd) {
+        arrivals.reserve(expected);
+        thread = std::thread([this]{run();});
+    }
+    ~MasterReader() {stop();}
+    void stop() {
+        running = false;
+        if (thread.joinable()) thread.join();
+    }
+    std::vector<Arrival> arrivals;
+private:
+    void run() {
+        unsigned char buf[256];
+        pollfd pfd = {fd, POLLIN, 0};
+        while (running) {
+            if (poll(&pfd, 1, 50) <= 0) continue;
+            ssize_t n = read(fd, buf, sizeof(buf));
+            auto now = Clock::now();
+            for (ssize_t i = 0; i < n; i++) arrivals.push_back({buf[i], now});
+        }
+    }
+    int fd;
+    std::atomic<bool> running{true};
+    std::thread thread;
+};
+
+static double percentile(std::vector<double>& v, double p) {
+    if (v.empty()) return 0;
+    size_t idx = std::min(v.size() - 1, (size_t)(p / 100.0 * (v.size() - 1) + 0.5));
+    return v[idx];
+}
+
+static void report(const char* name, std::vector<double> v) {
+    std::sort(v.begin(), v.end());
+    double mean = 0;
+    for (double x : v) mean += x;
+    mean = v.empty() ? 0 : mean / v.size();
+    printf("  %-12s n=%-6zu mean=%8.1f p50=%8.1f p90=%8.1f p99=%8.1f p99.9=%8.1f max=%8.1f us\n", name, v.size(), mean,
+        percentile(v, 50), percentile(v, 90), percentile(v, 99), percentile(v, 99.9), v.empty() ? 0 : v.back());
+}
+
+static void run(int count, double rate_hz, int pulse_us) {
+    PtyPair pty;
+    TriggerBox tb;
+    if (!tb.connectToCom(pty.slave_path)) throw std::runtime_error("could not attach to " + pty.slave_path);
+    tb.setPulseWidth(std::chrono::microseconds(pulse_us));
+    MasterReader reader(pty.master, 2 * count);
+
+    std::vector<Clock::time_point> sent;
+    sent.reserve(count);
+    auto period = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / rate_hz));
+    auto next = Clock::now();
+    for (int i = 0; i < count; i++) {
+        std::this_thread::sleep_until(next);
+        sent.push_back(Clock::now());
+        tb.sendTrigger((unsigned char)(i % 255 + 1));
+        next += period;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    reader.stop();
+    tb.endComConnection();
+
+    //codes cycle through 1..255, an arrival belongs to the next send with its code; the sends it
+    //skips were lost, and a byte no send within one cycle matches was not sent by us
+    auto code = [](size_t i) {return (unsigned char)(i % 255 + 1);};
+    std::vector<double> latency, width;
+    size_t expected = 0, lost = 0, stray = 0;
+    bool open = false;
+    Clock::time_point rise;
+    for (auto& a : reader.arrivals) {
+        if (a.byte != 0) {
+            size_t i = expected;
+            while (i < sent.size() && i < expected + 255 && code(i) != a.byte) i++;
+            open = false;
+            if (i == sent.size() || i == expected + 255) {
+                stray++;
+                continue;
+            }
+            lost += i - expected;
+            latency.push_back(std::chrono::duration<double, std::micro>(a.t - sent[i]).count());
+            expected = i + 1;
+            rise = a.t;
+            open = true;
+        } else if (open) {
+            width.push_back(std::chrono::duration<double, std::micro>(a.t - rise).count());
+            open = false;
+        }
+    }
+    lost += sent.size() - expected;
+    printf("%d triggers at %.0f Hz, %d us pulse: %zu bytes received, %zu triggers unmatched, %zu unexpected bytes\n",
+        count, rate_hz, pulse_us, reader.arrivals.size(), lost, stray);
+    report("latency", latency);
+    report("pulse width", width);
+}
+
+int main(int argc, char** argv) {
+    cxxopts::Options options("TriggerLatencyBench", "Trigger path latency over a pseudo-terminal");
+    options.add_options()("h,help", "Print usage")
+    ("n,count", "Triggers per run", cxxopts::value<int>()->default_value("10000"))
+    ("r,rates", "Comma separated trigger rates in Hz", cxxopts::value<std::string>()->default_value("10,100,250"))
+    ("p,pulse-us", "Trigger pulse width in microseconds", cxxopts::value<int>()->default_value("1000"));
+    auto args = options.parse(argc, argv);
+    if (args.count("help")) {
+        std::cout << options.help() << std::endl;
+        return 0;
+    }
+    std::stringstream rates(args["rates"].as<std::string>());
+    try {
+        for (std::string rate; std::getline(rates, rate, ',');)
+            run(args["count"].as<int>(), std::stod(rate), args["pulse-us"].as<int>());
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,191 @@
+#include "app_config.hpp"
+#include "stream_table.hpp"
+#include "json_value.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+//monitor list entries are the config names of the stream table
+int AppConfig::monitor_flags() const {
+    int flags = 0;
+    for (auto& m : monitor)
+        for (int s = 0; s < STREAM_COUNT; s++) {
+            const StreamDesc& d = stream_desc(s);
+            if (d.config_name && m == d.config_name) flags |= d.monitor_flag;
+        }
+    return flags;
+}
+
+libct_posture_t AppConfig::posture_value() const {
+    return posture == "supine" ? LIBCT_POSTURE_SUPINE : LIBCT_POSTURE_SITTING;
+}
+
+bool AppConfig::operator==(const AppConfig& o) const {
+    return com_port == o.com_port && baud == o.baud && monitor == o.monitor && posture == o.posture
+        && discover_timeout_ms == o.discover_timeout_ms && output_dir == o.output_dir && expected_minutes == o.expected_minutes && lock_memory == o.lock_memory && devices == o.devices
+        && std::equal(threads, threads + ROLE_COUNT, o.threads);
+}
+
+ConfigStore::ConfigStore(std::string path, std::function<void(std::string)> log) : path(path), log(log) {
+}
+
+//a bad value only costs that one setting
+template <typename T>
+static void read(const JsonValue& obj, const char* section, const char* key, T& out, std::function<void(std::string)>& log) {
+    try {
+        const JsonValue* s = obj.find(section);
+        const JsonValue* v = s ? s->find(key) : nullptr;
+        if (v) json_get(*v, out);
+    } catch (const std::exception& e) {
+        log(std::string("Config ") + section + "." + key + " ignored: " + e.what());
+    }
+}
+
+void ConfigStore::load() {
+    std::lock_guard<std::mutex> lock(mtx);
+    if (!std::ifstream(path).good()) {
+        log("No config at " + path + ", writing defaults");
+        save(config);
+        return;
+    }
+    JsonValue v;
+    try {
+        std::ifstream in(path, std::ios::binary);
+        std::stringstream text;
+        text << in.rdbuf();
+        v = json_parse(text.str());
+    } catch (const std::exception& e) {
+        log("Config " + path + " unreadable, using defaults: " + e.what());
+        return;
+    }
+    read(v, "trigger_box", "com_port", config.com_port, log);
+    read(v, "trigger_box", "baud", config.baud, log);
+    try {
+        const JsonValue* c = v.find("caretaker");
+        const JsonValue* m = c ? c->find("monitor") : nullptr;
+        if (m) {
+            config.monitor.clear();
+            for (auto& name : m->as_array()) config.monitor.push_back(name.as_string());
+        }
+    } catch (const std::exception& e) {
+        log(std::string("Config caretaker.monitor ignored: ") + e.what());
+        config.monitor = AppConfig().monitor;
+    }
+    read(v, "caretaker", "posture", config.posture, log);
+    read(v, "caretaker", "discover_timeout_ms", config.discover_timeout_ms, log);
+    read(v, "session", "output_dir", config.output_dir, log);
+    read(v, "session", "expected_minutes", config.expected_minutes, log);
+    read(v, "session", "lock_memory", config.lock_memory, log);
+    try {
+        const JsonValue* d = v.find("devices");
+        if (d) {
+            for (auto& entry : d->as_array()) {
+                KnownDevice k;
+                k.address = entry.at("address").as_string();
+                if (const JsonValue* n = entry.find("name")) k.name = n->as_string();
+                if (const JsonValue* t = entry.find("last_seen_ms")) json_get(*t, k.last_seen_ms);
+                if (const JsonValue* t = entry.find("last_connected_ms")) json_get(*t, k.last_connected_ms);
+                config.devices.push_back(k);
+            }
+        }
+    } catch (const std::exception& e) {
+        log(std::string("Config devices ignored: ") + e.what());
+        config.devices.clear();
+    }
+    for (int role = 0; role < ROLE_COUNT; role++) {
+        const char* name = thread_role_name((THREAD_ROLE)role);
+        try {
+            const JsonValue* t = v.find("threads");
+            const JsonValue* e = t ? t->find(name) : nullptr;
+            if (!e) continue;
+            ThreadPolicy p;
+            if (const JsonValue* x = e->find("policy")) p.policy = x->as_string();
+            if (const JsonValue* x = e->find("priority")) json_get(*x, p.priority);
+            if (const JsonValue* x = e->find("cpus"))
+                for (auto& c : x->as_array()) {
+                    int cpu;
+                    json_get(c, cpu);
+                    p.cpus.push_back(cpu);
+                }
+            config.threads[role] = p;
+        } catch (const std::exception& e) {
+            log(std::string("Config threads.") + name + " ignored: " + e.what());
+        }
+    }
+    if (config.monitor_flags() == 0) {
+        log("Config enables no known monitor streams, using defaults");
+        config.monitor = AppConfig().monitor;
+    }
+    log("Loaded config " + path + ", " + std::to_string(config.devices.size()) + " known devices");
+}
+
+AppConfig ConfigStore::get() {
+    std::lock_guard<std::mutex> lock(mtx);
+    return config;
+}
+
+void ConfigStore::update(std::function<void(AppConfig&)> fn) {
+    std::lock_guard<std::mutex> lock(mtx);
+    AppConfig next = config;
+    fn(next);
+    if (next == config) return;
+    config = next;
+    if (!save(config)) log("Failed to save config " + path);
+}
+
+bool ConfigStore::save(const AppConfig& c) {
+    JsonValue trigger_box = JsonValue::object();
+    trigger_box.set("com_port", JsonValue::text(c.com_port));
+    trigger_box.set("baud", JsonValue::number(c.baud));
+    JsonValue monitor = JsonValue::array();
+    for (auto& m : c.monitor) monitor.push(JsonValue::text(m));
+    JsonValue caretaker = JsonValue::object();
+    caretaker.set("monitor", monitor);
+    caretaker.set("posture", JsonValue::text(c.posture));
+    caretaker.set("discover_timeout_ms", JsonValue::number(c.discover_timeout_ms));
+    JsonValue session = JsonValue::object();
+    session.set("output_dir", JsonValue::text(c.output_dir));
+    session.set("expected_minutes", JsonValue::number(c.expected_minutes));
+    session.set("lock_memory", JsonValue::boolean(c.lock_memory));
+    JsonValue devices = JsonValue::array();
+    for (auto& d : c.devices) {
+        JsonValue& entry = devices.push(JsonValue::object());
+        entry.set("address", JsonValue::text(d.address));
+        entry.set("name", JsonValue::text(d.name));
+        entry.set("last_seen_ms", JsonValue::number((int64_t)d.last_seen_ms));
+        entry.set("last_connected_ms", JsonValue::number((int64_t)d.last_connected_ms));
+    }
+    JsonValue threads = JsonValue::object();
+    for (int role = 0; role < ROLE_COUNT; role++) {
+        JsonValue cpus = JsonValue::array();
+        for (int cpu : c.threads[role].cpus) cpus.push(JsonValue::number(cpu));
+        JsonValue& t = threads.set(thread_role_name((THREAD_ROLE)role), JsonValue::object());
+        t.set("policy", JsonValue::text(c.threads[role].policy));
+        t.set("priority", JsonValue::number(c.threads[role].priority));
+        t.set("cpus", cpus);
+    }
+    JsonValue v = JsonValue::object();
+    v.set("trigger_box", trigger_box);
+    v.set("caretaker", caretaker);
+    v.set("session", session);
+    v.set("devices", devices);
+    v.set("threads", threads);
+    //write beside the old file and swap, a crash mid-write leaves the previous config intact
+    std::string tmp = path + ".tmp";
+    {
+        std::ofstream out(tmp, std::ios::trunc);
+        if (!out) return false;
+        out << json_write(v, 2) << std::endl;
+        if (!out) return false;
+    }
+    //replace in one step, there is never a moment without a config on disk
+#ifdef _WIN32
+    return MoveFileExA(tmp.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+#else
+    return std::rename(tmp.c_str(), path.c_str()) == 0;
+#endif
+}
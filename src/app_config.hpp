@@ -0,0 +1,61 @@
+#pragma once
+#include <caretaker_static.h>
+#include "thread_roles.hpp"
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
+
+struct KnownDevice {
+    std::string address;
+    std::string name;
+    uint64_t last_seen_ms = 0;      //last time discovery reported it
+    uint64_t last_connected_ms = 0; //0 if never connected
+    bool operator==(const KnownDevice& o) const {
+        return address == o.address && name == o.name && last_seen_ms == o.last_seen_ms && last_connected_ms == o.last_connected_ms;
+    }
+};
+
+//everything an operator would otherwise re-enter or rediscover each session
+struct AppConfig {
+    //trigger box
+    std::string com_port = "COM7";
+    uint32_t baud = 19200;
+    //caretaker
+    std::vector<std::string> monitor = {"int_pulse", "param_pulse", "vitals", "vitals2", "cuff", "device_status"};
+    std::string posture = "sitting";
+    int discover_timeout_ms = 10000;
+    //session files
+    std::string output_dir = ".";
+    int expected_minutes = 120;    //sizes the memory reserved at Start
+    bool lock_memory = false;      //keep that memory resident, may need privileges
+    //devices seen or connected before, tried directly before falling back to discovery
+    std::vector<KnownDevice> devices;
+    //scheduling and affinity per thread role, all left to the OS by default
+    ThreadPolicy threads[ROLE_COUNT];
+
+    int monitor_flags() const;
+    libct_posture_t posture_value() const;
+    bool operator==(const AppConfig& o) const;
+    bool operator!=(const AppConfig& o) const {return !(*this == o);}
+};
+
+/* JSON backed configuration. Loaded once at startup; every update() that changes a value is
+ * written straight back so a crash never loses the cached device or port settings. */
+class ConfigStore {
+public:
+    ConfigStore(std::string path, std::function<void(std::string)> log);
+    //missing keys keep their defaults, a missing file is created
+    void load();
+    AppConfig get();
+    //applies fn under the lock and saves if anything changed
+    void update(std::function<void(AppConfig&)> fn);
+    const std::string& file() const {return path;}
+private:
+    bool save(const AppConfig& c);
+    std::string path;
+    std::function<void(std::string)> log;
+    std::mutex mtx;
+    AppConfig config;
+};
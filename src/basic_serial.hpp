@@ -2,64 +2,270 @@
 #include <asio.hpp>
 #include <iostream>
 #include <string>
+#include <deque>
+#include <vector>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <chrono>
+#include <algorithm>
+#include <filesystem>
+#include "io_thread.hpp"
+#include "trace.hpp"
+
+enum SERIAL_FRAMING {
+    FRAME_BYTES, //every read delivers the bytes that arrived together
+    FRAME_LINES  //one frame per '\n' terminated line, '\r' stripped
+};
+
+struct SerialFrame {
+    std::string data;
+    std::chrono::steady_clock::time_point received;
+    uint64_t received_ms; //system clock, comparable with the CSV computer timestamp
+};
+
+//reads a serial port with async_read_some on the shared io thread and fans frames out to subscribers
+class AsyncSerialReader {
+public:
+    typedef std::function<void(const SerialFrame&)> Callback;
+    //longer lines are cut here, the rest up to the '\n' is dropped
+    static constexpr size_t MAX_LINE = 4096;
+    AsyncSerialReader(asio::serial_port& port, std::function<void(std::string)> log = nullptr) : port(port), log(log) {}
+    ~AsyncSerialReader() {wait_stopped();}
+
+    void subscribe(SERIAL_FRAMING framing, Callback cb) {
+        std::lock_guard<std::mutex> lock(sub_mutex);
+        subscribers.push_back({framing, cb});
+        if (framing == FRAME_LINES) line_subscribers++;
+    }
+    void start() {
+        std::lock_guard<std::mutex> lock(state_mutex);
+        if (reading) return;
+        reading = true;
+        asio::post(port.get_executor(), [this]{read_some();});
+    }
+    //blocks until the outstanding read has completed after the port was closed or cancelled
+    void wait_stopped() {
+        std::unique_lock<std::mutex> lock(state_mutex);
+        state_cv.wait(lock, [this]{return !reading;});
+    }
+private:
+    struct Subscriber {
+        SERIAL_FRAMING framing;
+        Callback cb;
+    };
+    void read_some() {
+        port.async_read_some(rx.prepare(512), [this](const asio::error_code& ec, size_t n) {
+            if (ec) {
+                std::lock_guard<std::mutex> lock(state_mutex);
+                reading = false;
+                state_cv.notify_all();
+                return;
+            }
+            rx.commit(n);
+            dispatch();
+            read_some();
+        });
+    }
+    void dispatch() {
+        SerialFrame frame;
+        frame.received = std::chrono::steady_clock::now();
+        frame.received_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count();
+        const char* data = static_cast<const char*>(rx.data().data());
+        size_t n = rx.size();
+        std::lock_guard<std::mutex> lock(sub_mutex);
+        frame.data.assign(data, n);
+        for (auto& s : subscribers)
+            if (s.framing == FRAME_BYTES) s.cb(frame);
+        //without a line subscriber nothing is buffered, a box that never sends '\n' would grow it forever
+        for (size_t i = 0; i < n && line_subscribers; i++) {
+            if (data[i] == '\r') continue;
+            if (data[i] != '\n') {
+                if (line.size() < MAX_LINE) line.push_back(data[i]);
+                else if (!line_cut) {
+                    line_cut = true;
+                    if (log) log("Serial input line longer than " + std::to_string(MAX_LINE) + " bytes, cutting it short");
+                }
+                continue;
+            }
+            frame.data = line;
+            for (auto& s : subscribers)
+                if (s.framing == FRAME_LINES) s.cb(frame);
+            line.clear();
+        }
+        rx.consume(n);
+    }
+    asio::serial_port& port;
+    std::function<void(std::string)> log;
+    asio::streambuf rx;
+    std::string line;
+    bool line_cut = false; //logged once per reader
+    std::mutex sub_mutex;
+    std::vector<Subscriber> subscribers;
+    size_t line_subscribers = 0;
+    std::mutex state_mutex;
+    std::condition_variable state_cv;
+    bool reading = false;
+};
+
 class SimpleSerialOutput {
 public:
-    SimpleSerialOutput(std::string port, uint32_t baud_rate) : io(), serial(io,port) {
+    SimpleSerialOutput(std::string port, uint32_t baud_rate, std::function<void(std::string)> log = nullptr)
+        : serial(IoThread::context(), port), reader(serial, log) {
         serial.set_option(asio::serial_port_base::baud_rate(baud_rate));
+        reader.subscribe(FRAME_BYTES, [this](const SerialFrame& f) {
+            std::lock_guard<std::mutex> lock(rx_mutex);
+            for (char c : f.data) bytes.push_back((u_char)c);
+            while (bytes.size() > MAX_QUEUED) bytes.pop_front();
+            rx_cv.notify_all();
+        });
+        reader.start();
+    }
+    ~SimpleSerialOutput() {
+        closePort();
     }
 
+    //writes on the io thread, where the pending read runs, as asio does not allow a port to be
+    //used from two threads at once; blocks until the byte was handed to the port
     void writeByte(u_char byte) {
-        serial.write_some(asio::buffer(&byte, 1));
+        TRACE_SCOPE("serial write");
+        std::promise<asio::error_code> done;
+        asio::post(serial.get_executor(), [this, byte, &done]{
+            asio::error_code ec;
+            asio::write(serial, asio::buffer(&byte, 1), ec);
+            done.set_value(ec);
+        });
+        asio::error_code ec = done.get_future().get();
+        if (ec) throw asio::system_error(ec);
+    }
+
+    //frames are delivered on the io thread, keep callbacks short
+    void subscribe(SERIAL_FRAMING framing, AsyncSerialReader::Callback cb) {
+        reader.subscribe(framing, cb);
     }
 
+    //lines are queued from the first call on, the box is not read as lines otherwise
     std::string readLine() {
-        char c;
-        std::string result;
-        for(;;)
-        {
-            asio::read(serial,asio::buffer(&c,1));
-            switch(c)
-            {
-                case '\r':
-                    break;
-                case '\n':
-                    return result;
-                default:
-                    result+=c;
-            }
+        //outside rx_mutex, the reader holds its subscriber lock while calling into ours
+        if (!lines_subscribed.exchange(true)) {
+            reader.subscribe(FRAME_LINES, [this](const SerialFrame& f) {
+                std::lock_guard<std::mutex> lock(rx_mutex);
+                lines.push_back(f.data);
+                while (lines.size() > MAX_QUEUED) lines.pop_front();
+                rx_cv.notify_all();
+            });
         }
+        std::unique_lock<std::mutex> lock(rx_mutex);
+        rx_cv.wait(lock, [this]{return !lines.empty() || closed;});
+        if (lines.empty()) return "";
+        std::string result = lines.front();
+        lines.pop_front();
+        return result;
     }
 
     u_char readByte() {
-        u_char c;
-        asio::read(serial,asio::buffer(&c,1));
+        std::unique_lock<std::mutex> lock(rx_mutex);
+        rx_cv.wait(lock, [this]{return !bytes.empty() || closed;});
+        if (bytes.empty()) return 0;
+        u_char c = bytes.front();
+        bytes.pop_front();
         return c;
     }
 
     void closePort(){
-        serial.close();
+        {
+            std::lock_guard<std::mutex> lock(rx_mutex);
+            if (closed) return;
+            closed = true;
+            rx_cv.notify_all();
+        }
+        //close on the io thread so it cannot race the pending read
+        std::promise<void> done;
+        asio::post(IoThread::context(), [this, &done]{
+            asio::error_code ec;
+            serial.close(ec);
+            done.set_value();
+        });
+        done.get_future().wait();
+        reader.wait_stopped();
     }
 private:
-    asio::io_service io;
+    static const size_t MAX_QUEUED = 4096;
     asio::serial_port serial;
+    AsyncSerialReader reader;
+    std::mutex rx_mutex;
+    std::condition_variable rx_cv;
+    std::deque<u_char> bytes;
+    std::deque<std::string> lines;
+    std::atomic<bool> lines_subscribed{false};
+    bool closed = false;
 };
 
+//serial ports present on this machine, e.g. {"COM3", "COM7"} or {"/dev/ttyUSB0"}
+inline std::vector<std::string> list_serial_ports() {
+    std::vector<std::string> ports;
+#ifdef _WIN32
+    HKEY key;
+    if (RegOpenKeyExA(HKEY_LOCAL_MACHINE, "HARDWARE\\DEVICEMAP\\SERIALCOMM", 0, KEY_READ, &key) != ERROR_SUCCESS)
+        return ports;
+    char name[256];
+    char value[256];
+    for (DWORD i = 0;; i++) {
+        DWORD name_len = sizeof(name), value_len = sizeof(value), type;
+        if (RegEnumValueA(key, i, name, &name_len, NULL, &type, (LPBYTE)value, &value_len) != ERROR_SUCCESS) break;
+        if (type != REG_SZ) continue;
+        std::string port(value, value_len);
+        port.erase(std::find(port.begin(), port.end(), '\0'), port.end());
+        ports.push_back(port);
+    }
+    RegCloseKey(key);
+#else
+    std::error_code ec;
+    for (auto& entry : std::filesystem::directory_iterator("/dev", ec)) {
+        std::string name = entry.path().filename().string();
+        if (name.rfind("ttyS", 0) == 0 || name.rfind("ttyUSB", 0) == 0 || name.rfind("ttyACM", 0) == 0)
+            ports.push_back(entry.path().string());
+    }
+#endif
+    std::sort(ports.begin(), ports.end());
+    return ports;
+}
+
 class TriggerBox {
     public:
         TriggerBox() {
         }
-        bool connectToCom(std::string port) {
+        bool connectToCom(std::string port, uint32_t baud_rate = 19200, std::function<void(std::string)> log = nullptr) {
             try{
-                ser.reset(new SimpleSerialOutput(port, 19200));
+                ser.reset(new SimpleSerialOutput(port, baud_rate, log));
                 return true;
             } catch (const std::exception&) {
                 return false;
             }
         }
-        void sendTrigger(u_char trigger) {
-            ser->writeByte(trigger);
-            std::this_thread::sleep_for(std::chrono::milliseconds(100)); 
+        //puts code on the lines and leaves it there, returns when the byte was handed to the port
+        std::chrono::steady_clock::time_point writeCode(u_char code) {
+            ser->writeByte(code);
+            return std::chrono::steady_clock::now();
+        }
+        //returns when the trigger byte was handed to the port, before the pulse is held
+        std::chrono::steady_clock::time_point sendTrigger(u_char trigger) {
+            auto written = writeCode(trigger);
+            std::this_thread::sleep_for(pulse_width);
             ser->writeByte(0x00);
+            return written;
+        }
+        //time the trigger code is held on the lines before they are reset to zero
+        void setPulseWidth(std::chrono::microseconds width) {
+            pulse_width = width;
+        }
+        //timestamped input from the box (markers, acknowledgements), delivered on the io thread
+        void onInput(SERIAL_FRAMING framing, AsyncSerialReader::Callback cb) {
+            if (ser)
+                ser->subscribe(framing, cb);
         }
         void endComConnection(){
             if(ser)
@@ -67,4 +273,5 @@ class TriggerBox {
         }
     private:
     std::unique_ptr<SimpleSerialOutput> ser;
-};
\ No newline at end of file
+    std::chrono::microseconds pulse_width = std::chrono::milliseconds(100);
+};
@@ -0,0 +1,200 @@
+#include "brainvision_writer.hpp"
+#include "edf_writer.hpp"
+#include "trace.hpp"
+#include <algorithm>
+#include <chrono>
+#include <ctime>
+
+//the name a header or marker file uses for a sibling, which sits in the same directory
+static std::string file_part(const std::string& path) {
+    size_t slash = path.find_last_of("/\\");
+    return slash == std::string::npos ? path : path.substr(slash + 1);
+}
+
+//commas separate marker fields, the format escapes them as \1
+static std::string escape(const std::string& text) {
+    std::string out;
+    for (char c : text) {
+        if (c == ',') out += "\\1";
+        else if (c != '\n' && c != '\r') out += c;
+    }
+    return out;
+}
+
+BrainVisionWriter::BrainVisionWriter() : hz(stream_desc(STREAM_INT_PULSE).sample_hz) {
+    for (auto& s : EdfWriter::signals()) {
+        const FieldDesc& f = field_desc(s.field);
+        channels.push_back({f.stream, f.slot});
+    }
+    held.assign(channels.size(), 0.0f);
+    block.reserve(channels.size() * BRAINVISION_BLOCK_POINTS);
+    pulse.reserve(256);
+    changes.resize(BRAINVISION_MAX_CHANGES);
+}
+
+BrainVisionWriter::~BrainVisionWriter() {
+    close();
+}
+
+bool BrainVisionWriter::open(const std::string& base) {
+    std::lock_guard<std::mutex> lock(mtx);
+    std::string name = file_part(base);
+    std::ofstream vhdr(base + ".vhdr", std::ios::out | std::ios::trunc);
+    if (!vhdr.is_open()) return false;
+    vhdr << "Brain Vision Data Exchange Header File Version 1.0\n"
+         << "; Data created by CaretakerControl\n\n"
+         << "[Common Infos]\n"
+         << "Codepage=UTF-8\n"
+         << "DataFile=" << name << ".eeg\n"
+         << "MarkerFile=" << name << ".vmrk\n"
+         << "DataFormat=BINARY\n"
+         << "DataOrientation=MULTIPLEXED\n"
+         << "NumberOfChannels=" << channels.size() << "\n"
+         << "; Sampling interval in microseconds\n"
+         << "SamplingInterval=" << 1000000 / hz << "\n\n"
+         << "[Binary Infos]\n"
+         << "BinaryFormat=IEEE_FLOAT_32\n\n"
+         << "[Channel Infos]\n"
+         << "; Each entry: Ch<Channel number>=<Name>,<Reference channel name>,<Resolution in \"Unit\">,<Unit>\n";
+    int n = 1;
+    for (auto& s : EdfWriter::signals())
+        vhdr << "Ch" << n++ << "=" << s.label << ",,1," << (s.dimension[0] ? s.dimension : "AU") << "\n";
+    vhdr.close();
+
+    eeg.open(base + ".eeg", std::ios::out | std::ios::binary | std::ios::trunc);
+    vmrk = fopen((base + ".vmrk").c_str(), "wb");
+    if (!eeg.is_open() || !vmrk) return false;
+    fprintf(vmrk, "Brain Vision Data Exchange Marker File, Version 1.0\n\n"
+                  "[Common Infos]\nCodepage=UTF-8\nDataFile=%s.eeg\n\n"
+                  "[Marker Infos]\n"
+                  "; Each entry: Mk<Marker number>=<Type>,<Description>,<Position in data points>,\n"
+                  "; <Size in data points>, <Channel number (0 = marker is related to all channels)>\n", name.c_str());
+    fflush(vmrk);
+    t0 = -1;
+    segment_point = 0;
+    next_point = 0;
+    change_head = 0;
+    change_count = 0;
+    held.assign(channels.size(), 0.0f);
+    points_written = 0;
+    marker_count = 0;
+    return true;
+}
+
+void BrainVisionWriter::close() {
+    flush();
+    std::lock_guard<std::mutex> lock(mtx);
+    if (eeg.is_open()) eeg.close();
+    if (vmrk) fclose(vmrk);
+    vmrk = nullptr;
+}
+
+void BrainVisionWriter::flush() {
+    std::lock_guard<std::mutex> lock(mtx);
+    if (!eeg.is_open()) return;
+    write_block();
+    eeg.flush();
+}
+
+struct BrainVisionWriter::Sink {
+    BrainVisionWriter* writer;
+    void row(STREAM_ID stream, const StreamRow& row) {
+        if (stream == STREAM_INT_PULSE) writer->pulse.push_back(row);
+        else if (stream == STREAM_VITALS || stream == STREAM_VITALS2) writer->queue_change(stream, row);
+    }
+    void packet(STREAM_ID, const StreamPacket&) {}
+};
+
+void BrainVisionWriter::push(const libct_stream_data_t* data) {
+    TRACE_SCOPE("brainvision push");
+    std::lock_guard<std::mutex> lock(mtx);
+    if (!eeg.is_open() || !vmrk) return;
+    pulse.clear();
+    Sink sink{this};
+    ingest_streams(data, sink);
+    //the waveform sets the points, vitals of the same packet apply from their own timestamps
+    for (auto& row : pulse) {
+        if (t0 < 0) start(row.timestamp);
+        long long rel = row.timestamp - t0;
+        long long index = segment_point + rel * hz / 1000;
+        if (rel < 0 || index < next_point) {
+            late++;
+            continue;
+        }
+        while (change_count > 0 && changes[change_head].row.timestamp <= row.timestamp) pop_change();
+        if (index - next_point > (long long)BRAINVISION_MAX_FILL_MS * hz / 1000) {
+            start(row.timestamp);
+            index = next_point;
+        }
+        while (next_point < index) write_point();
+        hold(STREAM_INT_PULSE, row);
+        write_point();
+    }
+}
+
+void BrainVisionWriter::queue_change(STREAM_ID stream, const StreamRow& row) {
+    //without a waveform the vitals have nowhere to go, keep only the newest
+    if (change_count == changes.size()) pop_change();
+    changes[(change_head + change_count) % changes.size()] = {stream, row};
+    change_count++;
+}
+
+//applies the oldest queued row
+void BrainVisionWriter::pop_change() {
+    hold(changes[change_head].stream, changes[change_head].row);
+    change_head = (change_head + 1) % changes.size();
+    change_count--;
+}
+
+void BrainVisionWriter::hold(STREAM_ID stream, const StreamRow& row) {
+    for (size_t c = 0; c < channels.size(); c++)
+        if (channels[c].stream == stream) held[c] = (float)row.ints[channels[c].slot];
+}
+
+void BrainVisionWriter::write_point() {
+    block.insert(block.end(), held.begin(), held.end());
+    next_point++;
+    if (block.size() >= channels.size() * BRAINVISION_BLOCK_POINTS) write_block();
+}
+
+void BrainVisionWriter::write_block() {
+    if (block.empty()) return;
+    eeg.write(reinterpret_cast<const char*>(block.data()), block.size() * sizeof(float));
+    points_written += block.size() / channels.size();
+    block.clear();
+}
+
+//begins a segment at the next data point, the first one at device_ts
+void BrainVisionWriter::start(long long device_ts) {
+    t0 = device_ts;
+    segment_point = next_point;
+    //New Segment carries the PC time of its first point, microseconds as the format wants
+    auto now = std::chrono::system_clock::now();
+    std::time_t secs = std::chrono::system_clock::to_time_t(now);
+    long long us = std::chrono::duration_cast<std::chrono::microseconds>(now.time_since_epoch()).count() % 1000000;
+    char date[32];
+    size_t len = std::strftime(date, sizeof(date), "%Y%m%d%H%M%S", std::localtime(&secs));
+    snprintf(date + len, sizeof(date) - len, "%06lld", us);
+    fprintf(vmrk, "Mk%llu=New Segment,,%lld,1,0,%s\n", (unsigned long long)++marker_count, segment_point + 1, date);
+    fflush(vmrk);
+}
+
+void BrainVisionWriter::marker(const char* type, const std::string& description, long long device_ts) {
+    if (t0 < 0 || !vmrk) return;
+    //positions count from 1, a time before the current segment goes at its start
+    long long position = segment_point + std::max(0LL, (device_ts - t0) * hz / 1000) + 1;
+    fprintf(vmrk, "Mk%llu=%s,%s,%lld,1,0\n", (unsigned long long)++marker_count, type, escape(description).c_str(), position);
+    fflush(vmrk);
+}
+
+void BrainVisionWriter::stimulus(long long device_ts, int code) {
+    std::lock_guard<std::mutex> lock(mtx);
+    char description[16];
+    snprintf(description, sizeof(description), "S%3d", code);
+    marker("Stimulus", description, device_ts);
+}
+
+void BrainVisionWriter::comment(long long device_ts, const std::string& text) {
+    std::lock_guard<std::mutex> lock(mtx);
+    marker("Comment", text, device_ts);
+}
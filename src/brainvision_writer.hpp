@@ -0,0 +1,73 @@
+#pragma once
+#include <caretaker_static.h>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "stream_table.hpp"
+
+const int BRAINVISION_BLOCK_POINTS = 1000; //data points buffered before a write to the .eeg
+const size_t BRAINVISION_MAX_CHANGES = 256; //vitals rows waiting for the waveform to reach them
+const int BRAINVISION_MAX_FILL_MS = 1000;   //longer waveform gaps start a new segment instead
+
+/* BrainVision Core Data Format triplet for <session>: .vhdr header, multiplexed IEEE float32 .eeg
+ * and .vmrk markers. Data points are on the int pulse grid from its first sample, the EDF channels
+ * (EdfWriter::signals) all at the pulse rate, vitals held until their next row, missing pulse
+ * samples filled with the last value so a position is always device time since the segment began.
+ * A pause longer than BRAINVISION_MAX_FILL_MS (Stop/Start, an outage) is not filled, a New Segment
+ * marker restarts the grid at the next sample.
+ * Markers are appended and flushed one line at a time, triggers as "Stimulus" with the same code
+ * in the BrainVision "S  7" form so they can be matched against the EEG recording's markers. */
+class BrainVisionWriter {
+public:
+    BrainVisionWriter();
+    ~BrainVisionWriter();
+    //base is the path without extension
+    bool open(const std::string& base);
+    void close();
+    void flush();
+    void push(const libct_stream_data_t* data);
+    //both ignored before the first sample
+    void stimulus(long long device_ts, int code);
+    void comment(long long device_ts, const std::string& text);
+    uint64_t points() const {return points_written;}
+    uint64_t markers() const {return marker_count;}
+    uint64_t late_samples() const {return late;}
+private:
+    struct Channel {
+        STREAM_ID stream;
+        int slot;
+    };
+    struct Change {
+        STREAM_ID stream;
+        StreamRow row;
+    };
+    struct Sink;
+    void hold(STREAM_ID stream, const StreamRow& row);
+    void queue_change(STREAM_ID stream, const StreamRow& row);
+    void pop_change();
+    void write_point();
+    void write_block();
+    void start(long long device_ts);
+    void marker(const char* type, const std::string& description, long long device_ts);
+    std::mutex mtx;
+    std::ofstream eeg;
+    FILE* vmrk = nullptr;
+    std::vector<Channel> channels;
+    std::vector<float> held;       //current value of each channel
+    std::vector<float> block;      //points not yet written, multiplexed
+    std::vector<StreamRow> pulse;  //this packet's waveform rows
+    std::vector<Change> changes;   //ring of held rows ahead of the waveform, BRAINVISION_MAX_CHANGES long
+    size_t change_head = 0;
+    size_t change_count = 0;
+    int hz;
+    long long t0 = -1;             //device time of the current segment's first point
+    long long segment_point = 0;   //data point the current segment starts at
+    long long next_point = 0;
+    std::atomic<uint64_t> points_written{0};
+    std::atomic<uint64_t> marker_count{0};
+    std::atomic<uint64_t> late{0};
+};
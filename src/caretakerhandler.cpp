@@ -1,11 +1,14 @@
 #include "caretakerhandler.hpp"
 #include <iostream>
-#include <map>
+#include <cstring>
 #include <algorithm>
 #include <iomanip>
 #include <sstream>
 #include <chrono>
-#define DISCOVER_TIMEOUT 10000
+#include "trace.hpp"
+#include "thread_roles.hpp"
+#define WAL_FILE "caretaker.wal"
+#define STATS_LOG_INTERVAL 10 //seconds between stream summaries in the console
 
 void LIBCTAPI cb_on_device_discovered(libct_context_t* context, libct_device_t* device);
 void LIBCTAPI cb_on_discovery_timedout(libct_context_t* context);
@@ -14,12 +17,15 @@ void LIBCTAPI cb_on_device_connected_ready(libct_context_t* context, libct_devic
 void LIBCTAPI cb_on_start_measuring(libct_context_t *context, libct_device_t *device, int status);
 void LIBCTAPI cb_on_data_received(libct_context_t *context, libct_device_t *device, libct_stream_data_t *data);
 void LIBCTAPI cb_on_start_monitoring(libct_context_t *context, libct_device_t *device, int status);
+void LIBCTAPI cb_on_device_disconnected(libct_context_t* context, libct_device_t* device);
+void LIBCTAPI cb_on_connect_error(libct_context_t* context, libct_device_t* device, const char* error);
+void LIBCTAPI cb_on_connect_timedout(libct_context_t* context, libct_device_t* device);
 
 std::string GetCurrentTimeForFileName()
 {
     auto time = std::time(nullptr);
     std::stringstream ss;
-    ss << std::put_time(std::localtime(&time), "%F_%T") << ".csv"; // ISO 8601 without timezone information.
+    ss << std::put_time(std::localtime(&time), "%F_%T"); // ISO 8601 without timezone information.
     auto s = ss.str();
     std::replace(s.begin(), s.end(), ':', '-');
     return s;
@@ -30,7 +36,39 @@ uint64_t timeSinceEpochMillisec() {
   return duration_cast<milliseconds>(system_clock::now().time_since_epoch()).count();
 }
 
-CaretakerHandler::CaretakerHandler(std::shared_ptr<IInterface> io) : io(io), fileOut(",",5) /*trigger, label, value, timestamp, computer timestamp*/ {
+uint64_t timeSinceEpochMicrosec() {
+  using namespace std::chrono;
+  return duration_cast<microseconds>(system_clock::now().time_since_epoch()).count();
+}
+
+#define CSV_ROW_MAX 160 //two 24 byte text fields, three integers and separators with room to spare
+
+//quoted the way CSVWriter quotes, so recovered and live files read the same
+static size_t format_csv_field(char* out, size_t cap, const char* s) {
+    bool quote = strchr(s, '"') || strchr(s, ',');
+    size_t n = 0;
+    if (quote && n < cap) out[n++] = '"';
+    for (; *s && n + 2 < cap; s++) {
+        if (*s == '"') out[n++] = '"';
+        out[n++] = *s;
+    }
+    if (quote && n < cap) out[n++] = '"';
+    return n;
+}
+
+//one row preceded by the line break, as the file has no trailing newline
+static size_t format_csv_row(char* out, size_t cap, int trigger, const char* label, const char* value,
+    long long ct_timestamp, unsigned long long pc_timestamp) {
+    if (cap < CSV_ROW_MAX) return 0;
+    int n = snprintf(out, cap, "\n%d,", trigger);
+    n += (int)format_csv_field(out + n, 40, label);
+    out[n++] = ',';
+    n += (int)format_csv_field(out + n, 40, value);
+    n += snprintf(out + n, cap - n, ",%lld,%llu", ct_timestamp, pc_timestamp);
+    return (size_t)n;
+}
+
+CaretakerHandler::CaretakerHandler(std::shared_ptr<IInterface> io, std::shared_ptr<ConfigStore> config, EpochConfig epoch_config, int wal_sync_ms) : io(io), config(config), epochs(epoch_config), wal(wal_sync_ms), supervisor(hd.context, [io](std::string s){io->log(s);}), strategy(hd.context, [io](std::string s){io->log(s);}) {
     io->log("Initialising Caretaker Library...");
     memset(&hd.init_data, 0, sizeof(hd.init_data));
     hd.init_data.device_class = LIBCT_DEVICE_CLASS_USB;
@@ -41,6 +79,9 @@ CaretakerHandler::CaretakerHandler(std::shared_ptr<IInterface> io) : io(io), fil
     hd.callbacks.on_data_received = cb_on_data_received;
     hd.callbacks.on_start_measuring = cb_on_start_measuring;
     hd.callbacks.on_start_monitoring = cb_on_start_monitoring;
+    hd.callbacks.on_device_disconnected = cb_on_device_disconnected;
+    hd.callbacks.on_connect_error = cb_on_connect_error;
+    hd.callbacks.on_connect_timedout = cb_on_connect_timedout;
     hd.context = NULL;
     hd.status = libct_init(&hd.context, &hd.init_data, &hd.callbacks);
     libct_set_app_specific_data(hd.context, this);
@@ -49,41 +90,263 @@ CaretakerHandler::CaretakerHandler(std::shared_ptr<IInterface> io) : io(io), fil
         exit(1);
     } else
     io->log("Caretaker Library Initialised Successfully");
-    filename = GetCurrentTimeForFileName();
-    fileOut << "trigger" << "datatype" << "recent value" << "ct timestamp" << "computer timestamp";
-    fileOut.writeToFile(filename);
+    erp = std::make_shared<ErpAverages>(epoch_config);
+    std::atomic_store(&io->erp, erp);
+    stats = std::make_shared<StreamStats>();
+    std::atomic_store(&io->stats, stats);
+    live = std::make_shared<LiveValues>();
+    std::atomic_store(&io->live, live);
+    //runs on the libct callback thread, the config file is written later by save_known_devices
+    strategy.on_device = [this](const std::string& address, const std::string& name, bool connected) {
+        KnownDevice d;
+        d.address = address;
+        d.name = name;
+        d.last_seen_ms = timeSinceEpochMillisec();
+        d.last_connected_ms = connected ? d.last_seen_ms : 0;
+        std::lock_guard<std::mutex> lock(sightings_mutex);
+        sightings.push_back(d);
+    };
+    supervisor.on_gap = [this](const DataGap& gap) {record_gap(gap);};
+    supervisor.restart_measuring = [this]{begin_measuring();};
+    //the data thread only folds the epoch in, the summary is built and logged by update_stats
+    epochs.on_epoch = [this](const Epoch& e) {
+        if (erp->add_epoch(e)) erp_updated.fetch_or(1u << e.trigger, std::memory_order_relaxed);
+    };
+}
+
+void CaretakerHandler::open_session(const std::string& output_dir) {
+    std::string wal_path = output_dir + "/" WAL_FILE;
+    WriteAheadLog::recover(wal_path, [this](std::string s){io->log(s);});
+    session_name = output_dir + "/" + GetCurrentTimeForFileName();
+    filename = session_name + ".csv";
+    //trigger, label, value, timestamp, computer timestamp; rows are appended as "\n<row>"
+    csv_file = fopen(filename.c_str(), "wb");
+    if (csv_file) {
+        fputs("trigger,datatype,recent value,ct timestamp,computer timestamp", csv_file);
+        fflush(csv_file);
+    } else io->log("Failed to create " + filename);
+    if (!wal.open(wal_path, session_name))
+        io->log("Failed to open write-ahead log " + wal_path + ", rows will not survive a crash");
+    if (!epochs.open(session_name + ".epochs"))
+        io->log("Failed to create epoch file " + session_name + ".epochs");
+    if (!store.open(session_name + ".cts"))
+        io->log("Failed to create session store " + session_name + ".cts");
+    if (!param_pulse.open(session_name + ".ppulse"))
+        io->log("Failed to create param pulse file " + session_name + ".ppulse");
+    if (!edf.open(session_name + ".edf"))
+        io->log("Failed to create EDF file " + session_name + ".edf");
+    if (!brainvision.open(session_name))
+        io->log("Failed to create BrainVision files " + session_name + ".vhdr/.vmrk/.eeg");
+    if (LslOutlet::available() && !lsl.is_open()) {
+        if (lsl.open("caretaker")) io->log("LSL outlets Caretaker Pulse, Caretaker Vitals and Caretaker Markers open");
+        else io->log("Failed to create LSL outlets");
+    }
 }
 
 bool CaretakerHandler::connect_to_single_device() {
-    int err = libct_start_discovery(hd.context, DISCOVER_TIMEOUT);
-    if (err == LIBCT_COMMON_STATUS_ERROR) {
-        return false;
-    } return true;
+    AppConfig cfg = config->get();
+    supervisor.discover_timeout_ms = cfg.discover_timeout_ms;
+    return strategy.start(cfg.devices, cfg.discover_timeout_ms);
 }
 
 void CaretakerHandler::start_device_readings() {
+    reserve_session_memory();
+    epochs.reset();
+    erp->clear();
+    supervisor.set_measuring(true);
+    begin_measuring();
+}
+
+//everything the recording would otherwise grow into is sized and faulted in before it starts
+void CaretakerHandler::reserve_session_memory() {
+    if (arena.capacity()) return;
+    AppConfig cfg = config->get();
+    SessionBudget budget(cfg.expected_minutes);
+    auto t0 = std::chrono::steady_clock::now();
+    if (!arena.reserve(budget.arena_bytes(), cfg.lock_memory))
+        io->log("Could not reserve " + std::to_string(budget.arena_bytes() / 1024) + " KiB session memory, using the heap");
+    csv_rows = (char*)arena.allocate(budget.csv_bytes);
+    if (!csv_rows) {
+        csv_heap.resize(budget.csv_bytes);
+        csv_rows = csv_heap.data();
+    }
+    csv_capacity = budget.csv_bytes;
+    store.reserve(arena, budget);
+    param_pulse.place(arena);
+    wal.reserve(budget.wal_records);
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+    if (arena.capacity())
+        io->log("Reserved " + std::to_string(arena.capacity() / 1024) + " KiB session memory for " + std::to_string(budget.minutes)
+            + " min in " + std::to_string((int)ms) + " ms" + (cfg.lock_memory ? (arena.locked() ? ", locked" : ", lock failed") : ""));
+}
+
+void CaretakerHandler::begin_measuring() {
     libct_cal_t cal;
     cal.type = LIBCT_AUTO_CAL;
-    cal.config.auto_cal.posture = libct_posture_t::LIBCT_POSTURE_SITTING;
+    cal.config.auto_cal.posture = config->get().posture_value();
     libct_start_measuring(hd.context, &cal);
 }
 
 void CaretakerHandler::stop_device_readings() {
+    supervisor.stop();
     libct_stop_measuring(hd.context);
     libct_stop_monitoring(hd.context);
     io->log("Measurements stopped!");
+    if (epochs.pending() > 0)
+        io->log("Discarded " + std::to_string(epochs.pending()) + " incomplete epochs");
+    io->log(std::to_string(epochs.written()) + " epochs written to " + session_name + ".epochs");
+    store.flush();
+    param_pulse.flush();
+    edf.flush();
+    brainvision.flush();
+    stats->aggregate(0);
+    io->log(stats->summary());
+    io->log(latency_report());
+    io->log(std::to_string(store.rows()) + " rows stored in " + std::to_string(store.bytes()) + " bytes to " + session_name + ".cts");
+    io->log(std::to_string(param_pulse.records()) + " param pulses stored in " + std::to_string(param_pulse.bytes()) + " bytes to " + session_name + ".ppulse");
+    io->log(std::to_string(edf.records()) + " EDF records written to " + session_name + ".edf"
+        + (edf.late_samples() ? ", " + std::to_string(edf.late_samples()) + " late samples dropped" : ""));
+    io->log(std::to_string(brainvision.points()) + " points and " + std::to_string(brainvision.markers()) + " markers written to "
+        + session_name + ".vhdr");
+    WalStats ws = wal.stats();
+    io->log("Journal: " + std::to_string(ws.records) + " records, " + std::to_string(ws.syncs) + " syncs, max sync "
+        + std::to_string(ws.sync_max_ms) + " ms");
+    io->log("Session memory: " + std::to_string(arena.used() / 1024) + " of " + std::to_string(arena.capacity() / 1024)
+        + " KiB used, " + std::to_string(arena.fallbacks()) + " heap fallbacks");
 }
 
-void CaretakerHandler::recordLastTimestamp(int triggerNum) {
-    std::time_t localTime = std::time(nullptr);
-    for (auto& datatype : hd.recentData) {
-        fileOut << triggerNum << datatype.first << datatype.second.data << datatype.second.timestamp << timeSinceEpochMillisec();
+CaretakerHandler::~CaretakerHandler() {
+    if (csv_file) fclose(csv_file);
+    wal.close();
+    WalStats ws = wal.stats();
+    std::cout << "Write-ahead log: " << ws.records << " records, " << ws.syncs << " syncs, "
+              << ws.sync_total_ms << " ms total, " << ws.sync_max_ms << " ms max" << std::endl;
+}
+
+void CaretakerHandler::update_stats() {
+    uint32_t updated = erp_updated.exchange(0, std::memory_order_relaxed);
+    for (int c = 1; c <= ErpAverages::NUM_CONDITIONS; c++)
+        if (updated & (1u << c)) io->log(erp->summary(c));
+    if (!stats->aggregate()) return;
+    StreamRates rates[STREAM_COUNT];
+    stats->snapshot(rates);
+    metrics.publish_streams(rates);
+    metrics.publish_latency();
+    WalStats ws = wal.stats();
+    metrics.program_state = get_state();
+    metrics.connected = isConnected.load();
+    metrics.wal_queued = wal.queued();
+    metrics.wal_records = ws.records;
+    metrics.wal_sync_max_ms = ws.sync_max_ms;
+    metrics.store_rows = store.rows();
+    metrics.store_bytes = store.bytes();
+    metrics.epochs_pending = epochs.pending();
+    metrics.epochs_written = epochs.written();
+    metrics.connection_gaps = supervisor.gaps();
+    if (hd.started && ++stats_seconds % STATS_LOG_INTERVAL == 0)
+        io->log(stats->summary());
+    //the exports write the table's sample rate, say so once if the device disagrees
+    std::string problem;
+    if (!sample_rates_checked && stats->check_sample_rates(problem)) {
+        sample_rates_checked = true;
+        if (!problem.empty()) io->log("Warning: " + problem);
     }
-    std::cout << "Writing " << hd.recentData.size() << " data readings to file" << std::endl;
-    fileOut.writeToFile(filename);
+}
+
+void CaretakerHandler::save_known_devices() {
+    std::vector<KnownDevice> seen;
+    {
+        std::lock_guard<std::mutex> lock(sightings_mutex);
+        if (sightings.empty()) return;
+        seen.swap(sightings);
+    }
+    config->update([&](AppConfig& c) {
+        for (auto& d : seen) ConnectionStrategy::remember(c.devices, d.address, d.name, d.last_seen_ms, d.last_connected_ms);
+    });
+}
+
+void CaretakerHandler::record_gap(const DataGap& gap) {
+    TRACE_SCOPE("record gap");
+    std::lock_guard<std::mutex> lock(file_mutex);
+    char duration[24];
+    snprintf(duration, sizeof(duration), "%lld", (long long)(gap.pc_end_ms - gap.pc_start_ms));
+    char rows[2 * CSV_ROW_MAX];
+    size_t len = format_csv_row(rows, sizeof(rows), 0, "gap_start", gap.reason.c_str(), gap.last_device_ts, gap.pc_start_ms);
+    len += format_csv_row(rows + len, sizeof(rows) - len, 0, "gap_end", duration, gap.first_device_ts, gap.pc_end_ms);
+    wal.append(0, "gap_start", gap.reason.c_str(), gap.last_device_ts, gap.pc_start_ms);
+    wal.append(0, "gap_end", duration, gap.first_device_ts, gap.pc_end_ms);
+    write_csv_rows(rows, len);
+    edf.annotate(gap.last_device_ts, "gap " + gap.reason);
+    brainvision.comment(gap.last_device_ts, "gap " + gap.reason);
+}
+
+void CaretakerHandler::record_transition(const StateMachine::Record& r) {
+    wal.append_transition(r.event, get_name(r.from).c_str(), get_name(r.to).c_str(), (int64_t)r.in_state_ms,
+        (uint32_t)r.took_us, timeSinceEpochMillisec());
+}
+
+void CaretakerHandler::write_csv_rows(const char* rows, size_t len) {
+    if (!csv_file || len == 0) return;
+    fwrite(rows, 1, len, csv_file);
+    fflush(csv_file);
+}
+
+void CaretakerHandler::recordLastTimestamp(int triggerNum, std::chrono::steady_clock::time_point at) {
+    TRACE_SCOPE("record trigger");
+    std::lock_guard<std::mutex> lock(file_mutex);
+    //the wall clock of the moment the byte went out, not of this call
+    uint64_t now = timeSinceEpochMillisec() - (uint64_t)std::max<long long>(0,
+        std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - at).count());
+    size_t len = 0;
+    int readings = 0;
+    for (int s = 0; s < STREAM_COUNT; s++) {
+        StreamRow row;
+        if (!live->read(s, row)) continue;
+        const StreamDesc& d = stream_desc(s);
+        for (int f = d.first_field; f < d.first_field + d.field_count; f++) {
+            const char* label = field_desc(f).trigger_label;
+            if (!label) continue;
+            char value[32];
+            format_field(f, row, value, sizeof(value));
+            //a full buffer goes out early rather than dropping rows
+            if (csv_capacity - len < CSV_ROW_MAX) {
+                write_csv_rows(csv_rows, len);
+                len = 0;
+            }
+            len += format_csv_row(csv_rows + len, csv_capacity - len, triggerNum, label, value, row.timestamp, now);
+            wal.append(triggerNum, label, value, row.timestamp, now);
+            readings++;
+        }
+    }
+    std::cout << "Writing " << readings << " data readings to file" << std::endl;
+    //only the new rows are appended, the journal covers anything lost before they reach disk
+    {
+        TRACE_SCOPE("csv flush");
+        write_csv_rows(csv_rows, len);
+    }
+    long long anchor = epochs.add_trigger(triggerNum, at);
+    if (anchor >= 0) {
+        edf.annotate(anchor, std::to_string(triggerNum));
+        brainvision.stimulus(anchor, triggerNum);
+        lsl.marker(anchor, triggerNum);
+    }
+    metrics.triggers++;
 }
 ///CALLBACKS///
 
+namespace {
+//the callback's share of each stream: latest row for triggers and the display, and the stream statistics
+struct CaptureSink {
+    CaretakerHandler* handler;
+    long receive_time;
+    void row(STREAM_ID, const StreamRow&) {}
+    void packet(STREAM_ID stream, const StreamPacket& p) {
+        handler->live->update(stream, *p.last);
+        handler->stats->record(stream, p.rows, p.bytes, p.first_ts, p.last_ts, receive_time);
+    }
+};
+}
+
 void LIBCTAPI cb_on_start_measuring(libct_context_t *context, libct_device_t *device, int status) {
     CaretakerHandler* handler = (CaretakerHandler*) libct_get_app_specific_data(context);
     handler->hd.started = true;
@@ -94,13 +357,14 @@ void LIBCTAPI cb_on_device_discovered(libct_context_t* context, libct_device_t*
     CaretakerHandler* handler = (CaretakerHandler*) libct_get_app_specific_data(context);
     handler->io->log("Successfully detected a caretaker device: " + std::string(device->get_name(device)));
     handler->io->log("Attempting to connect...");
-    libct_stop_discovery(context);
-    libct_connect(context, device);
+    handler->strategy.on_discovered(device);
 }
 
 void LIBCTAPI cb_on_discovery_timedout(libct_context_t* context){
     CaretakerHandler* handler = (CaretakerHandler*) libct_get_app_specific_data(context);
     handler->io->log("Could not discover any caretaker devices before timeout");
+    handler->strategy.on_discovery_timeout();
+    handler->supervisor.on_attempt_failed();
 }
 
 void LIBCTAPI cb_on_discovery_failed(libct_context_t* context, int error){
@@ -109,17 +373,33 @@ void LIBCTAPI cb_on_discovery_failed(libct_context_t* context, int error){
 }
 
 void LIBCTAPI cb_on_device_connected_ready(libct_context_t* context, libct_device_t* device){
-   int flags = (LIBCT_MONITOR_INT_PULSE |
-                LIBCT_MONITOR_VITALS |
-                LIBCT_MONITOR_VITALS2 |
-                LIBCT_MONITOR_CUFF_PRESSURE |
-                LIBCT_MONITOR_DEVICE_STATUS);
-
-    
-    libct_start_monitoring(context, flags);
+   TRACE_SCOPE("on_device_connected_ready");
     CaretakerHandler* handler = (CaretakerHandler*) libct_get_app_specific_data(context);
+    libct_start_monitoring(context, handler->config->get().monitor_flags());
     handler->io->log("Successfully connected to caretaker device! " + std::string(device->get_name(device)));
     handler->isConnected = true;
+    handler->strategy.on_connected(device);
+    handler->supervisor.on_connected(device);
+}
+
+void LIBCTAPI cb_on_device_disconnected(libct_context_t* context, libct_device_t* device) {
+    CaretakerHandler* handler = (CaretakerHandler*) libct_get_app_specific_data(context);
+    handler->isConnected = false;
+    handler->supervisor.on_disconnected();
+}
+
+void LIBCTAPI cb_on_connect_error(libct_context_t* context, libct_device_t* device, const char* error) {
+    CaretakerHandler* handler = (CaretakerHandler*) libct_get_app_specific_data(context);
+    handler->io->log("Connect failed: " + std::string(error ? error : "unknown error"));
+    handler->strategy.on_connect_failed(device);
+    handler->supervisor.on_attempt_failed();
+}
+
+void LIBCTAPI cb_on_connect_timedout(libct_context_t* context, libct_device_t* device) {
+    CaretakerHandler* handler = (CaretakerHandler*) libct_get_app_specific_data(context);
+    handler->io->log("Connect timed out");
+    handler->strategy.on_connect_failed(device);
+    handler->supervisor.on_attempt_failed();
 }
 
 void LIBCTAPI cb_on_start_monitoring(libct_context_t *context, libct_device_t *device, int status) {
@@ -131,43 +411,29 @@ void LIBCTAPI cb_on_start_monitoring(libct_context_t *context, libct_device_t *d
 }
 
 void LIBCTAPI cb_on_data_received(libct_context_t *context, libct_device_t *device, libct_stream_data_t *data) {
+    TRACE_THREAD_NAME("libct callback");
+    register_thread(ROLE_CALLBACK);
+    TRACE_SCOPE("on_data_received");
     CaretakerHandler* handler = (CaretakerHandler*) libct_get_app_specific_data(context);
     if (handler == 0) throw std::runtime_error(std::string("Couldn't find handler"));
+    handler->supervisor.on_data(data->int_pulse.count > 0 ? data->int_pulse.timestamps[data->int_pulse.count-1] : -1);
     if (handler->hd.started == false) return;
 
-    if (data->int_pulse.count > 0) {
-        handler->hd.recentData["int pulse"].timestamp = (unsigned long long) data->int_pulse.timestamps[data->int_pulse.count-1];
-        handler->hd.recentData["int pulse"].data = std::to_string(data->int_pulse.samples[data->int_pulse.count-1]);
+    handler->epochs.push_pulse(data->int_pulse.samples, data->int_pulse.timestamps, data->int_pulse.count);
+    handler->epochs.push_vitals(data->vitals.datapoints, data->vitals.count);
+    handler->epochs.push_vitals2(data->vitals2.datapoints, data->vitals2.count);
+    handler->store.push(data);
+    handler->param_pulse.push(data->param_pulse.datapoints, data->param_pulse.count);
+    handler->edf.push(data);
+    handler->brainvision.push(data);
+    handler->lsl.push(data);
+    if (data->receive_time > 0) {
+        //receive_time is on the library's own clock, so only the excess over the best case is measurable
+        long long offset_us = (long long)timeSinceEpochMicrosec() - (long long)data->receive_time * 1000;
+        if (offset_us < handler->receive_offset_us) handler->receive_offset_us = offset_us;
+        latency_histogram(LATENCY_RECEIVE_TO_STORED).record((uint64_t)(offset_us - handler->receive_offset_us));
     }
-    if (data->device_status.valid) {
-        handler->hd.recentData["status"].timestamp = (unsigned long long) data->device_status.timestamp;
-        handler->hd.recentData["status"].data = "n/a";
-    }
-    if (data->cuff_pressure.count > 0) {
-        handler->hd.recentData["cuff"].timestamp =  (unsigned long long) data->cuff_pressure.datapoints[data->cuff_pressure.count-1].timestamp;
-        handler->hd.recentData["cuff"].data = std::to_string(data->cuff_pressure.datapoints[data->cuff_pressure.count-1].value);
-    }
-    if (data->vitals.count > 0) {
-        int num_vals = data->vitals.count;
-        unsigned long long timestamp = (unsigned long long) data->vitals.datapoints[num_vals-1].timestamp;
-        handler->hd.recentData["systolic"].timestamp = timestamp;
-        handler->hd.recentData["systolic"].data = std::to_string(data->vitals.datapoints[num_vals-1].systolic);
-        handler->hd.recentData["diastolic"].timestamp = timestamp;
-        handler->hd.recentData["diastolic"].data = std::to_string(data->vitals.datapoints[num_vals-1].diastolic);
-        handler->hd.recentData["heart_rate"].timestamp = timestamp;
-        handler->hd.recentData["heart_rate"].data = std::to_string(data->vitals.datapoints[num_vals-1].heart_rate);
-        handler->hd.recentData["map"].timestamp = timestamp;
-        handler->hd.recentData["map"].data = std::to_string(data->vitals.datapoints[num_vals-1].map);
-        handler->hd.recentData["respiration"].timestamp = timestamp;
-        handler->hd.recentData["respiration"].data = std::to_string(data->vitals.datapoints[num_vals-1].respiration);
-    }
-    if (data->vitals2.count > 0) {
-        int num_vals = data->vitals2.count;
-        unsigned long long timestamp = (unsigned long long) data->vitals2.datapoints[num_vals-1].timestamp;
-        handler->hd.recentData["stroke_volume"].timestamp = timestamp;
-        handler->hd.recentData["stroke_volume"].data = std::to_string(data->vitals2.datapoints[num_vals-1].strokeVolume);
-        handler->hd.recentData["cardiac_output"].timestamp = timestamp;
-        handler->hd.recentData["cardiac_output"].data = std::to_string(data->vitals2.datapoints[num_vals-1].cardiac_output);
-    }
-    
-}
\ No newline at end of file
+
+    CaptureSink sink{handler, data->receive_time};
+    ingest_streams(data, sink);
+}
@@ -2,33 +2,85 @@
 
 #include <caretaker_static.h>
 #include "iinterface.hpp"
-#include "CSVWriter.h"
-#include <map>
+#include "epoching.hpp"
+#include "erp_average.hpp"
+#include "session_store.hpp"
+#include "write_ahead_log.hpp"
+#include "connection_supervisor.hpp"
+#include "stream_stats.hpp"
+#include "stream_table.hpp"
+#include "metrics_endpoint.hpp"
+#include "app_config.hpp"
+#include "connection_strategy.hpp"
+#include "session_arena.hpp"
+#include "param_pulse.hpp"
+#include "edf_writer.hpp"
+#include "brainvision_writer.hpp"
+#include "lsl_outlet.hpp"
+#include <cstdio>
+#include <mutex>
+#include <atomic>
+#include <climits>
 
-struct DataRecord {
-    unsigned long long timestamp;
-    std::string data; //unused
-};
 struct HandlerData{
     libct_init_data_t init_data;
     libct_app_callbacks_t callbacks = {};
     libct_context_t* context = NULL;
-    std::map<std::string, DataRecord> recentData; //type, data;
     bool started = false;
     int status;
 };
 
 class CaretakerHandler {
 public:
-    CaretakerHandler(std::shared_ptr<IInterface> io);
+    CaretakerHandler(std::shared_ptr<IInterface> io, std::shared_ptr<ConfigStore> config, EpochConfig epoch_config = EpochConfig(), int wal_sync_ms = 1000);
+    ~CaretakerHandler();
+    //recovers any unfinished session and creates this session's files in output_dir
+    void open_session(const std::string& output_dir);
     bool connect_to_single_device();
     void start_device_readings();
     void stop_device_readings();
-    void recordLastTimestamp(int triggerNum);
-    bool isConnected = false;
+    //at is when the trigger byte went out; the readings are the latest ones, the anchors and PC time are at
+    void recordLastTimestamp(int triggerNum, std::chrono::steady_clock::time_point at = std::chrono::steady_clock::now());
+    const std::string& session() const {return session_name;} //path of the session files without extension
+    std::atomic<bool> isConnected{false};
     HandlerData hd;
     std::shared_ptr<IInterface> io;
+    std::shared_ptr<ConfigStore> config;
+    EpochEngine epochs;
+    std::shared_ptr<ErpAverages> erp;
+    //reserved at the first Start, holds what grows with the session; declared before what is
+    //placed in it so it is destroyed after them
+    SessionArena arena;
+    SessionStoreWriter store;
+    ParamPulseWriter param_pulse;
+    EdfWriter edf;
+    BrainVisionWriter brainvision;
+    LslOutlet lsl; //only publishes in CARETAKER_LSL builds
+    WriteAheadLog wal;
+    ConnectionSupervisor supervisor;
+    ConnectionStrategy strategy;
+    std::shared_ptr<StreamStats> stats;
+    std::shared_ptr<LiveValues> live; //latest row of each stream, what a trigger records
+    Metrics metrics; //published from update_stats, read by the metrics endpoint
+    void update_stats(); //once per main loop pass, aggregates at 1 Hz and logs updated ERP averages
+    void save_known_devices(); //main loop, writes devices the strategy reported to the config
+    long long receive_offset_us = LLONG_MAX; //smallest wall clock minus receive_time seen, callback thread only
+    void record_gap(const DataGap& gap);
+    void record_transition(const StateMachine::Record& r); //journalled only, the CSV holds readings
 private:
-    CSVWriter fileOut;
+    void begin_measuring();
+    void reserve_session_memory();
+    void write_csv_rows(const char* rows, size_t len);
+    int stats_seconds = 0;
+    bool sample_rates_checked = false;
+    std::mutex sightings_mutex;
+    std::vector<KnownDevice> sightings; //reported by the strategy, not yet in the config
+    std::atomic<uint32_t> erp_updated{0}; //bit c set when condition c gained an epoch since the last update_stats
+    std::mutex file_mutex;
+    FILE* csv_file = nullptr;
+    char* csv_rows = nullptr;  //one trigger's rows, formatted before a single write
+    size_t csv_capacity = 0;
+    std::vector<char> csv_heap; //only if the arena could not be reserved
+    std::string session_name;
     std::string filename;
 };
\ No newline at end of file
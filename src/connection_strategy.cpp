@@ -0,0 +1,159 @@
+#include "connection_strategy.hpp"
+#include <algorithm>
+
+static std::string address_of(libct_device_t* device) {
+    const char* addr = device ? libct_device_get_address(device) : nullptr;
+    return addr ? addr : "";
+}
+
+ConnectionStrategy::ConnectionStrategy(libct_context_t*& context, std::function<void(std::string)> log)
+    : context(context), log(log) {
+}
+
+void ConnectionStrategy::order(std::vector<KnownDevice>& devices) {
+    std::stable_sort(devices.begin(), devices.end(), [](const KnownDevice& a, const KnownDevice& b) {
+        if (a.last_connected_ms != b.last_connected_ms) return a.last_connected_ms > b.last_connected_ms;
+        return a.last_seen_ms > b.last_seen_ms;
+    });
+}
+
+void ConnectionStrategy::remember(std::vector<KnownDevice>& devices, const std::string& address, const std::string& name,
+    uint64_t seen_ms, uint64_t connected_ms) {
+    if (address.empty()) return;
+    auto it = std::find_if(devices.begin(), devices.end(), [&](const KnownDevice& d) {return d.address == address;});
+    if (it == devices.end()) {
+        devices.push_back(KnownDevice());
+        it = devices.end() - 1;
+        it->address = address;
+    }
+    if (!name.empty()) it->name = name;
+    it->last_seen_ms = std::max(it->last_seen_ms, seen_ms);
+    it->last_connected_ms = std::max(it->last_connected_ms, connected_ms);
+    order(devices);
+    if (devices.size() > MAX_KNOWN) devices.resize(MAX_KNOWN);
+}
+
+double ConnectionStrategy::elapsed_ms() {
+    return std::chrono::duration<double, std::milli>(Clock::now() - started).count();
+}
+
+//the decisions are made under mtx, libct is called after releasing it as its callbacks lock it again
+bool ConnectionStrategy::start(std::vector<KnownDevice> known, int timeout_ms) {
+    uint64_t expected;
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        order(known);
+        candidates = known;
+        candidate = 0;
+        discover_timeout_ms = timeout_ms;
+        started = Clock::now();
+        phase = DIRECT;
+        expected = ++attempt;
+    }
+    next_candidate(expected);
+    return active();
+}
+
+void ConnectionStrategy::next_candidate(uint64_t expected) {
+    for (;;) {
+        KnownDevice d;
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            //a callback or tick has moved on since expected was taken
+            if (phase != DIRECT || attempt != expected) return;
+            if (candidate == candidates.size()) break;
+            d = candidates[candidate++];
+            pending_address = d.address;
+            attempt_deadline = Clock::now() + std::chrono::milliseconds(direct_timeout_ms);
+            expected = ++attempt;
+        }
+        log("Trying known device " + (d.name.empty() ? d.address : d.name + " at " + d.address));
+        if (LIBCT_SUCCEEDED(libct_connect_to_address(context, d.address.c_str()))) return;
+    }
+    begin_discovery();
+}
+
+void ConnectionStrategy::begin_discovery() {
+    int timeout_ms;
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        pending_address.clear();
+        if (!candidates.empty())
+            log("No known device answered after " + std::to_string((int)elapsed_ms()) + " ms, discovering");
+        //set first, libct may report a device before libct_start_discovery returns
+        phase = DISCOVERING;
+        timeout_ms = discover_timeout_ms;
+    }
+    libct_stop_discovery(context);
+    if (LIBCT_SUCCEEDED(libct_start_discovery(context, timeout_ms))) return;
+    log("Failed to begin Caretaker discovery (check usb/bluetooth)");
+    std::lock_guard<std::mutex> lock(mtx);
+    if (phase == DISCOVERING) phase = IDLE;
+}
+
+void ConnectionStrategy::on_discovered(libct_device_t* device) {
+    std::string address = address_of(device);
+    std::string name = device->get_name(device);
+    if (on_device) on_device(address, name, false);
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        if (phase == DISCOVERING) {
+            log("Discovered " + name + " after " + std::to_string((int)elapsed_ms()) + " ms, connecting");
+            phase = CONNECTING;
+        }
+    }
+    //the first device reported ends discovery, there is nothing to gain from waiting out the timeout
+    libct_stop_discovery(context);
+    libct_connect(context, device);
+}
+
+void ConnectionStrategy::on_discovery_timeout() {
+    std::lock_guard<std::mutex> lock(mtx);
+    if (phase == DISCOVERING) phase = IDLE;
+}
+
+void ConnectionStrategy::on_connect_failed(libct_device_t* device) {
+    uint64_t expected;
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        if (phase == CONNECTING) {
+            phase = IDLE;
+            return;
+        }
+        //a late failure from an attempt that already timed out must not skip the current one
+        if (phase != DIRECT || (device && address_of(device) != pending_address)) return;
+        expected = attempt;
+    }
+    next_candidate(expected);
+}
+
+void ConnectionStrategy::on_connected(libct_device_t* device) {
+    std::string address = address_of(device);
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        if (phase != IDLE)
+            log("Connected in " + std::to_string((int)elapsed_ms()) + " ms" + (phase == DIRECT ? " to a known device" : " via discovery"));
+        phase = IDLE;
+        pending_address.clear();
+    }
+    if (on_device) on_device(address, device->get_name(device), true);
+}
+
+void ConnectionStrategy::tick() {
+    uint64_t expected;
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        if (phase != DIRECT || Clock::now() < attempt_deadline) return;
+        log("No answer from " + pending_address + " within " + std::to_string(direct_timeout_ms) + " ms");
+        //stops the failure callback of the abandoned attempt from advancing a second time
+        pending_address.clear();
+        expected = attempt;
+    }
+    libct_disconnect(context);
+    next_candidate(expected);
+}
+
+bool ConnectionStrategy::active() {
+    std::lock_guard<std::mutex> lock(mtx);
+    return phase != IDLE;
+}
@@ -0,0 +1,57 @@
+#pragma once
+#include <caretaker_static.h>
+#include <chrono>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "app_config.hpp"
+
+/* Decides how the first connection of a session is made. Known devices are tried one after
+ * another with libct_connect_to_address (a context holds one pending connect, so not in parallel),
+ * each with a short timeout. Only when none answers does it fall back to discovery, which is cut
+ * off at the first device reported instead of running to its timeout. Every device seen is kept
+ * in a cache with its last-seen time so later sessions can skip discovery. */
+class ConnectionStrategy {
+public:
+    typedef std::chrono::steady_clock Clock;
+    static constexpr size_t MAX_KNOWN = 8;
+
+    ConnectionStrategy(libct_context_t*& context, std::function<void(std::string)> log);
+
+    //most recently connected first, then most recently seen
+    static void order(std::vector<KnownDevice>& devices);
+    //records a sighting or a connection in the cache, keeping it ordered and bounded
+    static void remember(std::vector<KnownDevice>& devices, const std::string& address, const std::string& name,
+        uint64_t seen_ms, uint64_t connected_ms);
+
+    bool start(std::vector<KnownDevice> known, int discover_timeout_ms);
+    void on_discovered(libct_device_t* device);
+    void on_discovery_timeout();
+    void on_connect_failed(libct_device_t* device);
+    void on_connected(libct_device_t* device);
+    void tick();
+    bool active();
+
+    int direct_timeout_ms = 1500;
+    //called on the libct callback thread, must not block
+    std::function<void(const std::string& address, const std::string& name, bool connected)> on_device;
+private:
+    enum PHASE {IDLE, DIRECT, DISCOVERING, CONNECTING};
+    //tries the remaining known devices, then discovery, unless attempt has moved past expected
+    void next_candidate(uint64_t expected);
+    void begin_discovery();
+    double elapsed_ms();
+
+    libct_context_t*& context;
+    std::function<void(std::string)> log;
+    std::mutex mtx;
+    PHASE phase = IDLE;
+    std::vector<KnownDevice> candidates;
+    size_t candidate = 0;
+    int discover_timeout_ms = 10000;
+    Clock::time_point started;
+    Clock::time_point attempt_deadline;
+    std::string pending_address;
+    uint64_t attempt = 0; //bumped for every connect started, so a stale caller cannot advance twice
+};
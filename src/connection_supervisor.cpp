@@ -0,0 +1,152 @@
+#include "connection_supervisor.hpp"
+#include <algorithm>
+
+static uint64_t now_ms() {
+    using namespace std::chrono;
+    return duration_cast<milliseconds>(system_clock::now().time_since_epoch()).count();
+}
+
+ConnectionSupervisor::ConnectionSupervisor(libct_context_t*& context, std::function<void(std::string)> log)
+    : context(context), log(log) {
+}
+
+std::string ConnectionSupervisor::cached_address() {
+    std::lock_guard<std::mutex> lock(mtx);
+    return address;
+}
+
+void ConnectionSupervisor::on_connected(libct_device_t* device) {
+    bool restart = false;
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        const char* addr = device ? libct_device_get_address(device) : nullptr;
+        if (addr && *addr) address = addr;
+        supervising = true;
+        link_down = false;
+        awaiting_ready = false;
+        attempts = 0;
+        backoff_ms = 0;
+        last_data = Clock::now();
+        restart = in_gap && measuring;
+    }
+    //monitoring is restarted by the connected callback itself, measuring has to be requested again
+    if (restart && restart_measuring) restart_measuring();
+}
+
+void ConnectionSupervisor::on_disconnected() {
+    std::lock_guard<std::mutex> lock(mtx);
+    if (!supervising) return;
+    link_down = true;
+    awaiting_ready = false;
+    begin_gap("device disconnected");
+}
+
+void ConnectionSupervisor::on_attempt_failed() {
+    std::lock_guard<std::mutex> lock(mtx);
+    awaiting_ready = false;
+}
+
+void ConnectionSupervisor::on_data(long long device_ts) {
+    DataGap closed;
+    bool ended = false;
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        last_data = Clock::now();
+        have_data = true;
+        if (in_gap && device_ts >= 0) {
+            gap.pc_end_ms = now_ms();
+            gap.first_device_ts = device_ts;
+            closed = gap;
+            in_gap = false;
+            ended = true;
+        }
+        if (device_ts >= 0) last_device_ts = device_ts;
+    }
+    if (ended) {
+        gap_count++;
+        log("Data resumed after " + std::to_string(closed.pc_end_ms - closed.pc_start_ms) + " ms gap (" + closed.reason + ")");
+        if (on_gap) on_gap(closed);
+    }
+}
+
+void ConnectionSupervisor::set_measuring(bool m) {
+    std::lock_guard<std::mutex> lock(mtx);
+    measuring = m;
+    have_data = false;
+    last_data = Clock::now();
+}
+
+void ConnectionSupervisor::stop() {
+    std::lock_guard<std::mutex> lock(mtx);
+    supervising = false;
+    measuring = false;
+    link_down = false;
+    in_gap = false;
+    awaiting_ready = false;
+}
+
+void ConnectionSupervisor::begin_gap(const char* reason) {
+    if (in_gap) return;
+    in_gap = true;
+    gap = DataGap();
+    gap.pc_start_ms = now_ms();
+    gap.last_device_ts = last_device_ts;
+    gap.first_device_ts = -1;
+    gap.reason = reason;
+    backoff_ms = 0;
+    next_attempt = Clock::now();
+    log(std::string("Connection lost: ") + reason + ", reconnecting");
+}
+
+void ConnectionSupervisor::tick() {
+    bool drop = false;
+    Attempt a;
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        if (!supervising) return;
+        auto now = Clock::now();
+        if (!link_down && measuring && have_data && !in_gap
+            && now - last_data > std::chrono::milliseconds(stall_timeout_ms)) {
+            //the link claims to be up but nothing arrives, drop it and reconnect
+            begin_gap("data stalled");
+            link_down = true;
+            drop = true;
+            next_attempt = now;
+        }
+        if (link_down && now >= next_attempt && (!awaiting_ready || now >= attempt_deadline))
+            a = plan_attempt(now);
+    }
+    if (drop) libct_disconnect(context);
+    if (a.number) start_attempt(a);
+}
+
+ConnectionSupervisor::Attempt ConnectionSupervisor::plan_attempt(Clock::time_point now) {
+    Attempt a;
+    a.number = ++attempts;
+    a.direct = !address.empty() && (attempts % (attempts_before_discovery + 1)) != 0;
+    a.address = address;
+    backoff_ms = backoff_ms == 0 ? backoff_min_ms : std::min(backoff_ms * 2, backoff_max_ms);
+    //a discovery run has to be given its full timeout before trying again
+    int wait_ms = a.direct ? backoff_ms : std::max(backoff_ms, discover_timeout_ms);
+    next_attempt = now + std::chrono::milliseconds(wait_ms);
+    attempt_deadline = now + std::chrono::milliseconds(std::max(wait_ms, attempt_timeout_ms));
+    awaiting_ready = true;
+    return a;
+}
+
+void ConnectionSupervisor::start_attempt(const Attempt& a) {
+    int err;
+    if (a.direct) {
+        err = libct_connect_to_address(context, a.address.c_str());
+    } else {
+        libct_stop_discovery(context);
+        err = libct_start_discovery(context, discover_timeout_ms);
+    }
+    bool started = LIBCT_SUCCEEDED(err);
+    if (!started) {
+        std::lock_guard<std::mutex> lock(mtx);
+        if (attempts == a.number) awaiting_ready = false;
+    }
+    log("Reconnect attempt " + std::to_string(a.number) + (a.direct ? " to " + a.address : std::string(" via discovery"))
+        + (started ? "" : " failed to start"));
+}
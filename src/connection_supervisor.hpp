@@ -0,0 +1,74 @@
+#pragma once
+#include <caretaker_static.h>
+#include <chrono>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <atomic>
+
+struct DataGap {
+    uint64_t pc_start_ms;           //computer time the outage was detected
+    uint64_t pc_end_ms;             //computer time data arrived again
+    long long last_device_ts;       //last device timestamp before the outage
+    long long first_device_ts;      //first device timestamp after it
+    std::string reason;
+};
+
+/* Watches the device link once a session is set up and brings it back after a disconnect or a stall.
+ * Reconnects go straight to the cached device address with exponential backoff; discovery is only
+ * used as a fallback. tick() is driven from the main loop, the on_* hooks from libct callbacks. A new
+ * attempt waits for the previous one to fail or time out. libct is never called with the lock held, as
+ * it may run callbacks into the on_* hooks before returning. */
+class ConnectionSupervisor {
+public:
+    typedef std::chrono::steady_clock Clock;
+    ConnectionSupervisor(libct_context_t*& context, std::function<void(std::string)> log);
+
+    void on_connected(libct_device_t* device);
+    void on_disconnected();
+    void on_attempt_failed(); //connect error or timeout, or discovery ended without a device
+    void on_data(long long device_ts);
+    void set_measuring(bool measuring);
+    void stop(); //user initiated disconnect, nothing to recover
+    void tick();
+
+    std::function<void(const DataGap&)> on_gap;
+    std::function<void()> restart_measuring;
+    std::string cached_address();
+    size_t gaps() const {return gap_count;}
+
+    int stall_timeout_ms = 3000;
+    int backoff_min_ms = 250;
+    int backoff_max_ms = 8000;
+    int discover_timeout_ms = 10000;
+    int attempts_before_discovery = 3;
+    int attempt_timeout_ms = 10000; //how long a started attempt may go without an answer from libct
+private:
+    struct Attempt {
+        int number = 0; //0 when there is nothing to attempt
+        bool direct = false;
+        std::string address;
+    };
+    void begin_gap(const char* reason);
+    Attempt plan_attempt(Clock::time_point now);
+    void start_attempt(const Attempt& a);
+
+    libct_context_t*& context;
+    std::function<void(std::string)> log;
+    std::mutex mtx;
+    std::string address;
+    bool supervising = false;
+    bool measuring = false;
+    bool link_down = false;
+    bool in_gap = false;
+    bool awaiting_ready = false;
+    int attempts = 0;
+    int backoff_ms = 0;
+    Clock::time_point next_attempt;
+    Clock::time_point attempt_deadline;
+    Clock::time_point last_data;
+    bool have_data = false;
+    long long last_device_ts = -1;
+    DataGap gap;
+    std::atomic<size_t> gap_count{0};
+};
@@ -0,0 +1,29 @@
+#include "device_status.hpp"
+
+const char* status_flag_name(int flag) {
+    static const char* names[STATUS_FLAG_COUNT] = {
+#define STATUS_NAME(member, label) label,
+        DEVICE_STATUS_FLAGS(STATUS_NAME)
+#undef STATUS_NAME
+    };
+    return flag >= 0 && flag < STATUS_FLAG_COUNT ? names[flag] : "?";
+}
+
+uint64_t pack_device_status(const libct_device_status_t& s) {
+    uint64_t word = 0;
+#define STATUS_PACK(member, label) word |= (uint64_t)(s.member ? 1 : 0) << STATUS_##member;
+    DEVICE_STATUS_FLAGS(STATUS_PACK)
+#undef STATUS_PACK
+    //autocal_pct is a percentage and posture a small enum, a byte each holds them
+    word |= (uint64_t)(uint8_t)s.autocal_pct << STATUS_AUTOCAL_SHIFT;
+    word |= (uint64_t)(uint8_t)s.posture << STATUS_POSTURE_SHIFT;
+    return word;
+}
+
+void unpack_device_status(uint64_t word, libct_device_status_t& s) {
+#define STATUS_UNPACK(member, label) s.member = (word >> STATUS_##member) & 1;
+    DEVICE_STATUS_FLAGS(STATUS_UNPACK)
+#undef STATUS_UNPACK
+    s.autocal_pct = (short)status_autocal_pct(word);
+    s.posture = (short)status_posture(word);
+}
@@ -0,0 +1,65 @@
+#pragma once
+#include <caretaker_static.h>
+#include <cstdint>
+
+/* libct_device_status_t packed into one 64-bit word: one bit per flag in this order from bit 0,
+ * autocal_pct in bits 48-55 and posture in bits 56-63. The order is part of the stored format,
+ * new flags go at the end. F(member, short label) */
+#define DEVICE_STATUS_FLAGS(F) \
+    F(pda_enabled, "pda") \
+    F(simulation_enabled, "simulation") \
+    F(pressure_control_indicator, "pressure ctl") \
+    F(inflated_indicator, "inflated") \
+    F(clock_wrap_around, "clock wrap") \
+    F(battery_voltage_low, "battery low") \
+    F(critical_temperature, "critical temp") \
+    F(pump_overrun, "pump overrun") \
+    F(body_temp_connected, "body temp") \
+    F(spo2_connected, "spo2") \
+    F(reserved4, "reserved4") \
+    F(reserved5, "reserved5") \
+    F(stop_button_pressed, "stop button") \
+    F(auto_cal_mode, "auto cal") \
+    F(manual_cal_mode, "manual cal") \
+    F(motion_event, "motion") \
+    F(poor_signal, "poor signal") \
+    F(data_valid, "data valid") \
+    F(calibrating, "calibrating") \
+    F(calibrated, "calibrated") \
+    F(beta_processing, "beta") \
+    F(inflate_failed, "inflate failed") \
+    F(calibration_failed, "cal failed") \
+    F(calibration_offset_failed, "cal offset failed") \
+    F(no_pulse_timeout, "no pulse") \
+    F(cuff_too_loose, "cuff loose") \
+    F(cuff_too_tight, "cuff tight") \
+    F(weak_signal, "weak signal") \
+    F(bad_cuff, "bad cuff") \
+    F(ble_adv, "ble adv") \
+    F(recal_soon, "recal soon") \
+    F(too_many_fails, "too many fails") \
+    F(charging, "charging") \
+    F(charge_complete, "charged") \
+    F(invalid_data_entry, "invalid entry") \
+    F(recal_recommended, "recal advised") \
+    F(hemodynamics_enabled, "hemodynamics") \
+    F(cardiac_output_calibrated, "co calibrated")
+
+enum STATUS_FLAG {
+#define STATUS_ENUM(member, label) STATUS_##member,
+    DEVICE_STATUS_FLAGS(STATUS_ENUM)
+#undef STATUS_ENUM
+    STATUS_FLAG_COUNT
+};
+const int STATUS_AUTOCAL_SHIFT = 48;
+const int STATUS_POSTURE_SHIFT = 56;
+static_assert(STATUS_FLAG_COUNT <= STATUS_AUTOCAL_SHIFT, "status flags overlap the small fields");
+
+const char* status_flag_name(int flag);
+uint64_t pack_device_status(const libct_device_status_t& s);
+//valid, value and timestamp are left alone
+void unpack_device_status(uint64_t word, libct_device_status_t& s);
+
+inline bool status_flag(uint64_t word, STATUS_FLAG flag) {return (word >> flag) & 1;}
+inline int status_autocal_pct(uint64_t word) {return (int)((word >> STATUS_AUTOCAL_SHIFT) & 0xff);}
+inline int status_posture(uint64_t word) {return (int)(int8_t)(word >> STATUS_POSTURE_SHIFT);}
@@ -0,0 +1,231 @@
+#include "edf_writer.hpp"
+#include "trace.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+
+//int pulse at the rate the stream table gives it, the vitals held at a rate that keeps beat timing
+const std::vector<EdfSignal>& EdfWriter::signals() {
+    static const std::vector<EdfSignal> list = {
+        {FIELD_INT_PULSE_sample, "Pulse", "", stream_desc(STREAM_INT_PULSE).sample_hz},
+        {FIELD_VITALS_systolic, "Systolic", "mmHg", 10},
+        {FIELD_VITALS_diastolic, "Diastolic", "mmHg", 10},
+        {FIELD_VITALS_map, "MAP", "mmHg", 10},
+        {FIELD_VITALS_heart_rate, "HR", "bpm", 10},
+        {FIELD_VITALS_respiration, "Resp", "bpm", 10},
+        {FIELD_VITALS2_strokeVolume, "SV", "ml", 10},
+        {FIELD_VITALS2_cardiac_output, "CO", "dl/min", 10},
+    };
+    return list;
+}
+
+//an ASCII header field, left aligned and space padded to width
+static void put_field(std::string& h, const std::string& v, size_t width) {
+    h += v.substr(0, width);
+    h.append(width - std::min(v.size(), width), ' ');
+}
+
+static std::string number(long long v) {
+    return std::to_string(v);
+}
+
+EdfWriter::EdfWriter() {
+    for (auto& s : signals()) {
+        const FieldDesc& f = field_desc(s.field);
+        SignalState st;
+        st.spec = &s;
+        st.stream = f.stream;
+        st.slot = f.slot;
+        st.samples_per_record = s.hz * EDF_RECORD_MS / 1000;
+        st.values.assign((size_t)st.samples_per_record * EDF_OPEN_RECORDS, 0);
+        st.set.assign(st.values.size(), 0);
+        state.push_back(std::move(st));
+    }
+    size_t samples = EDF_ANNOTATION_BYTES / 2;
+    for (auto& s : state) samples += s.samples_per_record;
+    record.resize(samples * 2);
+}
+
+EdfWriter::~EdfWriter() {
+    close();
+}
+
+bool EdfWriter::open(const std::string& filename) {
+    std::lock_guard<std::mutex> lock(mtx);
+    file.open(filename, std::ios::out | std::ios::binary | std::ios::trunc);
+    t0 = -1;
+    base = 0;
+    newest = -1;
+    header_written = false;
+    pending.clear();
+    records_written = 0;
+    return file.is_open();
+}
+
+void EdfWriter::close() {
+    flush();
+    std::lock_guard<std::mutex> lock(mtx);
+    if (file.is_open()) file.close();
+}
+
+void EdfWriter::flush() {
+    std::lock_guard<std::mutex> lock(mtx);
+    if (!file.is_open()) return;
+    while (base <= newest) write_oldest();
+    patch_count();
+    file.flush();
+}
+
+struct EdfWriter::Sink {
+    EdfWriter* writer;
+    void row(STREAM_ID stream, const StreamRow& row) {writer->add(stream, row);}
+    void packet(STREAM_ID, const StreamPacket&) {}
+};
+
+void EdfWriter::push(const libct_stream_data_t* data) {
+    std::lock_guard<std::mutex> lock(mtx);
+    if (!file.is_open()) return;
+    Sink sink{this};
+    ingest_streams(data, sink);
+}
+
+void EdfWriter::annotate(long long device_ts, const std::string& text) {
+    std::lock_guard<std::mutex> lock(mtx);
+    if (t0 < 0) return;
+    pending.push_back({device_ts, text});
+}
+
+void EdfWriter::add(STREAM_ID stream, const StreamRow& row) {
+    if (stream != STREAM_INT_PULSE && stream != STREAM_VITALS && stream != STREAM_VITALS2) return;
+    if (t0 < 0) {
+        if (stream != STREAM_INT_PULSE) return; //the waveform sets the grid
+        t0 = row.timestamp;
+        write_header();
+    }
+    long long rel = row.timestamp - t0;
+    if (rel < 0) {
+        late++;
+        return;
+    }
+    for (auto& s : state) {
+        if (s.stream != stream) continue;
+        long long index = rel * s.spec->hz / 1000;
+        long long rec = index / s.samples_per_record;
+        if (rec < base) {
+            late++;
+            continue;
+        }
+        //the data moved past the oldest open record, it cannot change any more; after a pause the
+        //records in between are never visited, they would be empty and are left out anyway
+        if (rec >= base + EDF_OPEN_RECORDS) {
+            long long keep = rec - EDF_OPEN_RECORDS + 1;
+            while (base < keep && base <= newest) write_oldest();
+            base = std::max(base, keep);
+        }
+        newest = std::max(newest, rec);
+        size_t at = (size_t)(rec % EDF_OPEN_RECORDS) * s.samples_per_record + (size_t)(index % s.samples_per_record);
+        s.values[at] = (int16_t)std::min<int64_t>(std::max<int64_t>(row.ints[s.slot], INT16_MIN), INT16_MAX);
+        s.set[at] = 1;
+    }
+}
+
+void EdfWriter::write_header() {
+    std::time_t now = std::time(nullptr);
+    std::tm tm = *std::localtime(&now);
+    static const char* months[] = {"JAN", "FEB", "MAR", "APR", "MAY", "JUN", "JUL", "AUG", "SEP", "OCT", "NOV", "DEC"};
+    //every field is two digits in the header, the casts let the compiler see the 8 characters
+    char date[32], start_date[16], start_time[16];
+    snprintf(date, sizeof(date), "%02u-%s-%04u", (unsigned)tm.tm_mday % 100, months[tm.tm_mon], (unsigned)(tm.tm_year + 1900) % 10000);
+    snprintf(start_date, sizeof(start_date), "%02u.%02u.%02u", (unsigned)tm.tm_mday % 100, (unsigned)(tm.tm_mon + 1) % 100, (unsigned)tm.tm_year % 100);
+    snprintf(start_time, sizeof(start_time), "%02u.%02u.%02u", (unsigned)tm.tm_hour % 100, (unsigned)tm.tm_min % 100, (unsigned)tm.tm_sec % 100);
+    int ns = (int)state.size() + 1;
+    std::string h;
+    put_field(h, "0", 8);
+    put_field(h, "X X X X", 80);
+    put_field(h, std::string("Startdate ") + date + " X X Caretaker", 80);
+    put_field(h, start_date, 8);
+    put_field(h, start_time, 8);
+    put_field(h, number(256 * (ns + 1)), 8);
+    put_field(h, "EDF+D", 44);
+    put_field(h, "-1", 8);
+    char duration[16];
+    snprintf(duration, sizeof(duration), "%g", EDF_RECORD_MS / 1000.0);
+    put_field(h, duration, 8);
+    put_field(h, number(ns), 4);
+    //each field for every signal in turn, the annotation signal last
+    for (auto& s : state) put_field(h, s.spec->label, 16);
+    put_field(h, "EDF Annotations", 16);
+    for (int i = 0; i < ns; i++) put_field(h, i < ns - 1 ? "Caretaker" : "", 80);
+    for (auto& s : state) put_field(h, s.spec->dimension, 8);
+    put_field(h, "", 8);
+    //physical and digital ranges are equal, so stored values are the device's integers
+    for (int i = 0; i < ns; i++) put_field(h, i < ns - 1 ? "-32768" : "-1", 8);
+    for (int i = 0; i < ns; i++) put_field(h, i < ns - 1 ? "32767" : "1", 8);
+    for (int i = 0; i < ns; i++) put_field(h, "-32768", 8);
+    for (int i = 0; i < ns; i++) put_field(h, "32767", 8);
+    for (int i = 0; i < ns; i++) put_field(h, "", 80);
+    for (auto& s : state) put_field(h, number(s.samples_per_record), 8);
+    put_field(h, number(EDF_ANNOTATION_BYTES / 2), 8);
+    for (int i = 0; i < ns; i++) put_field(h, "", 32);
+    file.write(h.data(), h.size());
+    header_written = true;
+}
+
+void EdfWriter::write_oldest() {
+    TRACE_SCOPE("edf record");
+    //a record without any sample (the stream was stopped) is left out, its TAL onset marks the gap
+    bool empty = true;
+    for (auto& s : state) {
+        auto first = s.set.begin() + (base % EDF_OPEN_RECORDS) * s.samples_per_record;
+        if (std::find(first, first + s.samples_per_record, 1) != first + s.samples_per_record) empty = false;
+    }
+    if (empty) {
+        base++;
+        return;
+    }
+    uint8_t* p = record.data();
+    for (auto& s : state) {
+        size_t first = (size_t)(base % EDF_OPEN_RECORDS) * s.samples_per_record;
+        for (int i = 0; i < s.samples_per_record; i++) {
+            if (s.set[first + i]) s.held = s.values[first + i];
+            s.set[first + i] = 0;
+            *p++ = (uint8_t)s.held;
+            *p++ = (uint8_t)((uint16_t)s.held >> 8);
+        }
+    }
+    //time-keeping TAL first, then as many annotations up to the end of this record as fit
+    char* tal = (char*)p;
+    char* end = tal + EDF_ANNOTATION_BYTES;
+    std::fill(tal, end, 0);
+    int n = snprintf(tal, EDF_ANNOTATION_BYTES, "+%g\x14\x14", base * (EDF_RECORD_MS / 1000.0));
+    tal += n + 1;
+    long long record_end = t0 + (base + 1) * EDF_RECORD_MS;
+    while (!pending.empty() && pending.front().onset_ms < record_end) {
+        const Annotation& a = pending.front();
+        char onset[32];
+        int len = snprintf(onset, sizeof(onset), "%+.3f\x14", (a.onset_ms - t0) / 1000.0);
+        if (tal + len + a.text.size() + 2 > end) break;
+        memcpy(tal, onset, len);
+        tal += len;
+        memcpy(tal, a.text.data(), a.text.size());
+        tal += a.text.size();
+        *tal++ = 0x14;
+        *tal++ = 0;
+        pending.pop_front();
+    }
+    file.write((const char*)record.data(), record.size());
+    records_written++;
+    base++;
+}
+
+void EdfWriter::patch_count() {
+    //a session without samples still gets a valid empty file
+    if (!header_written) write_header();
+    std::string count;
+    put_field(count, number((long long)records_written), 8);
+    auto at = file.tellp();
+    file.seekp(EDF_COUNT_OFFSET);
+    file.write(count.data(), count.size());
+    file.seekp(at);
+}
@@ -0,0 +1,77 @@
+#pragma once
+#include <caretaker_static.h>
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "stream_table.hpp"
+
+//one EDF signal fed from a field of the stream table, held between samples
+struct EdfSignal {
+    FIELD_ID field;
+    const char* label;
+    const char* dimension;
+    int hz;
+};
+
+const int EDF_RECORD_MS = 1000;
+const int EDF_OPEN_RECORDS = 4;          //how far behind the newest sample a late sample may land
+const int EDF_ANNOTATION_BYTES = 256;    //TAL space per record, triggers that do not fit go in the next one
+const int EDF_COUNT_OFFSET = 236;        //header position of the 8 character record count
+
+/* Streaming EDF+ (<session>.edf). Data records of EDF_RECORD_MS hold the int pulse at its nominal
+ * rate and the vitals resampled by holding each value until the next, all on the device clock from
+ * the first sample. Every record carries an EDF Annotations signal with its time-keeping TAL and
+ * any trigger or gap annotations. Only the open records are buffered, older ones are written as the
+ * data moves past them; a sample for a record already written is dropped and counted. Records in
+ * which no signal got a sample (a paused stream) are not written, so the file is EDF+D and readers
+ * place each record by its time-keeping TAL.
+ * The record count is -1 while recording and patched in by flush() and close(). */
+class EdfWriter {
+public:
+    EdfWriter();
+    ~EdfWriter();
+    bool open(const std::string& filename);
+    void close();
+    //writes the open records and patches the record count, later data appends after them
+    void flush();
+    void push(const libct_stream_data_t* data);
+    //text at device_ts; ignored before the first sample
+    void annotate(long long device_ts, const std::string& text);
+    uint64_t records() const {return records_written;}
+    uint64_t late_samples() const {return late;}
+    static const std::vector<EdfSignal>& signals();
+private:
+    struct SignalState {
+        const EdfSignal* spec;
+        STREAM_ID stream;
+        int slot;
+        int samples_per_record;
+        std::vector<int16_t> values; //EDF_OPEN_RECORDS records
+        std::vector<uint8_t> set;    //which slots got a sample
+        int16_t held = 0;
+    };
+    struct Annotation {
+        long long onset_ms;
+        std::string text;
+    };
+    struct Sink;
+    void add(STREAM_ID stream, const StreamRow& row);
+    void write_header();
+    void write_oldest();
+    void patch_count();
+    std::mutex mtx;
+    std::ofstream file;
+    std::vector<SignalState> state;
+    std::deque<Annotation> pending;
+    std::vector<uint8_t> record; //one serialised data record
+    long long t0 = -1;           //device time of the start of record 0
+    long long base = 0;          //oldest open record
+    long long newest = -1;       //newest record holding a sample
+    bool header_written = false;
+    std::atomic<uint64_t> records_written{0};
+    std::atomic<uint64_t> late{0};
+};
@@ -0,0 +1,181 @@
+#include "epoching.hpp"
+#include <cstdint>
+#include <algorithm>
+
+template<typename T>
+static void write_raw(std::ofstream& f, T value) {
+    f.write(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+EpochEngine::EpochEngine(EpochConfig config) : config(config) {
+    //sized for a 1kHz waveform and sub-second vitals updates
+    int history_ms = std::max(config.history_ms, 2 * (config.pre_ms + config.post_ms));
+    pulse_history.reserve(history_ms);
+    vitals_history.reserve(history_ms / 10 + 16);
+    vitals2_history.reserve(history_ms / 10 + 16);
+    scratch.pulse.reserve(config.pre_ms + config.post_ms + 1);
+    scratch.vitals.reserve(2 * ((config.pre_ms + config.post_ms) / 10 + 16));
+}
+
+EpochEngine::~EpochEngine() {
+    close();
+}
+
+/* File layout (little endian, unpadded):
+ *   "CTEPOCH2" int32 pre_ms int32 post_ms
+ *   per epoch: int32 trigger, int64 anchor, uint32 n_pulse, uint32 n_vitals,
+ *              n_pulse x {int32 dt, int16 value},
+ *              n_vitals x {int32 dt, int16 sys, dia, map, hr, resp, uint8 sv, co, valid}
+ *   dt is relative to the anchor in device milliseconds, valid holds the VITALS_VALID bits of the
+ *   fields that had been reported (the others are 0). */
+bool EpochEngine::open(const std::string& filename) {
+    std::lock_guard<std::mutex> lock(mtx);
+    file.open(filename, std::ios::out | std::ios::binary | std::ios::trunc);
+    if (!file.is_open()) return false;
+    file.write("CTEPOCH2", 8);
+    write_raw<int32_t>(file, config.pre_ms);
+    write_raw<int32_t>(file, config.post_ms);
+    file.flush();
+    return file.good();
+}
+
+void EpochEngine::close() {
+    std::lock_guard<std::mutex> lock(mtx);
+    if (file.is_open()) file.close();
+}
+
+void EpochEngine::reset() {
+    std::lock_guard<std::mutex> lock(mtx);
+    pulse_history.clear();
+    vitals_history.clear();
+    vitals2_history.clear();
+    pending_triggers.clear();
+    last_device_ts = -1;
+}
+
+void EpochEngine::push_pulse(const short* samples, const long long* timestamps, unsigned int count) {
+    if (count == 0) return;
+    std::lock_guard<std::mutex> lock(mtx);
+    for (unsigned int i = 0; i < count; i++)
+        pulse_history.push({timestamps[i], samples[i]});
+    last_device_ts = timestamps[count-1];
+    last_device_rx = std::chrono::steady_clock::now();
+    complete_ready(last_device_ts);
+}
+
+void EpochEngine::push_vitals(const libct_vitals_t* datapoints, unsigned int count) {
+    std::lock_guard<std::mutex> lock(mtx);
+    for (unsigned int i = 0; i < count; i++) {
+        VitalsSample v = {};
+        v.timestamp = datapoints[i].timestamp;
+        v.systolic = datapoints[i].systolic;
+        v.diastolic = datapoints[i].diastolic;
+        v.map = datapoints[i].map;
+        v.heart_rate = datapoints[i].heart_rate;
+        v.respiration = datapoints[i].respiration;
+        v.valid = VITALS_VALID_PRESSURE;
+        vitals_history.push(v);
+    }
+}
+
+void EpochEngine::push_vitals2(const libct_vitals2_t* datapoints, unsigned int count) {
+    std::lock_guard<std::mutex> lock(mtx);
+    for (unsigned int i = 0; i < count; i++) {
+        VitalsSample v = {};
+        v.timestamp = datapoints[i].timestamp;
+        v.stroke_volume = datapoints[i].strokeVolume;
+        v.cardiac_output = datapoints[i].cardiac_output;
+        v.valid = VITALS_VALID_OUTPUT;
+        vitals2_history.push(v);
+    }
+}
+
+long long EpochEngine::add_trigger(int trigger, std::chrono::steady_clock::time_point at) {
+    std::lock_guard<std::mutex> lock(mtx);
+    if (last_device_ts < 0) return -1; //no waveform yet, nothing to lock the trigger to
+    //map the PC-side trigger time onto the device clock using the most recent packet;
+    //a trigger sent before that packet arrived maps back before it
+    auto since_rx = std::chrono::duration_cast<std::chrono::milliseconds>(at - last_device_rx).count();
+    long long anchor = last_device_ts + since_rx;
+    pending_triggers.push_back({trigger, anchor});
+    return anchor;
+}
+
+void EpochEngine::complete_ready(long long latest) {
+    while (!pending_triggers.empty() && pending_triggers.front().anchor + config.post_ms <= latest) {
+        PendingTrigger t = pending_triggers.front();
+        pending_triggers.pop_front();
+        scratch.trigger = t.trigger;
+        scratch.anchor = t.anchor;
+        scratch.pulse.clear();
+        scratch.vitals.clear();
+        pulse_history.copy_range(t.anchor - config.pre_ms, t.anchor + config.post_ms, scratch.pulse);
+        merge_vitals(t.anchor - config.pre_ms, t.anchor + config.post_ms, scratch.vitals);
+        write_epoch(scratch);
+        if (on_epoch) on_epoch(scratch);
+    }
+}
+
+//copies the fields v's stream reported into held
+static void hold(VitalsSample& held, const VitalsSample& v) {
+    held.timestamp = v.timestamp;
+    if (v.valid & VITALS_VALID_PRESSURE) {
+        held.systolic = v.systolic;
+        held.diastolic = v.diastolic;
+        held.map = v.map;
+        held.heart_rate = v.heart_rate;
+        held.respiration = v.respiration;
+    }
+    if (v.valid & VITALS_VALID_OUTPUT) {
+        held.stroke_volume = v.stroke_volume;
+        held.cardiac_output = v.cardiac_output;
+    }
+    held.valid |= v.valid;
+}
+
+//merges both streams' updates in [t0, t1] in timestamp order, each holding the latest value of every field
+void EpochEngine::merge_vitals(long long t0, long long t1, std::vector<VitalsSample>& out) {
+    size_t i = vitals_history.lower_bound(t0);
+    size_t j = vitals2_history.lower_bound(t0);
+    VitalsSample held = {};
+    //the values in force when the window opens
+    if (i > 0) hold(held, vitals_history.at(i - 1));
+    if (j > 0) hold(held, vitals2_history.at(j - 1));
+    for (;;) {
+        bool more = i < vitals_history.size() && (long long)vitals_history.at(i).timestamp <= t1;
+        bool more2 = j < vitals2_history.size() && (long long)vitals2_history.at(j).timestamp <= t1;
+        if (!more && !more2) break;
+        if (more && (!more2 || vitals_history.at(i).timestamp <= vitals2_history.at(j).timestamp))
+            hold(held, vitals_history.at(i++));
+        else
+            hold(held, vitals2_history.at(j++));
+        //updates of both streams at the same time are one sample
+        if (!out.empty() && out.back().timestamp == held.timestamp) out.back() = held;
+        else out.push_back(held);
+    }
+}
+
+void EpochEngine::write_epoch(const Epoch& e) {
+    if (!file.is_open()) return;
+    write_raw<int32_t>(file, e.trigger);
+    write_raw<int64_t>(file, e.anchor);
+    write_raw<uint32_t>(file, (uint32_t)e.pulse.size());
+    write_raw<uint32_t>(file, (uint32_t)e.vitals.size());
+    for (auto& s : e.pulse) {
+        write_raw<int32_t>(file, (int32_t)(s.timestamp - e.anchor));
+        write_raw<int16_t>(file, s.value);
+    }
+    for (auto& v : e.vitals) {
+        write_raw<int32_t>(file, (int32_t)((long long)v.timestamp - e.anchor));
+        write_raw<int16_t>(file, v.systolic);
+        write_raw<int16_t>(file, v.diastolic);
+        write_raw<int16_t>(file, v.map);
+        write_raw<int16_t>(file, v.heart_rate);
+        write_raw<int16_t>(file, v.respiration);
+        write_raw<uint8_t>(file, v.stroke_volume);
+        write_raw<uint8_t>(file, v.cardiac_output);
+        write_raw<uint8_t>(file, v.valid);
+    }
+    file.flush();
+    epochs_written++;
+}
@@ -0,0 +1,126 @@
+#pragma once
+#include <caretaker_static.h>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <chrono>
+#include <fstream>
+#include <functional>
+#include <string>
+#include <atomic>
+
+struct EpochConfig {
+    int pre_ms = 500;   //window kept before the trigger
+    int post_ms = 1500; //window that must elapse after the trigger before the epoch is cut
+    int history_ms = 10000;
+};
+
+struct PulseSample {
+    long long timestamp;
+    short value;
+};
+
+//bits of VitalsSample::valid, one per stream; a stream's fields are left out until it has reported
+enum VITALS_VALID : unsigned char {
+    VITALS_VALID_PRESSURE = 1, //systolic, diastolic, map, heart_rate and respiration, from vitals
+    VITALS_VALID_OUTPUT = 2,   //stroke_volume and cardiac_output, from vitals2
+};
+
+//sample-and-hold of the latest vitals/vitals2 values at the time of each update
+struct VitalsSample {
+    unsigned long long timestamp;
+    short systolic;
+    short diastolic;
+    short map;
+    short heart_rate;
+    short respiration;
+    unsigned char stroke_volume;
+    unsigned char cardiac_output;
+    unsigned char valid; //VITALS_VALID bits of the fields that hold a reported value
+};
+
+//fixed capacity ring, oldest entries are overwritten. Entries must be pushed in timestamp order.
+template<typename T>
+class HistoryRing {
+public:
+    void reserve(size_t capacity) {
+        buf.assign(capacity, T{});
+        head = 0;
+        len = 0;
+    }
+    void push(const T& item) {
+        if (buf.empty()) return;
+        buf[(head + len) % buf.size()] = item;
+        if (len < buf.size()) len++;
+        else head = (head + 1) % buf.size();
+    }
+    size_t size() const {return len;}
+    const T& at(size_t i) const {return buf[(head + i) % buf.size()];}
+    const T& back() const {return at(len - 1);}
+    void clear() {head = 0; len = 0;}
+    //index of the first entry with timestamp >= ts
+    template<typename TS>
+    size_t lower_bound(TS ts) const {
+        size_t lo = 0, hi = len;
+        while (lo < hi) {
+            size_t mid = lo + (hi - lo) / 2;
+            if ((long long)at(mid).timestamp < (long long)ts) lo = mid + 1;
+            else hi = mid;
+        }
+        return lo;
+    }
+    template<typename TS>
+    void copy_range(TS t0, TS t1, std::vector<T>& out) const {
+        for (size_t i = lower_bound(t0); i < len && (long long)at(i).timestamp <= (long long)t1; i++)
+            out.push_back(at(i));
+    }
+private:
+    std::vector<T> buf;
+    size_t head = 0;
+    size_t len = 0;
+};
+
+struct Epoch {
+    int trigger;
+    long long anchor; //device timestamp the trigger was mapped to
+    std::vector<PulseSample> pulse;
+    std::vector<VitalsSample> vitals;
+};
+
+class EpochEngine {
+public:
+    EpochEngine(EpochConfig config = EpochConfig());
+    ~EpochEngine();
+    bool open(const std::string& filename);
+    void close();
+    void reset();
+    void push_pulse(const short* samples, const long long* timestamps, unsigned int count);
+    void push_vitals(const libct_vitals_t* datapoints, unsigned int count);
+    void push_vitals2(const libct_vitals2_t* datapoints, unsigned int count);
+    //maps at, when the trigger went out, onto the device clock and returns it; -1 before the first waveform sample
+    long long add_trigger(int trigger, std::chrono::steady_clock::time_point at = std::chrono::steady_clock::now());
+    size_t pending() {std::lock_guard<std::mutex> lock(mtx); return pending_triggers.size();}
+    size_t written() const {return epochs_written;}
+    std::function<void(const Epoch&)> on_epoch; //called on the data thread for each completed epoch
+    const EpochConfig config;
+private:
+    struct PendingTrigger {
+        int trigger;
+        long long anchor;
+    };
+    void complete_ready(long long latest);
+    void merge_vitals(long long t0, long long t1, std::vector<VitalsSample>& out);
+    void write_epoch(const Epoch& e);
+
+    std::mutex mtx;
+    HistoryRing<PulseSample> pulse_history;
+    //one ring per stream, each in its own timestamp order, merged when an epoch is cut
+    HistoryRing<VitalsSample> vitals_history;
+    HistoryRing<VitalsSample> vitals2_history;
+    std::deque<PendingTrigger> pending_triggers;
+    long long last_device_ts = -1;
+    std::chrono::steady_clock::time_point last_device_rx;
+    Epoch scratch;
+    std::ofstream file;
+    std::atomic<size_t> epochs_written{0};
+};
@@ -0,0 +1,116 @@
+#include "erp_average.hpp"
+#include <sstream>
+#include <iomanip>
+
+const char* erp_vital_name(int vital) {
+    switch(vital){
+        case ERP_SYSTOLIC: return "systolic";
+        case ERP_DIASTOLIC: return "diastolic";
+        case ERP_MAP: return "map";
+        case ERP_HEART_RATE: return "heart_rate";
+        case ERP_RESPIRATION: return "respiration";
+        case ERP_STROKE_VOLUME: return "stroke_volume";
+        case ERP_CARDIAC_OUTPUT: return "cardiac_output";
+        default: return "unknown";
+    }
+}
+
+ErpAverages::ErpAverages(const EpochConfig& config, int bin_ms)
+    : pre_ms(config.pre_ms), bin_ms(bin_ms), num_bins((config.pre_ms + config.post_ms) / bin_ms + 1) {
+    for (auto& c : conditions) {
+        c.pulse.resize(num_bins);
+        c.vitals.resize(ERP_VITAL_COUNT);
+    }
+    bin_sum.resize(num_bins);
+    bin_count.resize(num_bins);
+}
+
+bool ErpAverages::add_epoch(const Epoch& e) {
+    if (e.trigger < 1 || e.trigger > NUM_CONDITIONS) return false;
+    std::lock_guard<std::mutex> lock(mtx);
+    Condition& c = conditions[e.trigger - 1];
+    //average the waveform into fixed bins relative to the window start
+    std::fill(bin_sum.begin(), bin_sum.end(), 0.0);
+    std::fill(bin_count.begin(), bin_count.end(), 0);
+    for (auto& s : e.pulse) {
+        long long offset = s.timestamp - e.anchor + pre_ms;
+        if (offset < 0) continue;
+        size_t bin = (size_t)(offset / bin_ms);
+        if (bin >= num_bins) continue;
+        bin_sum[bin] += s.value;
+        bin_count[bin]++;
+    }
+    for (size_t b = 0; b < num_bins; b++)
+        if (bin_count[b] > 0) c.pulse.add(b, bin_sum[b] / bin_count[b]);
+    //vitals are summarised as their mean over the post-trigger part of the window
+    //of the samples where they had been reported, a field with none is left out of this epoch
+    double vsum[ERP_VITAL_COUNT] = {};
+    unsigned int vcount[ERP_VITAL_COUNT] = {};
+    for (auto& v : e.vitals) {
+        if ((long long)v.timestamp < e.anchor) continue;
+        if (v.valid & VITALS_VALID_PRESSURE) {
+            vsum[ERP_SYSTOLIC] += v.systolic;
+            vsum[ERP_DIASTOLIC] += v.diastolic;
+            vsum[ERP_MAP] += v.map;
+            vsum[ERP_HEART_RATE] += v.heart_rate;
+            vsum[ERP_RESPIRATION] += v.respiration;
+            for (int i : {ERP_SYSTOLIC, ERP_DIASTOLIC, ERP_MAP, ERP_HEART_RATE, ERP_RESPIRATION}) vcount[i]++;
+        }
+        if (v.valid & VITALS_VALID_OUTPUT) {
+            vsum[ERP_STROKE_VOLUME] += v.stroke_volume;
+            vsum[ERP_CARDIAC_OUTPUT] += v.cardiac_output;
+            vcount[ERP_STROKE_VOLUME]++;
+            vcount[ERP_CARDIAC_OUTPUT]++;
+        }
+    }
+    for (int i = 0; i < ERP_VITAL_COUNT; i++)
+        if (vcount[i] > 0) c.vitals.add(i, vsum[i] / vcount[i]);
+    c.epochs++;
+    return true;
+}
+
+void ErpAverages::snapshot(int condition, ErpSnapshot& out) {
+    if (condition < 1 || condition > NUM_CONDITIONS) return;
+    std::lock_guard<std::mutex> lock(mtx);
+    const Condition& c = conditions[condition - 1];
+    out.condition = condition;
+    out.epochs = c.epochs;
+    out.bin_ms = bin_ms;
+    out.pre_ms = pre_ms;
+    out.pulse_mean.resize(num_bins);
+    out.pulse_lo.resize(num_bins);
+    out.pulse_hi.resize(num_bins);
+    for (size_t b = 0; b < num_bins; b++) {
+        double ci = c.pulse.ci95(b);
+        out.pulse_mean[b] = (float)c.pulse.mean[b];
+        out.pulse_lo[b] = (float)(c.pulse.mean[b] - ci);
+        out.pulse_hi[b] = (float)(c.pulse.mean[b] + ci);
+    }
+    for (int i = 0; i < ERP_VITAL_COUNT; i++) {
+        out.vital_mean[i] = (float)c.vitals.mean[i];
+        out.vital_ci[i] = (float)c.vitals.ci95(i);
+    }
+}
+
+std::string ErpAverages::summary(int condition) {
+    if (condition < 1 || condition > NUM_CONDITIONS) return "";
+    std::lock_guard<std::mutex> lock(mtx);
+    const Condition& c = conditions[condition - 1];
+    std::stringstream ss;
+    ss << std::fixed << std::setprecision(1) << "Trigger " << condition << " average (n=" << c.epochs << "):";
+    for (int i : {ERP_HEART_RATE, ERP_SYSTOLIC, ERP_DIASTOLIC, ERP_STROKE_VOLUME}) {
+        ss << " " << erp_vital_name(i);
+        if (c.vitals.n[i] == 0) ss << " -"; //not reported in any epoch yet
+        else ss << " " << c.vitals.mean[i] << "+/-" << c.vitals.ci95(i);
+    }
+    return ss.str();
+}
+
+void ErpAverages::clear() {
+    std::lock_guard<std::mutex> lock(mtx);
+    for (auto& c : conditions) {
+        c.epochs = 0;
+        c.pulse.clear();
+        c.vitals.clear();
+    }
+}
@@ -0,0 +1,75 @@
+#pragma once
+#include "epoching.hpp"
+#include <vector>
+#include <mutex>
+#include <string>
+#include <cmath>
+#include <algorithm>
+
+//running mean/variance (Welford) over a fixed number of bins, no allocation after construction
+struct WelfordBins {
+    void resize(size_t bins) {n.assign(bins, 0); mean.assign(bins, 0.0); m2.assign(bins, 0.0);}
+    void add(size_t bin, double x) {
+        n[bin]++;
+        double d = x - mean[bin];
+        mean[bin] += d / n[bin];
+        m2[bin] += d * (x - mean[bin]);
+    }
+    double variance(size_t bin) const {return n[bin] > 1 ? m2[bin] / (n[bin] - 1) : 0.0;}
+    //half width of the normal-approximation 95% confidence interval of the mean
+    double ci95(size_t bin) const {return n[bin] > 1 ? 1.96 * std::sqrt(variance(bin) / n[bin]) : 0.0;}
+    void clear() {std::fill(n.begin(), n.end(), 0); std::fill(mean.begin(), mean.end(), 0.0); std::fill(m2.begin(), m2.end(), 0.0);}
+    std::vector<unsigned int> n;
+    std::vector<double> mean;
+    std::vector<double> m2;
+};
+
+enum ERP_VITAL {
+    ERP_SYSTOLIC,
+    ERP_DIASTOLIC,
+    ERP_MAP,
+    ERP_HEART_RATE,
+    ERP_RESPIRATION,
+    ERP_STROKE_VOLUME,
+    ERP_CARDIAC_OUTPUT,
+    ERP_VITAL_COUNT
+};
+const char* erp_vital_name(int vital);
+
+struct ErpSnapshot {
+    int condition = 0;
+    unsigned int epochs = 0;
+    int bin_ms = 0;
+    int pre_ms = 0;
+    std::vector<float> pulse_mean;
+    std::vector<float> pulse_lo;
+    std::vector<float> pulse_hi;
+    float vital_mean[ERP_VITAL_COUNT] = {};
+    float vital_ci[ERP_VITAL_COUNT] = {};
+};
+
+class ErpAverages {
+public:
+    static const int NUM_CONDITIONS = 10; //trigger values 1-10 offered by the GUI
+    ErpAverages(const EpochConfig& config, int bin_ms = 10);
+    //called from the data thread for every completed epoch, returns false if the trigger is out of range
+    bool add_epoch(const Epoch& e);
+    //copies the current averages of trigger value (condition) into out; out is reused between calls
+    void snapshot(int condition, ErpSnapshot& out);
+    std::string summary(int condition);
+    void clear();
+    size_t bins() const {return num_bins;}
+private:
+    struct Condition {
+        unsigned int epochs = 0;
+        WelfordBins pulse;
+        WelfordBins vitals;
+    };
+    const int pre_ms;
+    const int bin_ms;
+    const size_t num_bins;
+    std::mutex mtx;
+    Condition conditions[NUM_CONDITIONS];
+    std::vector<double> bin_sum;
+    std::vector<unsigned int> bin_count;
+};
@@ -1,6 +1,11 @@
 #pragma warning( disable : 4244 )
 #pragma warning( disable : 4267 )
 #include "gui.hpp"
+#include "erp_average.hpp"
+#include "stream_stats.hpp"
+#include "stream_table.hpp"
+#include "trace.hpp"
+#include "thread_roles.hpp"
 #include <stdlib.h> 
 #define NK_GLFW_GL3_IMPLEMENTATION
 #define NK_IMPLEMENTATION
@@ -20,16 +25,24 @@
 #include <GL/glut.h>
 #include <iostream>
 #include <sstream>
-#include <numeric>
 
 static void error_callback(int e, const char *d)
 {printf("Error %d: %s\n", e, d);}
 
 GUI::GUI(){
+    //window and font setup run on the render thread while the rest of startup continues
     renderthread = std::make_shared<std::thread>([this]{run_app();});
-    while(!gui_ready){} //block until ready
 }
-int win_height = 480;
+
+std::chrono::steady_clock::time_point GUI::wait_ready(){
+    while(!gui_ready)
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    return ready_at;
+}
+int main_height = 480;
+int analysis_height = 220;
+int status_height = 150;
+int win_height = main_height + analysis_height + status_height;
 int win_width = 640;
 void GUI::run_app(){
     struct nk_glfw glfw = {0};
@@ -63,7 +76,7 @@ void GUI::run_app(){
     static const char* trigger_options[] = {"1","2","3","4","5","6","7","8","9","10"};
     int trigger_sel = 0;
     int control_panel_width = win_width / 4;
-    int control_panel_height = win_height;
+    int control_panel_height = main_height;
 
     static const int num_console_lines = 512;
     static const int max_text_width = 68;
@@ -71,14 +84,25 @@ void GUI::run_app(){
     consoleOutput.reserve(num_console_lines);
     static const int max_console_size = num_console_lines*128;
     std::string consoleBuff;
+    consoleBuff.reserve(max_console_size);
+    ErpSnapshot erp_view;
+    StreamRates stream_view[STREAM_COUNT];
+    int averages_width = win_width * 0.6;
 
     printDate();
+    ready_at = std::chrono::steady_clock::now();
     gui_ready = true;
+    TRACE_THREAD_NAME("render");
+    register_thread(ROLE_GUI);
      while (!glfwWindowShouldClose(win))
      {
+        TRACE_SCOPE("gui frame");
          /* Input */
-        glfwPollEvents();
-        nk_glfw3_new_frame(&glfw);
+        {
+            TRACE_SCOPE("gui input");
+            glfwPollEvents();
+            nk_glfw3_new_frame(&glfw);
+        }
          /* GUI */
 
         if (nk_begin(ctx, "Control", nk_rect(0, 0, control_panel_width, control_panel_height), NK_WINDOW_BORDER | NK_WINDOW_TITLE))
@@ -92,17 +116,20 @@ void GUI::run_app(){
                 start_but_flag = true;
 
             nk_spacer(ctx);
-            if (nk_button_label(ctx, "Trigger"))
+            if (nk_button_label(ctx, "Trigger")) {
+                trigger_time = std::chrono::steady_clock::now();
                 trigger_flag.first = true;
+            }
             nk_spacer(ctx);
-            nk_spacer(ctx);
+            if (nk_button_label(ctx, "Latency"))
+                report_but_flag = true;
             nk_spacer(ctx);
             if (nk_button_label(ctx, "Stop"))
                 stop_but_flag = true;
         }
         nk_end(ctx);
         int values_panel_width = win_width - control_panel_width;
-        int values_panel_height = win_height * 0.4;
+        int values_panel_height = main_height * 0.4;
         if (nk_begin(ctx, "Values", nk_rect(control_panel_width, 0, values_panel_width, values_panel_height), NK_WINDOW_BORDER | NK_WINDOW_TITLE))
         {
             nk_layout_row_dynamic(ctx, 16, 2);
@@ -110,8 +137,11 @@ void GUI::run_app(){
             nk_label(ctx, "BAUD:", NK_TEXT_LEFT);
             nk_layout_row_dynamic(ctx, 32, 2);   
 
-            nk_edit_string(ctx, NK_EDIT_FIELD, com_input, &com_size, 64, nk_filter_default);
-            nk_edit_string(ctx, NK_EDIT_FIELD, baud_input, &baud_size, 64, nk_filter_default);
+            {
+                std::lock_guard<std::mutex> lock(com_mtx);
+                nk_edit_string(ctx, NK_EDIT_FIELD, com_input, &com_size, 64, nk_filter_default);
+                nk_edit_string(ctx, NK_EDIT_FIELD, baud_input, &baud_size, 64, nk_filter_decimal);
+            }
             nk_layout_row_dynamic(ctx, 24, 2);
             nk_label(ctx, "BrainProducts Trigger:", NK_TEXT_LEFT);
             trigger_flag.second = nk_combo(ctx, trigger_options,NK_LEN(trigger_options),trigger_flag.second, 24, nk_vec2(200,200));
@@ -123,32 +153,36 @@ void GUI::run_app(){
         nk_end(ctx);
 
         int console_panel_width = values_panel_width;
-        int console_panel_height = win_height - values_panel_height;
+        int console_panel_height = main_height - values_panel_height;
         static const nk_flags status_flags = nk_edit_types::NK_EDIT_EDITOR | NK_EDIT_SELECTABLE | NK_EDIT_MULTILINE;
         struct nk_vec2 orig_padding = ctx->style.window.padding;
         ctx->style.window.padding = nk_vec2(0, 0);
         if (nk_begin(ctx, "Console", nk_rect(control_panel_width, values_panel_height, console_panel_width, console_panel_height)
             , NK_WINDOW_BORDER | NK_WINDOW_TITLE | NK_WINDOW_NO_SCROLLBAR))
         {
+            TRACE_SCOPE("gui console");
             std::string log = getLogQueue();
             
-            std::vector<std::string> splitVals;
-            auto ss = std::stringstream{log};
-            for (std::string line; std::getline(ss, line, '\n');) {
+            //rebuilt in place and only when lines arrive, a frame without new output allocates nothing
+            if (!log.empty()) {
+                std::vector<std::string> splitVals;
+                auto ss = std::stringstream{log};
+                for (std::string line; std::getline(ss, line, '\n');) {
 
-                while (line.size() > max_text_width) {
-                    splitVals.push_back(line.substr(0,max_text_width) + "\n");
-                    line = line.substr(max_text_width, line.size());
+                    while (line.size() > max_text_width) {
+                        splitVals.push_back(line.substr(0,max_text_width) + "\n");
+                        line = line.substr(max_text_width, line.size());
+                    }
+                    splitVals.push_back(line + "\n");
                 }
-                splitVals.push_back(line + "\n");
-            }
-            int new_size = consoleOutput.size() + splitVals.size();
-            if (new_size > num_console_lines) {
-                consoleOutput.erase(consoleOutput.begin(), consoleOutput.begin() + (new_size-num_console_lines)+1);
+                int new_size = consoleOutput.size() + splitVals.size();
+                if (new_size > num_console_lines) {
+                    consoleOutput.erase(consoleOutput.begin(), consoleOutput.begin() + (new_size-num_console_lines)+1);
+                }
+                consoleOutput.insert( consoleOutput.end(), splitVals.begin(), splitVals.end() );
+                consoleBuff.clear();
+                for (auto& line : consoleOutput) consoleBuff += line;
             }
-            consoleOutput.insert( consoleOutput.end(), splitVals.begin(), splitVals.end() );
-            
-            consoleBuff = std::accumulate(consoleOutput.begin(), consoleOutput.end(), std::string(""));
             int console_size = consoleBuff.length();
             nk_layout_row_dynamic(ctx, console_panel_height-25, 1);
             nk_edit_focus(ctx,0);
@@ -156,11 +190,107 @@ void GUI::run_app(){
         }
         nk_end(ctx);
         ctx->style.window.padding = orig_padding;
+
+        if (nk_begin(ctx, "Averages", nk_rect(0, main_height, averages_width, analysis_height), NK_WINDOW_BORDER | NK_WINDOW_TITLE | NK_WINDOW_NO_SCROLLBAR))
+        {
+            if (auto averages = std::atomic_load(&erp)) averages->snapshot(get_trigger_value(), erp_view);
+            nk_layout_row_dynamic(ctx, 16, 1);
+            nk_labelf(ctx, NK_TEXT_LEFT, "Trigger %d: %u epochs, pulse mean with 95%% band (%d ms bins from -%d ms)",
+                (int)get_trigger_value(), erp_view.epochs, erp_view.bin_ms, erp_view.pre_ms);
+            nk_layout_row_dynamic(ctx, analysis_height - 90, 1);
+            int bins = (int)erp_view.pulse_mean.size();
+            if (bins > 0 && erp_view.epochs > 0) {
+                float lo = *std::min_element(erp_view.pulse_lo.begin(), erp_view.pulse_lo.end());
+                float hi = *std::max_element(erp_view.pulse_hi.begin(), erp_view.pulse_hi.end());
+                if (hi <= lo) hi = lo + 1;
+                if (nk_chart_begin_colored(ctx, NK_CHART_LINES, nk_rgb(255,200,50), nk_rgb(255,255,255), bins, lo, hi)) {
+                    nk_chart_add_slot_colored(ctx, NK_CHART_LINES, nk_rgb(90,90,140), nk_rgb(255,255,255), bins, lo, hi);
+                    nk_chart_add_slot_colored(ctx, NK_CHART_LINES, nk_rgb(90,90,140), nk_rgb(255,255,255), bins, lo, hi);
+                    for (int b = 0; b < bins; b++) {
+                        nk_chart_push_slot(ctx, erp_view.pulse_mean[b], 0);
+                        nk_chart_push_slot(ctx, erp_view.pulse_lo[b], 1);
+                        nk_chart_push_slot(ctx, erp_view.pulse_hi[b], 2);
+                    }
+                    nk_chart_end(ctx);
+                }
+            } else {
+                nk_label(ctx, "No completed epochs for this trigger yet", NK_TEXT_CENTERED);
+            }
+            nk_layout_row_dynamic(ctx, 16, ERP_VITAL_COUNT);
+            for (int i = 0; i < ERP_VITAL_COUNT; i++)
+                nk_label(ctx, erp_vital_name(i), NK_TEXT_CENTERED);
+            for (int i = 0; i < ERP_VITAL_COUNT; i++)
+                nk_labelf(ctx, NK_TEXT_CENTERED, "%.1f+/-%.1f", erp_view.vital_mean[i], erp_view.vital_ci[i]);
+        }
+        nk_end(ctx);
+
+        if (nk_begin(ctx, "Streams", nk_rect(averages_width, main_height, win_width - averages_width, analysis_height), NK_WINDOW_BORDER | NK_WINDOW_TITLE))
+        {
+            if (auto stream_stats = std::atomic_load(&stats)) stream_stats->snapshot(stream_view);
+            auto live_values = std::atomic_load(&live);
+            static const float stream_cols[] = {0.22f, 0.13f, 0.1f, 0.17f, 0.38f};
+            nk_layout_row(ctx, NK_DYNAMIC, 16, 5, stream_cols);
+            nk_label(ctx, "stream", NK_TEXT_LEFT);
+            nk_label(ctx, "per s", NK_TEXT_RIGHT);
+            nk_label(ctx, "gaps", NK_TEXT_RIGHT);
+            nk_label(ctx, "lat ms", NK_TEXT_RIGHT);
+            nk_label(ctx, "latest", NK_TEXT_LEFT);
+            for (int s = 0; s < STREAM_COUNT; s++) {
+                nk_label(ctx, stream_name(s), NK_TEXT_LEFT);
+                nk_labelf(ctx, NK_TEXT_RIGHT, "%.0f", stream_view[s].samples_per_s);
+                nk_labelf(ctx, NK_TEXT_RIGHT, "%llu", (unsigned long long)stream_view[s].gaps);
+                nk_labelf(ctx, NK_TEXT_RIGHT, "%.1f/%.0f", stream_view[s].latency_avg_ms, stream_view[s].latency_max_ms);
+                //every field of the latest row, named in the tooltip
+                const StreamDesc& d = stream_desc(s);
+                char latest[128] = "-";
+                StreamRow row;
+                if (live_values && live_values->read(s, row)) {
+                    size_t n = 0;
+                    for (int f = d.first_field; f < d.first_field + d.field_count && n + 24 < sizeof(latest); f++) {
+                        if (n) latest[n++] = '/';
+                        n += format_field(f, row, latest + n, sizeof(latest) - n);
+                    }
+                }
+                if (nk_widget_is_hovered(ctx)) nk_tooltip(ctx, stream_csv_header(s).c_str());
+                nk_label(ctx, latest, NK_TEXT_LEFT);
+            }
+            double total_bytes = 0;
+            for (auto& r : stream_view) total_bytes += r.bytes_per_s;
+            nk_layout_row_dynamic(ctx, 16, 1);
+            nk_labelf(ctx, NK_TEXT_LEFT, "%.1f kB/s total", total_bytes / 1024);
+        }
+        nk_end(ctx);
+
+        if (nk_begin(ctx, "Device Status", nk_rect(0, main_height + analysis_height, win_width, status_height), NK_WINDOW_BORDER | NK_WINDOW_TITLE))
+        {
+            //everything comes from the packed word, one bit test per indicator
+            auto live_values = std::atomic_load(&live);
+            StreamRow row;
+            bool have_status = live_values && live_values->read(STREAM_DEVICE_STATUS, row);
+            uint64_t word = have_status ? (uint64_t)row.ints[field_desc(FIELD_DEVICE_STATUS_word).slot] : 0;
+            nk_layout_row_dynamic(ctx, 16, 1);
+            if (have_status)
+                nk_labelf(ctx, NK_TEXT_LEFT, "word %016llx, autocal %d%%, posture %d, at %lld", (unsigned long long)word,
+                    status_autocal_pct(word), status_posture(word), (long long)row.timestamp);
+            else
+                nk_label(ctx, "No device status yet", NK_TEXT_LEFT);
+            nk_layout_row_dynamic(ctx, 16, 6);
+            for (int f = 0; f < STATUS_FLAG_COUNT; f++)
+                nk_label_colored(ctx, status_flag_name(f), NK_TEXT_LEFT,
+                    status_flag(word, (STATUS_FLAG)f) ? nk_rgb(250, 200, 60) : nk_rgb(90, 90, 90));
+        }
+        nk_end(ctx);
         /* Draw */
-        glViewport(0, 0, win_width, win_height);
-        glClear(GL_COLOR_BUFFER_BIT);
-        nk_glfw3_render(&glfw, NK_ANTI_ALIASING_ON, MAX_VERTEX_BUFFER, MAX_ELEMENT_BUFFER);
-        glfwSwapBuffers(win);
+        {
+            TRACE_SCOPE("gui render");
+            glViewport(0, 0, win_width, win_height);
+            glClear(GL_COLOR_BUFFER_BIT);
+            nk_glfw3_render(&glfw, NK_ANTI_ALIASING_ON, MAX_VERTEX_BUFFER, MAX_ELEMENT_BUFFER);
+        }
+        {
+            TRACE_SCOPE("gui swap");
+            glfwSwapBuffers(win);
+        }
      }
     nk_glfw3_shutdown(&glfw);
     glfwTerminate();
@@ -1,7 +1,12 @@
 #pragma once
 #include "iinterface.hpp"
 #include <thread>
+#include <atomic>
+#include <chrono>
+#include <mutex>
 #include <string>
+#include <cstdio>
+#include <cstdlib>
 #include "stdcapture.hpp"
 class GUI : public IInterface{
 public:
@@ -11,25 +16,44 @@ public:
         start_but_flag = false;
         stop_but_flag = false;
         trigger_flag.first = false;
+        report_but_flag = false;
     }
     bool get_connect_pressed() {if (conn_but_flag) {reset_flags(); return true;} return false;};
     bool get_start_pressed() {if (start_but_flag) {reset_flags(); return true;} return false;};
     bool get_stop_pressed() {if (stop_but_flag) {reset_flags(); return true;} return false;};
-    std::string get_com_port() {return std::string(com_input,com_size);};
+    //the edit fields belong to the render thread, other threads go through com_mtx
+    std::string get_com_port() {std::lock_guard<std::mutex> lock(com_mtx); return std::string(com_input,com_size);};
+    uint32_t get_baud_rate() {
+        std::lock_guard<std::mutex> lock(com_mtx);
+        return (uint32_t)strtoul(std::string(baud_input,baud_size).c_str(), nullptr, 10);
+    };
+    void set_com_settings(const std::string& port, uint32_t baud) {
+        std::lock_guard<std::mutex> lock(com_mtx);
+        com_size = snprintf(com_input, sizeof(com_input), "%s", port.c_str());
+        if (com_size >= (int)sizeof(com_input)) com_size = sizeof(com_input) - 1;
+        baud_size = snprintf(baud_input, sizeof(baud_input), "%u", baud);
+    };
     bool get_trigger_pressed() {if (trigger_flag.first) {reset_flags(); return true;} return false;};
     unsigned char get_trigger_value() override {return trigger_flag.second+1;};
+    std::chrono::steady_clock::time_point get_trigger_time() override {return trigger_time;};
+    bool get_report_pressed() {if (report_but_flag) {reset_flags(); return true;} return false;};
     void run_app();
+    std::chrono::steady_clock::time_point wait_ready() override;
 private:
     bool conn_but_flag = false;
     bool start_but_flag = false;
     bool stop_but_flag = false;
+    bool report_but_flag = false;
     std::pair<bool, unsigned char> trigger_flag = {false,0};
-    char baud_input[64] = "192000";
+    std::chrono::steady_clock::time_point trigger_time;
+    char baud_input[64] = "19200";
     char com_input[64] = "COM7";
     int com_size = 4;
-    int baud_size = 6;
+    int baud_size = 5;
+    std::mutex com_mtx;
     const static int MAX_MEMORY = 4096;
     std::shared_ptr<std::thread> renderthread;
     StdCapture stdcap;
-    bool gui_ready = false;
+    std::atomic<bool> gui_ready{false};
+    std::chrono::steady_clock::time_point ready_at;
 };
\ No newline at end of file
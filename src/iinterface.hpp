@@ -7,6 +7,13 @@
 #include <iomanip>
 #include "program_state.hpp"
 #include <sstream>
+#include <memory>
+#include <chrono>
+#include "latency_histogram.hpp"
+
+class ErpAverages;
+class StreamStats;
+class LiveValues;
 
 class IInterface{
 public:
@@ -14,15 +21,25 @@ public:
     virtual bool get_start_pressed() = 0;
     virtual bool get_stop_pressed() = 0;
     virtual std::string get_com_port() = 0;
+    virtual uint32_t get_baud_rate() = 0;
+    virtual void set_com_settings(const std::string& port, uint32_t baud) = 0; //prefill from the saved config
     virtual bool get_trigger_pressed() = 0;
     virtual void run_app() = 0;
+    //blocks until the interface accepts input, returns when that happened
+    virtual std::chrono::steady_clock::time_point wait_ready() = 0;
     virtual unsigned char get_trigger_value() = 0;
+    virtual std::chrono::steady_clock::time_point get_trigger_time() = 0; //when the pending trigger was requested
+    virtual bool get_report_pressed() = 0;
     void log(std::string str) {
         q_mutex.lock();
-        log_queue.push(str);
+        log_queue.push({str, std::chrono::steady_clock::now()});
         q_mutex.unlock();
     };
     volatile bool running;
+    //set by the data handler while the interface may already be drawing, use std::atomic_load/store
+    std::shared_ptr<ErpAverages> erp;
+    std::shared_ptr<StreamStats> stats;
+    std::shared_ptr<LiveValues> live;
 protected:
     std::string getLogQueue(){
         q_mutex.lock();
@@ -31,7 +48,8 @@ protected:
         {
             auto t = std::time(nullptr);
             auto tm = *std::localtime(&t);
-            ss << std::put_time(&tm, "%H:%M:%S: ") << log_queue.front() << std::endl;
+            ss << std::put_time(&tm, "%H:%M:%S: ") << log_queue.front().text << std::endl;
+            latency_histogram(LATENCY_LOG_TO_DISPLAY).record_since(log_queue.front().queued);
             log_queue.pop();
         }
         q_mutex.unlock();
@@ -47,5 +65,9 @@ protected:
         log(ss.str());
     }
     std::mutex q_mutex;
-    std::queue<std::string> log_queue;
+    struct LogLine {
+        std::string text;
+        std::chrono::steady_clock::time_point queued;
+    };
+    std::queue<LogLine> log_queue;
 };
\ No newline at end of file
@@ -0,0 +1,30 @@
+#pragma once
+#include <asio.hpp>
+#include <thread>
+#include "trace.hpp"
+#include "thread_roles.hpp"
+
+//io_context shared by the serial readers and network endpoints, run on its own thread for the app lifetime
+class IoThread {
+public:
+    static asio::io_context& context() {
+        static IoThread instance;
+        return instance.io;
+    }
+    ~IoThread() {
+        work.reset();
+        io.stop();
+        if (runner.joinable()) runner.join();
+    }
+private:
+    IoThread() : work(asio::make_work_guard(io)) {
+        runner = std::thread([this]{
+            TRACE_THREAD_NAME("io");
+            register_thread(ROLE_IO);
+            io.run();
+        });
+    }
+    asio::io_context io;
+    asio::executor_work_guard<asio::io_context::executor_type> work;
+    std::thread runner;
+};
@@ -0,0 +1,395 @@
+#include "json_value.hpp"
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <limits>
+
+static const char* type_name(JSON_TYPE t) {
+    switch (t) {
+        case JSON_NULL: return "null";
+        case JSON_BOOL: return "boolean";
+        case JSON_NUMBER: return "number";
+        case JSON_STRING: return "string";
+        case JSON_ARRAY: return "array";
+        case JSON_OBJECT: return "object";
+    }
+    return "?";
+}
+
+static void expect(JSON_TYPE have, JSON_TYPE want) {
+    if (have != want) throw std::runtime_error(std::string("expected ") + type_name(want) + ", found " + type_name(have));
+}
+
+JsonValue JsonValue::boolean(bool b) {
+    JsonValue v;
+    v.kind = JSON_BOOL;
+    v.b = b;
+    return v;
+}
+
+JsonValue JsonValue::number(int64_t i) {
+    JsonValue v;
+    v.kind = JSON_NUMBER;
+    v.integral = true;
+    v.i = i;
+    v.d = (double)i;
+    return v;
+}
+
+JsonValue JsonValue::real(double d) {
+    JsonValue v;
+    v.kind = JSON_NUMBER;
+    v.d = d;
+    return v;
+}
+
+JsonValue JsonValue::text(const std::string& s) {
+    JsonValue v;
+    v.kind = JSON_STRING;
+    v.s = s;
+    return v;
+}
+
+JsonValue JsonValue::array() {
+    JsonValue v;
+    v.kind = JSON_ARRAY;
+    return v;
+}
+
+JsonValue JsonValue::object() {
+    JsonValue v;
+    v.kind = JSON_OBJECT;
+    return v;
+}
+
+const JsonValue* JsonValue::find(const std::string& key) const {
+    if (kind != JSON_OBJECT) return nullptr;
+    for (auto& m : members)
+        if (m.first == key) return &m.second;
+    return nullptr;
+}
+
+const JsonValue& JsonValue::at(const std::string& key) const {
+    expect(kind, JSON_OBJECT);
+    const JsonValue* v = find(key);
+    if (!v) throw std::runtime_error("missing key " + key);
+    return *v;
+}
+
+bool JsonValue::as_bool() const {
+    expect(kind, JSON_BOOL);
+    return b;
+}
+
+int64_t JsonValue::as_int() const {
+    expect(kind, JSON_NUMBER);
+    if (integral) return i;
+    if (d != std::floor(d) || std::fabs(d) >= 9.2e18) throw std::runtime_error("expected an integer");
+    return (int64_t)d;
+}
+
+double JsonValue::as_real() const {
+    expect(kind, JSON_NUMBER);
+    return d;
+}
+
+const std::string& JsonValue::as_string() const {
+    expect(kind, JSON_STRING);
+    return s;
+}
+
+const std::vector<JsonValue>& JsonValue::as_array() const {
+    expect(kind, JSON_ARRAY);
+    return items;
+}
+
+const std::vector<std::pair<std::string, JsonValue>>& JsonValue::as_members() const {
+    expect(kind, JSON_OBJECT);
+    return members;
+}
+
+JsonValue& JsonValue::push(JsonValue v) {
+    expect(kind, JSON_ARRAY);
+    items.push_back(std::move(v));
+    return items.back();
+}
+
+JsonValue& JsonValue::set(const std::string& key, JsonValue v) {
+    expect(kind, JSON_OBJECT);
+    for (auto& m : members)
+        if (m.first == key) return m.second = std::move(v);
+    members.emplace_back(key, std::move(v));
+    return members.back().second;
+}
+
+namespace {
+const int MAX_DEPTH = 64;
+
+class JsonParser {
+public:
+    JsonParser(const std::string& text) : text(text) {}
+    JsonValue document() {
+        JsonValue v = value(0);
+        skip_space();
+        if (pos != text.size()) fail("trailing characters");
+        return v;
+    }
+private:
+    [[noreturn]] void fail(const char* what) {
+        throw std::runtime_error(std::string(what) + " at offset " + std::to_string(pos));
+    }
+    void skip_space() {
+        while (pos < text.size() && (text[pos] == ' ' || text[pos] == '\t' || text[pos] == '\n' || text[pos] == '\r')) pos++;
+    }
+    bool literal(const char* word) {
+        size_t n = std::char_traits<char>::length(word);
+        if (text.compare(pos, n, word) != 0) return false;
+        pos += n;
+        return true;
+    }
+    JsonValue value(int depth) {
+        if (depth > MAX_DEPTH) fail("nesting too deep");
+        skip_space();
+        if (pos >= text.size()) fail("unexpected end");
+        char c = text[pos];
+        if (c == '{') return object(depth);
+        if (c == '[') return array(depth);
+        if (c == '"') return JsonValue::text(string());
+        if (literal("true")) return JsonValue::boolean(true);
+        if (literal("false")) return JsonValue::boolean(false);
+        if (literal("null")) return JsonValue();
+        if (c == '-' || (c >= '0' && c <= '9')) return number();
+        fail("unexpected character");
+    }
+    JsonValue object(int depth) {
+        JsonValue v = JsonValue::object();
+        pos++;
+        skip_space();
+        if (pos < text.size() && text[pos] == '}') {
+            pos++;
+            return v;
+        }
+        while (true) {
+            skip_space();
+            if (pos >= text.size() || text[pos] != '"') fail("expected a key");
+            std::string key = string();
+            skip_space();
+            if (pos >= text.size() || text[pos] != ':') fail("expected ':'");
+            pos++;
+            v.set(key, value(depth + 1));
+            skip_space();
+            if (pos < text.size() && text[pos] == ',') {pos++; continue;}
+            if (pos < text.size() && text[pos] == '}') {pos++; return v;}
+            fail("expected ',' or '}'");
+        }
+    }
+    JsonValue array(int depth) {
+        JsonValue v = JsonValue::array();
+        pos++;
+        skip_space();
+        if (pos < text.size() && text[pos] == ']') {
+            pos++;
+            return v;
+        }
+        while (true) {
+            v.push(value(depth + 1));
+            skip_space();
+            if (pos < text.size() && text[pos] == ',') {pos++; continue;}
+            if (pos < text.size() && text[pos] == ']') {pos++; return v;}
+            fail("expected ',' or ']'");
+        }
+    }
+    unsigned hex4() {
+        if (pos + 4 > text.size()) fail("short \\u escape");
+        unsigned u = 0;
+        for (int k = 0; k < 4; k++) {
+            char h = text[pos++];
+            u <<= 4;
+            if (h >= '0' && h <= '9') u |= h - '0';
+            else if (h >= 'a' && h <= 'f') u |= h - 'a' + 10;
+            else if (h >= 'A' && h <= 'F') u |= h - 'A' + 10;
+            else fail("bad \\u escape");
+        }
+        return u;
+    }
+    static void utf8(std::string& out, unsigned cp) {
+        if (cp < 0x80) out += (char)cp;
+        else if (cp < 0x800) {
+            out += (char)(0xc0 | (cp >> 6));
+            out += (char)(0x80 | (cp & 0x3f));
+        } else if (cp < 0x10000) {
+            out += (char)(0xe0 | (cp >> 12));
+            out += (char)(0x80 | ((cp >> 6) & 0x3f));
+            out += (char)(0x80 | (cp & 0x3f));
+        } else {
+            out += (char)(0xf0 | (cp >> 18));
+            out += (char)(0x80 | ((cp >> 12) & 0x3f));
+            out += (char)(0x80 | ((cp >> 6) & 0x3f));
+            out += (char)(0x80 | (cp & 0x3f));
+        }
+    }
+    std::string string() {
+        std::string out;
+        pos++;
+        while (true) {
+            if (pos >= text.size()) fail("unterminated string");
+            char c = text[pos++];
+            if (c == '"') return out;
+            if ((unsigned char)c < 0x20) fail("control character in string");
+            if (c != '\\') {
+                out += c;
+                continue;
+            }
+            if (pos >= text.size()) fail("unterminated string");
+            char e = text[pos++];
+            switch (e) {
+                case '"': out += '"'; break;
+                case '\\': out += '\\'; break;
+                case '/': out += '/'; break;
+                case 'b': out += '\b'; break;
+                case 'f': out += '\f'; break;
+                case 'n': out += '\n'; break;
+                case 'r': out += '\r'; break;
+                case 't': out += '\t'; break;
+                case 'u': {
+                    unsigned cp = hex4();
+                    if (cp >= 0xd800 && cp < 0xdc00) {
+                        if (!literal("\\u")) fail("lone surrogate");
+                        unsigned low = hex4();
+                        if (low < 0xdc00 || low >= 0xe000) fail("lone surrogate");
+                        cp = 0x10000 + ((cp - 0xd800) << 10) + (low - 0xdc00);
+                    }
+                    utf8(out, cp);
+                    break;
+                }
+                default: fail("bad escape");
+            }
+        }
+    }
+    JsonValue number() {
+        size_t start = pos;
+        bool integral = true;
+        if (text[pos] == '-') pos++;
+        if (pos >= text.size() || text[pos] < '0' || text[pos] > '9') fail("bad number");
+        while (pos < text.size()) {
+            char c = text[pos];
+            if (c >= '0' && c <= '9') pos++;
+            else if (c == '.' || c == 'e' || c == 'E' || c == '+' || c == '-') {integral = false; pos++;}
+            else break;
+        }
+        std::string n = text.substr(start, pos - start);
+        char* end = nullptr;
+        if (integral) {
+            errno = 0;
+            long long i = std::strtoll(n.c_str(), &end, 10);
+            if (errno == 0 && *end == 0) return JsonValue::number(i);
+        }
+        double d = std::strtod(n.c_str(), &end);
+        if (*end != 0) {
+            pos = start;
+            fail("bad number");
+        }
+        return JsonValue::real(d);
+    }
+    const std::string& text;
+    size_t pos = 0;
+};
+
+void write_string(std::string& out, const std::string& s) {
+    out += '"';
+    for (char c : s) {
+        switch (c) {
+            case '"': out += "\\\""; break;
+            case '\\': out += "\\\\"; break;
+            case '\n': out += "\\n"; break;
+            case '\r': out += "\\r"; break;
+            case '\t': out += "\\t"; break;
+            default:
+                if ((unsigned char)c < 0x20) {
+                    char u[8];
+                    snprintf(u, sizeof(u), "\\u%04x", (unsigned)(unsigned char)c);
+                    out += u;
+                } else out += c;
+        }
+    }
+    out += '"';
+}
+
+void write_value(std::string& out, const JsonValue& v, int indent, int depth) {
+    auto newline = [&](int level) {
+        if (!indent) return;
+        out += '\n';
+        out.append((size_t)(indent * level), ' ');
+    };
+    switch (v.type()) {
+        case JSON_NULL: out += "null"; break;
+        case JSON_BOOL: out += v.as_bool() ? "true" : "false"; break;
+        case JSON_NUMBER: {
+            double d = v.as_real();
+            if (d == std::floor(d) && std::fabs(d) < 9.2e18) out += std::to_string(v.as_int());
+            else {
+                char buf[32];
+                snprintf(buf, sizeof(buf), "%.17g", d);
+                out += buf;
+            }
+            break;
+        }
+        case JSON_STRING: write_string(out, v.as_string()); break;
+        case JSON_ARRAY: {
+            const auto& items = v.as_array();
+            out += '[';
+            for (size_t k = 0; k < items.size(); k++) {
+                if (k) out += ',';
+                newline(depth + 1);
+                write_value(out, items[k], indent, depth + 1);
+            }
+            if (!items.empty()) newline(depth);
+            out += ']';
+            break;
+        }
+        case JSON_OBJECT: {
+            const auto& members = v.as_members();
+            out += '{';
+            for (size_t k = 0; k < members.size(); k++) {
+                if (k) out += ',';
+                newline(depth + 1);
+                write_string(out, members[k].first);
+                out += indent ? ": " : ":";
+                write_value(out, members[k].second, indent, depth + 1);
+            }
+            if (!members.empty()) newline(depth);
+            out += '}';
+            break;
+        }
+    }
+}
+}
+
+JsonValue json_parse(const std::string& text) {
+    return JsonParser(text).document();
+}
+
+std::string json_write(const JsonValue& v, int indent) {
+    std::string out;
+    write_value(out, v, indent, 0);
+    return out;
+}
+
+template <typename T>
+static T in_range(const JsonValue& v) {
+    int64_t i = v.as_int();
+    if (i < (int64_t)std::numeric_limits<T>::min() || i > (int64_t)std::numeric_limits<T>::max())
+        throw std::runtime_error("number out of range");
+    return (T)i;
+}
+
+void json_get(const JsonValue& v, std::string& out) {out = v.as_string();}
+void json_get(const JsonValue& v, bool& out) {out = v.as_bool();}
+void json_get(const JsonValue& v, int& out) {out = in_range<int>(v);}
+void json_get(const JsonValue& v, uint32_t& out) {out = in_range<uint32_t>(v);}
+void json_get(const JsonValue& v, uint64_t& out) {
+    int64_t i = v.as_int();
+    if (i < 0) throw std::runtime_error("number out of range");
+    out = (uint64_t)i;
+}
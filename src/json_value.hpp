@@ -0,0 +1,66 @@
+#pragma once
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+enum JSON_TYPE {
+    JSON_NULL,
+    JSON_BOOL,
+    JSON_NUMBER,
+    JSON_STRING,
+    JSON_ARRAY,
+    JSON_OBJECT
+};
+
+/* Just enough JSON for the config file: a DOM with objects kept in insertion order, a
+ * recursive-descent parser and an indented writer. Integers are kept exactly as int64.
+ * Accessors of the wrong type throw std::runtime_error, as does json_parse with the offset. */
+class JsonValue {
+public:
+    JsonValue() = default;
+    static JsonValue boolean(bool b);
+    static JsonValue number(int64_t i);
+    static JsonValue real(double d);
+    static JsonValue text(const std::string& s);
+    static JsonValue array();
+    static JsonValue object();
+
+    JSON_TYPE type() const {return kind;}
+    bool is_object() const {return kind == JSON_OBJECT;}
+    //nullptr if not an object or no such key
+    const JsonValue* find(const std::string& key) const;
+    const JsonValue& at(const std::string& key) const;
+
+    bool as_bool() const;
+    int64_t as_int() const; //a real must be integral
+    double as_real() const;
+    const std::string& as_string() const;
+    const std::vector<JsonValue>& as_array() const;
+    const std::vector<std::pair<std::string, JsonValue>>& as_members() const;
+
+    //building; set replaces an existing key
+    JsonValue& push(JsonValue v);
+    JsonValue& set(const std::string& key, JsonValue v);
+private:
+    JSON_TYPE kind = JSON_NULL;
+    bool b = false;
+    bool integral = false;
+    int64_t i = 0;
+    double d = 0;
+    std::string s;
+    std::vector<JsonValue> items;
+    std::vector<std::pair<std::string, JsonValue>> members;
+};
+
+JsonValue json_parse(const std::string& text);
+//indent spaces per level, 0 for one line
+std::string json_write(const JsonValue& v, int indent = 2);
+
+//typed reads with range checks, throwing like the accessors
+void json_get(const JsonValue& v, std::string& out);
+void json_get(const JsonValue& v, bool& out);
+void json_get(const JsonValue& v, int& out);
+void json_get(const JsonValue& v, uint32_t& out);
+void json_get(const JsonValue& v, uint64_t& out);
@@ -0,0 +1,102 @@
+#include "latency_histogram.hpp"
+#include <cstdio>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+static int msb_of(uint64_t v) {
+#ifdef _MSC_VER
+    unsigned long idx;
+    _BitScanReverse64(&idx, v);
+    return (int)idx;
+#else
+    return 63 - __builtin_clzll(v);
+#endif
+}
+
+LatencyHistogram::LatencyHistogram() {
+    reset();
+}
+
+int LatencyHistogram::index_of(uint64_t us) {
+    if (us < (uint64_t)SUB_BUCKETS) return (int)us;
+    if (us >= (1ull << MAX_VALUE_BITS)) us = (1ull << MAX_VALUE_BITS) - 1;
+    int shift = msb_of(us) - (SUB_BUCKET_BITS - 1);
+    return SUB_BUCKETS + (shift - 1) * HALF_SUB_BUCKETS + (int)((us >> shift) - HALF_SUB_BUCKETS);
+}
+
+uint64_t LatencyHistogram::highest_equivalent(int index) {
+    if (index < SUB_BUCKETS) return index;
+    int shift = (index - SUB_BUCKETS) / HALF_SUB_BUCKETS + 1;
+    uint64_t sub = (index - SUB_BUCKETS) % HALF_SUB_BUCKETS + HALF_SUB_BUCKETS;
+    return ((sub + 1) << shift) - 1;
+}
+
+void LatencyHistogram::record(uint64_t us) {
+    counts[index_of(us)].fetch_add(1, std::memory_order_relaxed);
+    total.fetch_add(1, std::memory_order_relaxed);
+    sum_us.fetch_add(us, std::memory_order_relaxed);
+    uint64_t prev = max_us.load(std::memory_order_relaxed);
+    while (us > prev && !max_us.compare_exchange_weak(prev, us, std::memory_order_relaxed)) {}
+}
+
+void LatencyHistogram::record(std::chrono::steady_clock::duration d) {
+    auto us = std::chrono::duration_cast<std::chrono::microseconds>(d).count();
+    record(us > 0 ? (uint64_t)us : 0);
+}
+
+void LatencyHistogram::reset() {
+    for (auto& c : counts) c.store(0, std::memory_order_relaxed);
+    total = 0;
+    sum_us = 0;
+    max_us = 0;
+}
+
+double LatencyHistogram::mean() const {
+    uint64_t n = count();
+    return n ? (double)sum_us.load(std::memory_order_relaxed) / n : 0;
+}
+
+uint64_t LatencyHistogram::percentile(double p) const {
+    //sum the buckets rather than trusting total, writers may be mid-record
+    uint64_t n = 0;
+    for (auto& c : counts) n += c.load(std::memory_order_relaxed);
+    if (n == 0) return 0;
+    uint64_t rank = (uint64_t)(p / 100.0 * n + 0.5);
+    if (rank < 1) rank = 1;
+    if (rank > n) rank = n;
+    uint64_t seen = 0;
+    for (int i = 0; i < BUCKET_COUNT; i++) {
+        seen += counts[i].load(std::memory_order_relaxed);
+        if (seen >= rank) {
+            uint64_t v = highest_equivalent(i);
+            return v < max() ? v : max();
+        }
+    }
+    return max();
+}
+
+std::string LatencyHistogram::report(const char* name) const {
+    char buf[192];
+    snprintf(buf, sizeof(buf), "%s n=%llu p50=%llu p99=%llu p99.9=%llu max=%llu us", name,
+        (unsigned long long)count(), (unsigned long long)percentile(50), (unsigned long long)percentile(99),
+        (unsigned long long)percentile(99.9), (unsigned long long)max());
+    return buf;
+}
+
+const char* latency_path_name(int path) {
+    static const char* names[LATENCY_PATH_COUNT] = {"trigger->byte", "receive->stored", "log->display", "schedule->byte"};
+    return path >= 0 && path < LATENCY_PATH_COUNT ? names[path] : "?";
+}
+
+LatencyHistogram& latency_histogram(LATENCY_PATH path) {
+    static LatencyHistogram histograms[LATENCY_PATH_COUNT];
+    return histograms[path];
+}
+
+std::string latency_report() {
+    std::string out = "Latency:";
+    for (int p = 0; p < LATENCY_PATH_COUNT; p++)
+        out += "\n  " + latency_histogram((LATENCY_PATH)p).report(latency_path_name(p));
+    return out;
+}
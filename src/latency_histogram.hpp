@@ -0,0 +1,52 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+/* Log-linear (HDR style) latency histogram in microseconds.
+ * Each power of two range is split into 64 linear sub-buckets, so any recorded value is reported
+ * within 1/64 (~1.6%) of its true value from 1 us up to ~12 days. record() is a couple of relaxed
+ * atomic adds and may be called from any thread without locking. */
+class LatencyHistogram {
+public:
+    static const int SUB_BUCKET_BITS = 7;
+    static const int SUB_BUCKETS = 1 << SUB_BUCKET_BITS;
+    static const int HALF_SUB_BUCKETS = SUB_BUCKETS / 2;
+    static const int MAX_VALUE_BITS = 40;
+    static const int BUCKET_COUNT = SUB_BUCKETS + (MAX_VALUE_BITS - SUB_BUCKET_BITS) * HALF_SUB_BUCKETS;
+
+    LatencyHistogram();
+    void record(uint64_t us);
+    void record(std::chrono::steady_clock::duration d);
+    void record_since(std::chrono::steady_clock::time_point start) {record(std::chrono::steady_clock::now() - start);}
+    void reset();
+
+    uint64_t count() const {return total.load(std::memory_order_relaxed);}
+    uint64_t max() const {return max_us.load(std::memory_order_relaxed);}
+    double mean() const;
+    //highest value equivalent to the bucket holding the given percentile (0-100)
+    uint64_t percentile(double p) const;
+    //"name n=.. p50=.. p99=.. p99.9=.. max=.. us"
+    std::string report(const char* name) const;
+
+    static int index_of(uint64_t us);
+    static uint64_t highest_equivalent(int index);
+private:
+    std::atomic<uint64_t> counts[BUCKET_COUNT];
+    std::atomic<uint64_t> total{0};
+    std::atomic<uint64_t> sum_us{0};
+    std::atomic<uint64_t> max_us{0};
+};
+
+//the paths whose tail latency decides event timing
+enum LATENCY_PATH {
+    LATENCY_TRIGGER_TO_BYTE,   //trigger button press -> trigger byte written to the port
+    LATENCY_RECEIVE_TO_STORED, //packet receive_time -> rows pushed to the session store
+    LATENCY_LOG_TO_DISPLAY,    //IInterface::log() -> line taken by the console
+    LATENCY_SCHEDULE_TO_BYTE,  //planned time of a scheduled trigger -> trigger byte written to the port
+    LATENCY_PATH_COUNT
+};
+const char* latency_path_name(int path);
+LatencyHistogram& latency_histogram(LATENCY_PATH path);
+std::string latency_report();
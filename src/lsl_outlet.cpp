@@ -0,0 +1,150 @@
+#include "lsl_outlet.hpp"
+#include "stream_table.hpp"
+#include "trace.hpp"
+#include <algorithm>
+#include <vector>
+
+ClockOffsetFilter::ClockOffsetFilter(double window_s, int windows, double step_s)
+    : window_s(window_s), step_s(step_s), minima((size_t)std::max(windows, 1)) {}
+
+double ClockOffsetFilter::update(double host_s, double device_s) {
+    double d = host_s - device_s;
+    if (!have || d > estimate + step_s) {
+        std::fill(minima.begin(), minima.end(), d);
+        current = 0;
+        window_start = host_s;
+        estimate = d;
+        have = true;
+        return estimate;
+    }
+    if (host_s - window_start >= window_s) {
+        current = (current + 1) % minima.size();
+        minima[current] = d;
+        window_start = host_s;
+    } else minima[current] = std::min(minima[current], d);
+    estimate = *std::min_element(minima.begin(), minima.end());
+    return estimate;
+}
+
+#ifdef CARETAKER_LSL
+#include <lsl_cpp.h>
+
+struct LslOutlet::Outlets {
+    std::unique_ptr<lsl::stream_outlet> pulse;
+    std::unique_ptr<lsl::stream_outlet> vitals;
+    std::unique_ptr<lsl::stream_outlet> markers;
+    ClockOffsetFilter clock; //LSL seconds minus device seconds
+    //one packet's worth of each stream, kept between packets
+    std::vector<float> pulse_values;
+    std::vector<float> vitals_values;
+    std::vector<double> vitals_stamps;
+    double pulse_last = 0;
+
+    double lsl_time(long long device_ts) const {return device_ts / 1000.0 + clock.offset();}
+
+    void row(STREAM_ID stream, const StreamRow& row) {
+        if (stream == STREAM_INT_PULSE) {
+            pulse_values.push_back((float)row.ints[0]);
+            pulse_last = (double)row.timestamp;
+        } else if (stream == STREAM_VITALS) {
+            const StreamDesc& d = stream_desc(stream);
+            for (int i = 0; i < d.int_fields; i++) vitals_values.push_back((float)row.ints[i]);
+            for (int i = 0; i < d.float_fields; i++) vitals_values.push_back(row.floats[i]);
+            vitals_stamps.push_back((double)row.timestamp);
+        }
+    }
+    void packet(STREAM_ID, const StreamPacket&) {}
+};
+
+static lsl::stream_info describe(const char* name, const char* type, STREAM_ID stream, double rate, const std::string& source_id) {
+    const StreamDesc& d = stream_desc(stream);
+    lsl::stream_info info(name, type, d.field_count, rate, lsl::cf_float32, source_id + "-" + d.config_name);
+    lsl::xml_element channels = info.desc().append_child("channels");
+    for (int f = d.first_field; f < d.first_field + d.field_count; f++)
+        channels.append_child("channel").append_child_value("label", field_desc(f).column);
+    info.desc().append_child("acquisition").append_child_value("manufacturer", "Caretaker Medical");
+    return info;
+}
+
+bool LslOutlet::open(const std::string& source_id) {
+    std::lock_guard<std::mutex> lock(mtx);
+    auto o = std::make_unique<Outlets>();
+    const StreamDesc& pulse = stream_desc(STREAM_INT_PULSE);
+    //chunk sizes match a packet so the outlet does not split or hold them
+    o->pulse = std::make_unique<lsl::stream_outlet>(
+        describe("Caretaker Pulse", "PPG", STREAM_INT_PULSE, pulse.sample_hz, source_id), 0, 60);
+    o->vitals = std::make_unique<lsl::stream_outlet>(
+        describe("Caretaker Vitals", "Vitals", STREAM_VITALS, lsl::IRREGULAR_RATE, source_id), 0, 600);
+    o->markers = std::make_unique<lsl::stream_outlet>(
+        lsl::stream_info("Caretaker Markers", "Markers", 1, lsl::IRREGULAR_RATE, lsl::cf_string, source_id + "-markers"), 0, 600);
+    o->pulse_values.reserve(256);
+    o->vitals_values.reserve(8 * STREAM_MAX_FIELDS);
+    o->vitals_stamps.reserve(8);
+    outlets = std::move(o);
+    return true;
+}
+
+void LslOutlet::push(const libct_stream_data_t* data) {
+    TRACE_SCOPE("lsl push");
+    std::lock_guard<std::mutex> lock(mtx);
+    if (!outlets) return;
+    Outlets& o = *outlets;
+    o.pulse_values.clear();
+    o.vitals_values.clear();
+    o.vitals_stamps.clear();
+    ingest_streams(data, o);
+    if (!o.pulse_values.empty()) {
+        //the newest sample arrives with the packet, the filter takes the transport delay out
+        o.clock.update(lsl::local_clock(), o.pulse_last / 1000.0);
+        o.pulse->push_chunk_multiplexed(o.pulse_values.data(), o.pulse_values.size(), o.lsl_time((long long)o.pulse_last));
+    }
+    if (!o.vitals_stamps.empty() && o.clock.valid()) {
+        for (auto& t : o.vitals_stamps) t = o.lsl_time((long long)t);
+        o.vitals->push_chunk_multiplexed(o.vitals_values.data(), o.vitals_stamps.data(), o.vitals_values.size());
+    }
+}
+
+void LslOutlet::marker(long long device_ts, int code) {
+    std::lock_guard<std::mutex> lock(mtx);
+    if (!outlets || !outlets->clock.valid()) return;
+    std::vector<std::string> sample{std::to_string(code)};
+    outlets->markers->push_sample(sample, outlets->lsl_time(device_ts));
+}
+
+bool LslOutlet::available() {
+    return true;
+}
+
+#else
+
+struct LslOutlet::Outlets {};
+
+bool LslOutlet::open(const std::string&) {
+    return false;
+}
+
+void LslOutlet::push(const libct_stream_data_t*) {}
+
+void LslOutlet::marker(long long, int) {}
+
+bool LslOutlet::available() {
+    return false;
+}
+
+#endif
+
+LslOutlet::LslOutlet() = default;
+
+LslOutlet::~LslOutlet() {
+    close();
+}
+
+void LslOutlet::close() {
+    std::lock_guard<std::mutex> lock(mtx);
+    outlets.reset();
+}
+
+bool LslOutlet::is_open() {
+    std::lock_guard<std::mutex> lock(mtx);
+    return outlets != nullptr;
+}
@@ -0,0 +1,54 @@
+#pragma once
+#include <caretaker_static.h>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/* Host minus device clock offset from (receive time, device time) pairs. Transport delay only adds
+ * to a difference, so the smallest one is the best estimate; it is the minimum over the last few
+ * windows so a slow drift between the clocks is followed. A difference far above the estimate is a
+ * step of the device clock, not delay, and starts over. */
+class ClockOffsetFilter {
+public:
+    ClockOffsetFilter(double window_s = 10, int windows = 6, double step_s = 1);
+    //returns the offset in seconds after taking the pair into account
+    double update(double host_s, double device_s);
+    double offset() const {return estimate;}
+    bool valid() const {return have;}
+    void reset() {have = false;}
+private:
+    const double window_s;
+    const double step_s;
+    std::vector<double> minima; //one per window, a ring
+    size_t current = 0;
+    double window_start = 0;
+    double estimate = 0;
+    bool have = false;
+};
+
+/* Lab Streaming Layer outlets, built with -DCARETAKER_LSL=ON (needs liblsl), otherwise every call
+ * does nothing. Three streams:
+ *   "Caretaker Pulse"   int pulse, one channel at its sample rate
+ *   "Caretaker Vitals"  the vitals fields of the stream table, irregular rate
+ *   "Caretaker Markers" trigger codes as strings, irregular rate
+ * Each packet goes out as one chunk per stream. Device time is mapped onto the LSL clock through a
+ * ClockOffsetFilter fed with the newest pulse sample of each packet, so vitals and markers keep their
+ * device-clock spacing. */
+class LslOutlet {
+public:
+    LslOutlet();
+    ~LslOutlet();
+    //source_id identifies this recorder to inlets across restarts
+    bool open(const std::string& source_id);
+    void close();
+    void push(const libct_stream_data_t* data);
+    //a trigger code at device time, ignored before the first pulse sample
+    void marker(long long device_ts, int code);
+    bool is_open();
+    static bool available(); //built with LSL support
+private:
+    struct Outlets;
+    std::mutex mtx;
+    std::unique_ptr<Outlets> outlets;
+};
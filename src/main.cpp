@@ -6,6 +6,11 @@
 #include "gui.hpp"
 #include <cxxopts.hpp>
 #include "program_state.hpp"
+#include "trace.hpp"
+#include "startup_report.hpp"
+#include "thread_roles.hpp"
+#include "trigger_scheduler.hpp"
+#include <filesystem>
 #define USB_ENABLED 1
 
 int main(int argc, char **argv)
@@ -13,86 +18,200 @@ int main(int argc, char **argv)
     //program argument handling
     cxxopts::Options options("CaretakerApp", "An app for controlling the Caretaker4 platform");
     options.add_options()("h,help", "Print usage")
-    ("n,nogui", "Start application in console-only mode");
+    ("n,nogui", "Start application in console-only mode")
+    ("epoch-pre", "Milliseconds of data kept before each trigger epoch", cxxopts::value<int>()->default_value("500"))
+    ("epoch-post", "Milliseconds of data kept after each trigger epoch", cxxopts::value<int>()->default_value("1500"))
+    ("fsync-ms", "Maximum interval between write-ahead log syncs", cxxopts::value<int>()->default_value("1000"))
+    ("metrics-bind", "Address the metrics endpoint listens on", cxxopts::value<std::string>()->default_value("127.0.0.1"))
+    ("config", "Settings file, rewritten whenever a setting changes", cxxopts::value<std::string>()->default_value("caretaker_config.json"))
+    ("metrics-port", "Port of the metrics endpoint, 0 to disable", cxxopts::value<int>()->default_value("9464"))
+    ("export-csv", "Write each stream of a session store (.cts) to its own CSV file and exit", cxxopts::value<std::string>())
+    ("schedule", "Trigger schedule played from Start: offset_ms,code,width_ms[,jitter_ms] per line", cxxopts::value<std::string>())
+    ("schedule-spin-us", "How long before each scheduled trigger the dispatch thread stops sleeping and spins", cxxopts::value<int>()->default_value("2000"));
 
     auto args = options.parse(argc, argv);
+    if (args.count("export-csv"))
+        return export_session_csv(args["export-csv"].as<std::string>(), [](std::string s){std::cout << s << std::endl;}) < 0 ? 1 : 0;
+    register_thread(ROLE_MAIN);
     std::shared_ptr<IInterface> io;
     TriggerBox tb;
+    StartupReport startup;
  
+    //the window comes up on the render thread while the independent phases below run alongside it
     io = std::make_shared<GUI>();
     io->running = true;
     std::cout << "Starting app in graphical mode" << std::endl;
 
-    CaretakerHandler cth(io);
+    EpochConfig epoch_config;
+    epoch_config.pre_ms = args["epoch-pre"].as<int>();
+    epoch_config.post_ms = args["epoch-post"].as<int>();
+    auto config = std::make_shared<ConfigStore>(args["config"].as<std::string>(), [io](std::string s){io->log(s);});
+    auto config_ready = startup.run_async("config", [config, io]{
+        config->load();
+        AppConfig cfg = config->get();
+        std::error_code ec;
+        std::filesystem::create_directories(cfg.output_dir, ec);
+        if (ec) io->log("Could not create output directory " + cfg.output_dir + ": " + ec.message());
+        return cfg;
+    });
+    auto ports = startup.run_async("serial ports", []{return list_serial_ports();});
+    auto libct_start = StartupReport::Clock::now();
+    CaretakerHandler cth(io, config, epoch_config, args["fsync-ms"].as<int>());
+    startup.mark("libct init", libct_start, StartupReport::Clock::now());
+    AppConfig startup_config = config_ready.get();
+    io->set_com_settings(startup_config.com_port, startup_config.baud);
+    //threads that are already up get their policy now, later ones as they register
+    configure_thread_roles(startup_config.threads, [io](std::string s){io->log(s);});
+    startup.run("session files", [&]{cth.open_session(startup_config.output_dir);});
+    MetricsServer metrics_server(IoThread::context(), cth.metrics);
+    if (args["metrics-port"].as<int>() > 0) {
+        std::string endpoint = args["metrics-bind"].as<std::string>() + ":" + std::to_string(args["metrics-port"].as<int>());
+        try {
+            metrics_server.start(args["metrics-bind"].as<std::string>(), (unsigned short)args["metrics-port"].as<int>());
+            io->log("Serving metrics on http://" + endpoint + "/metrics");
+        } catch (const std::exception& e) {
+            io->log("Metrics endpoint " + endpoint + " unavailable: " + e.what());
+        }
+    }
+    std::vector<std::string> found_ports = ports.get();
+    std::string port_list;
+    for (auto& p : found_ports) port_list += (port_list.empty() ? "" : ", ") + p;
+    io->log("Serial ports: " + (port_list.empty() ? std::string("none found") : port_list));
+    if (!found_ports.empty() && std::find(found_ports.begin(), found_ports.end(), startup_config.com_port) == found_ports.end())
+        io->log("Configured trigger port " + startup_config.com_port + " is not present");
+    TriggerScheduler scheduler(args["schedule-spin-us"].as<int>());
+    if (args.count("schedule")) {
+        std::vector<ScheduledTrigger> schedule;
+        std::string error;
+        if (load_trigger_schedule(args["schedule"].as<std::string>(), schedule, error)) {
+            scheduler.load(schedule);
+            io->log("Loaded " + std::to_string(schedule.size()) + " scheduled triggers from " + args["schedule"].as<std::string>());
+        } else io->log("Trigger schedule not loaded, " + error);
+    }
+    bool schedule_reported = true;
+    std::vector<TriggerEmission> emitted;
+    emitted.reserve(64);
+    //scheduled triggers go into the session like button presses, the planned against actual times to their own file
+    auto record_scheduled = [&](bool final) {
+        emitted.clear();
+        scheduler.drain(emitted);
+        for (auto& e : emitted) {
+            io->log("Sent scheduled trigger " + std::to_string((int)e.code) + " at " + std::to_string(e.actual_us)
+                + " us, " + std::to_string(e.actual_us - e.planned_us) + " us from plan");
+            cth.recordLastTimestamp(e.code, e.written);
+        }
+        if (schedule_reported || !(final || scheduler.finished())) return;
+        schedule_reported = true;
+        std::string report = cth.session() + ".schedule.csv";
+        if (scheduler.report(report)) io->log("Trigger schedule timing written to " + report);
+        else io->log("Could not write " + report);
+    };
+    auto gui_ready = io->wait_ready();
+    startup.mark("gui", startup.started(), gui_ready);
+    io->log(startup.summary(StartupReport::Clock::now()));
+    io->log(thread_roles_report());
     bool quit = false;
-    set_state(IDLE);
+    //guards may refuse, in which case the state is left as it was
+    StateMachine sm({
+        {IDLE, EV_CONNECT, CONNECTING_CARETAKER, [&]{
+            bool didConnectEEG = tb.connectToCom(io->get_com_port(), io->get_baud_rate(), [io](std::string s){io->log(s);});
+            if (!didConnectEEG) {
+                io->log("Failed to connect to COM port " + io->get_com_port() + " at " + std::to_string(io->get_baud_rate()) + " baud");
+                return false;
+            }
+            config->update([&io](AppConfig& c) {
+                c.com_port = io->get_com_port();
+                c.baud = io->get_baud_rate();
+            });
+            io->log("Connected to EEG COM port on " + io->get_com_port());
+            //runs on the io thread for every read, the box repeats its input so only changes are logged
+            tb.onInput(FRAME_BYTES, [io, last = -1](const SerialFrame& f) mutable {
+                if (f.data.empty() || (unsigned char)f.data.back() == last) return;
+                last = (unsigned char)f.data.back();
+                io->log("Trigger box input " + std::to_string(last) + " at " + std::to_string(f.received_ms)
+                    + (f.data.size() > 1 ? " (" + std::to_string(f.data.size()) + " bytes read)" : ""));
+            });
+            //start Caretaker link
+            if(USB_ENABLED) {
+                bool connect_started = cth.connect_to_single_device();
+                if(!connect_started) {
+                    io->log("Failed to begin connecting to the Caretaker (check usb/bluetooth)");
+                    tb.endComConnection();
+                    return false;
+                }
+            }
+            return true;
+        }},
+        {CONNECTING_CARETAKER, EV_LINK_UP, CONNECTED, nullptr},
+        {CONNECTED, EV_START, RUNNING, nullptr},
+        {StateMachine::ANY, EV_STOP, IDLE, nullptr},
+        {StateMachine::ANY, EV_EXIT, QUIT, nullptr},
+    }, [io](std::string s){io->log(s);});
+    sm.on_transition([&cth](const StateMachine::Record& r){cth.record_transition(r);});
+    sm.on_entry(RUNNING, [&]{
+        if(USB_ENABLED) cth.start_device_readings();
+        if (scheduler.size() && scheduler.start([&tb](unsigned char code){return tb.writeCode(code);})) {
+            schedule_reported = false;
+            io->log("Trigger schedule started");
+        }
+    });
+    //every way back to IDLE tears the links down
+    sm.on_entry(IDLE, [&]{
+        scheduler.stop();
+        record_scheduled(true);
+        if(USB_ENABLED) cth.stop_device_readings();
+        tb.endComConnection();
+    });
     
-    while(get_state() != QUIT){
-        
-        PROGRAM_STATE next_state = get_state();
-        switch(get_state()) {
+    TRACE_THREAD_NAME("main");
+    while(sm.state() != QUIT){
+        TRACE_SCOPE_ABOVE("state step", 20); //the loop spins, idle passes would flush the ring
+        switch(sm.state()) {
             case IDLE:
-                if (io->get_connect_pressed()) {
-                    bool didConnectEEG = tb.connectToCom(io->get_com_port());
-                    if (!didConnectEEG) {
-                        io->log("Failed to connect to COM port " + io->get_com_port());
-                        break;
-                    }
-                    io->log("Connected to EEG COM port on " + io->get_com_port());
-                    //start Caretaker link
-                    if(USB_ENABLED) {
-                        bool discovery_started = cth.connect_to_single_device();
-                        if(!discovery_started) {
-                            io->log("Failed to begin Caretaker discovery (check usb/bluetooth)");
-                            tb.endComConnection();
-                            break;
-                        }
-                    }
-                    next_state = CONNECTING_CARETAKER;
-                }
+                if (io->get_connect_pressed()) sm.fire(EV_CONNECT);
                 break;
             case CONNECTING_CARETAKER:
                 //await connection
-                if (cth.isConnected || USB_ENABLED == 0){
-                    next_state = CONNECTED;
-                }
+                if (cth.isConnected || USB_ENABLED == 0) sm.fire(EV_LINK_UP);
                 break;
             case CONNECTED:
-                if(io->get_start_pressed()) {
-                    if(USB_ENABLED) cth.start_device_readings();
-                    //tb.sendTrigger(io->get_trigger_value());
-                    //io->log("Send trigger " + std::to_string((int)io->get_trigger_value()));
-                    next_state = RUNNING;
-                }
-                if(io->get_stop_pressed()) {
-                    if(USB_ENABLED) cth.stop_device_readings();
-                    tb.endComConnection();
-                    next_state = IDLE;
-                }
+                if(io->get_start_pressed()) sm.fire(EV_START);
                 break;
             case RUNNING:
+                record_scheduled(false);
                 if(io->get_trigger_pressed()) {
-                    tb.sendTrigger(io->get_trigger_value());
+                    //the schedule owns the trigger lines while it plays
+                    if (scheduler.running()) {
+                        io->log("Trigger schedule running, manual trigger ignored");
+                        break;
+                    }
+                    auto written = tb.sendTrigger(io->get_trigger_value());
+                    latency_histogram(LATENCY_TRIGGER_TO_BYTE).record(written - io->get_trigger_time());
                     io->log("Sent trigger " + std::to_string((int)io->get_trigger_value()));
-                    cth.recordLastTimestamp(io->get_trigger_value());
+                    cth.recordLastTimestamp(io->get_trigger_value(), written);
                 }
                 break;
+            default:
+                break;
         }
         //common logic
         //
-        if(io->get_stop_pressed()) {
-            if(USB_ENABLED) cth.stop_device_readings();
-            tb.endComConnection();
-            next_state = IDLE;
-        }
-        /////////////////////////////
-        if(get_state() != next_state) {
-           io->log("Moving state " + get_name(get_state()) + " to " + get_name(next_state));
-        }
-        set_state(next_state);
-        if(io->running == false) {
-            set_state(QUIT);
+        cth.strategy.tick();
+        cth.save_known_devices();
+        cth.supervisor.tick();
+        cth.update_stats();
+        if(io->get_report_pressed()) {
+            io->log(latency_report());
+            io->log(thread_roles_report());
+#ifdef CARETAKER_TRACE
+            std::string trace_file = "trace-" + std::to_string(std::time(nullptr)) + ".json";
+            long events = trace_dump(trace_file);
+            if (events < 0) io->log("Could not write " + trace_file);
+            else io->log("Wrote " + std::to_string(events) + " trace events to " + trace_file);
+#endif
         }
+        if(io->get_stop_pressed()) sm.fire(EV_STOP);
+        if(io->running == false) sm.fire(EV_EXIT);
     }
 
     return 0;
@@ -0,0 +1,209 @@
+#include "metrics_endpoint.hpp"
+#include "program_state.hpp"
+#include <cctype>
+#include <cstdarg>
+#include <cstdio>
+#include <future>
+
+static const double QUANTILES[Metrics::QUANTILE_COUNT] = {50, 99, 99.9, 100};
+static const char* QUANTILE_LABELS[Metrics::QUANTILE_COUNT] = {"0.5", "0.99", "0.999", "1"};
+
+Metrics::Metrics() {
+    for (int s = 0; s < STREAM_COUNT; s++) {
+        samples_per_s[s] = 0;
+        packets_per_s[s] = 0;
+        bytes_per_s[s] = 0;
+        gaps[s] = 0;
+        dropped[s] = 0;
+        latency_avg_ms[s] = 0;
+        latency_max_ms[s] = 0;
+    }
+    for (int p = 0; p < LATENCY_PATH_COUNT; p++) {
+        latency_count[p] = 0;
+        for (auto& q : latency_us[p]) q = 0;
+    }
+}
+
+void Metrics::publish_streams(const StreamRates rates[STREAM_COUNT]) {
+    for (int s = 0; s < STREAM_COUNT; s++) {
+        samples_per_s[s].store(rates[s].samples_per_s, std::memory_order_relaxed);
+        packets_per_s[s].store(rates[s].packets_per_s, std::memory_order_relaxed);
+        bytes_per_s[s].store(rates[s].bytes_per_s, std::memory_order_relaxed);
+        gaps[s].store(rates[s].gaps, std::memory_order_relaxed);
+        dropped[s].store(rates[s].dropped, std::memory_order_relaxed);
+        latency_avg_ms[s].store(rates[s].latency_avg_ms, std::memory_order_relaxed);
+        latency_max_ms[s].store(rates[s].latency_max_ms, std::memory_order_relaxed);
+    }
+}
+
+void Metrics::publish_latency() {
+    for (int p = 0; p < LATENCY_PATH_COUNT; p++) {
+        const LatencyHistogram& h = latency_histogram((LATENCY_PATH)p);
+        latency_count[p].store(h.count(), std::memory_order_relaxed);
+        for (int q = 0; q < QUANTILE_COUNT; q++)
+            latency_us[p][q].store(h.percentile(QUANTILES[q]), std::memory_order_relaxed);
+    }
+}
+
+static std::string label_value(const char* name) {
+    std::string s;
+    for (const char* c = name; *c; c++) {
+        if (isalnum((unsigned char)*c)) s += *c;
+        else if (s.empty() || s.back() != '_') s += '_';
+    }
+    return s;
+}
+
+static void line(std::string& out, const char* fmt, ...) {
+    char buf[256];
+    va_list args;
+    va_start(args, fmt);
+    vsnprintf(buf, sizeof(buf), fmt, args);
+    va_end(args);
+    out += buf;
+}
+
+static void header(std::string& out, const char* name, const char* type, const char* help) {
+    line(out, "# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+}
+
+std::string Metrics::render() const {
+    std::string out;
+    out.reserve(8192);
+    auto r = std::memory_order_relaxed;
+
+    header(out, "caretaker_program_state", "gauge", "Current program state, 1 for the active one");
+    for (int s = IDLE; s <= QUIT; s++)
+        line(out, "caretaker_program_state{state=\"%s\"} %d\n", get_name((PROGRAM_STATE)s).c_str(), program_state.load(r) == s ? 1 : 0);
+    header(out, "caretaker_device_connected", "gauge", "Whether the Caretaker link is up");
+    line(out, "caretaker_device_connected %d\n", connected.load(r) ? 1 : 0);
+
+    struct {const char* name; const char* type; const char* help; const std::atomic<double>* values;} rates[] = {
+        {"caretaker_stream_samples_per_second", "gauge", "Samples received per second", samples_per_s},
+        {"caretaker_stream_packets_per_second", "gauge", "Packets received per second", packets_per_s},
+        {"caretaker_stream_bytes_per_second", "gauge", "Payload bytes received per second", bytes_per_s},
+        {"caretaker_stream_latency_avg_ms", "gauge", "Mean receive latency above the best case", latency_avg_ms},
+        {"caretaker_stream_latency_max_ms", "gauge", "Max receive latency above the best case", latency_max_ms},
+    };
+    for (auto& m : rates) {
+        header(out, m.name, m.type, m.help);
+        for (int s = 0; s < STREAM_COUNT; s++)
+            line(out, "%s{stream=\"%s\"} %.3f\n", m.name, label_value(stream_name(s)).c_str(), m.values[s].load(r));
+    }
+    header(out, "caretaker_stream_gaps_total", "counter", "Timestamp gaps beyond the expected cadence");
+    for (int s = 0; s < STREAM_COUNT; s++)
+        line(out, "caretaker_stream_gaps_total{stream=\"%s\"} %llu\n", label_value(stream_name(s)).c_str(), (unsigned long long)gaps[s].load(r));
+    header(out, "caretaker_stream_dropped_samples_total", "counter", "Samples missing inside detected gaps");
+    for (int s = 0; s < STREAM_COUNT; s++)
+        line(out, "caretaker_stream_dropped_samples_total{stream=\"%s\"} %llu\n", label_value(stream_name(s)).c_str(), (unsigned long long)dropped[s].load(r));
+
+    header(out, "caretaker_latency_us", "summary", "Latency distribution per timing path in microseconds");
+    for (int p = 0; p < LATENCY_PATH_COUNT; p++) {
+        std::string path = label_value(latency_path_name(p));
+        for (int q = 0; q < QUANTILE_COUNT; q++)
+            line(out, "caretaker_latency_us{path=\"%s\",quantile=\"%s\"} %llu\n", path.c_str(), QUANTILE_LABELS[q], (unsigned long long)latency_us[p][q].load(r));
+        line(out, "caretaker_latency_us_count{path=\"%s\"} %llu\n", path.c_str(), (unsigned long long)latency_count[p].load(r));
+    }
+
+    struct {const char* name; const char* type; const char* help; const std::atomic<uint64_t>* value;} counters[] = {
+        {"caretaker_wal_queued_records", "gauge", "Journal records waiting for the flusher", &wal_queued},
+        {"caretaker_wal_records_total", "counter", "Journal records written", &wal_records},
+        {"caretaker_store_rows_total", "counter", "Rows written to the session store", &store_rows},
+        {"caretaker_store_bytes_total", "counter", "Bytes written to the session store", &store_bytes},
+        {"caretaker_epochs_pending", "gauge", "Triggers waiting for their post-trigger window", &epochs_pending},
+        {"caretaker_epochs_written_total", "counter", "Epochs written to the epoch file", &epochs_written},
+        {"caretaker_connection_gaps_total", "counter", "Outages recovered by the connection supervisor", &connection_gaps},
+        {"caretaker_triggers_total", "counter", "Triggers sent and recorded", &triggers},
+    };
+    for (auto& m : counters) {
+        header(out, m.name, m.type, m.help);
+        line(out, "%s %llu\n", m.name, (unsigned long long)m.value->load(r));
+    }
+    header(out, "caretaker_wal_sync_max_ms", "gauge", "Slowest journal sync this session");
+    line(out, "caretaker_wal_sync_max_ms %.3f\n", wal_sync_max_ms.load(r));
+    return out;
+}
+
+//one request per connection, the response is rendered from the published atomics
+class MetricsSession : public std::enable_shared_from_this<MetricsSession> {
+public:
+    MetricsSession(asio::ip::tcp::socket socket, const Metrics& metrics)
+        : socket(std::move(socket)), request(MAX_REQUEST), metrics(metrics) {}
+    void start() {
+        auto self = shared_from_this();
+        asio::async_read_until(socket, request, "\r\n\r\n", [this, self](const asio::error_code& ec, size_t) {
+            if (ec) return;
+            std::istream in(&request);
+            std::string method, target;
+            in >> method >> target;
+            if (method != "GET")
+                respond("405 Method Not Allowed", "text/plain", "GET only\n");
+            else if (target == "/metrics")
+                respond("200 OK", "text/plain; version=0.0.4", metrics.render());
+            else
+                respond("404 Not Found", "text/plain", "try /metrics\n");
+        });
+    }
+private:
+    static const size_t MAX_REQUEST = 8192;
+    void respond(const char* status, const char* type, const std::string& body) {
+        response = std::string("HTTP/1.0 ") + status + "\r\nContent-Type: " + type + "\r\nContent-Length: "
+            + std::to_string(body.size()) + "\r\nConnection: close\r\n\r\n" + body;
+        auto self = shared_from_this();
+        asio::async_write(socket, asio::buffer(response), [this, self](const asio::error_code&, size_t) {
+            asio::error_code ignored;
+            socket.shutdown(asio::ip::tcp::socket::shutdown_both, ignored);
+        });
+    }
+    asio::ip::tcp::socket socket;
+    asio::streambuf request;
+    std::string response;
+    const Metrics& metrics;
+};
+
+MetricsServer::MetricsServer(asio::io_context& io, const Metrics& metrics) : io(io), metrics(metrics), acceptor(io), retry(io) {
+}
+
+MetricsServer::~MetricsServer() {
+    stop();
+}
+
+void MetricsServer::start(const std::string& address, unsigned short port) {
+    asio::ip::tcp::endpoint endpoint(asio::ip::make_address(address), port);
+    acceptor.open(endpoint.protocol());
+    acceptor.set_option(asio::ip::tcp::acceptor::reuse_address(true));
+    acceptor.bind(endpoint);
+    acceptor.listen();
+    asio::post(io, [this]{accept();});
+}
+
+void MetricsServer::accept() {
+    acceptor.async_accept([this](const asio::error_code& ec, asio::ip::tcp::socket socket) {
+        if (ec == asio::error::operation_aborted || !acceptor.is_open()) return; //stopped
+        if (!ec) {
+            std::make_shared<MetricsSession>(std::move(socket), metrics)->start();
+            accept();
+            return;
+        }
+        //a failed accept, e.g. out of descriptors, loses that client, not the endpoint; waiting
+        //before the next one keeps a lasting error from spinning the io thread
+        retry.expires_after(ACCEPT_RETRY);
+        retry.async_wait([this](const asio::error_code& wait_ec) {
+            if (wait_ec || !acceptor.is_open()) return; //stopped
+            accept();
+        });
+    });
+}
+
+void MetricsServer::stop() {
+    //close on the io thread so it cannot race a pending accept
+    if (!acceptor.is_open()) return;
+    std::promise<void> done;
+    asio::post(io, [this, &done]{
+        asio::error_code ec;
+        acceptor.close(ec);
+        retry.cancel();
+        done.set_value();
+    });
+    done.get_future().wait();
+}
@@ -0,0 +1,58 @@
+#pragma once
+#include <asio.hpp>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+#include "stream_stats.hpp"
+#include "latency_histogram.hpp"
+
+/* Health values published once per second by the main loop. The endpoint only ever reads these
+ * atomics, so a scrape costs the acquisition threads nothing. */
+struct Metrics {
+    static const int QUANTILE_COUNT = 4; //p50, p99, p99.9, max
+
+    std::atomic<int> program_state{0};
+    std::atomic<bool> connected{false};
+    std::atomic<double> samples_per_s[STREAM_COUNT];
+    std::atomic<double> packets_per_s[STREAM_COUNT];
+    std::atomic<double> bytes_per_s[STREAM_COUNT];
+    std::atomic<uint64_t> gaps[STREAM_COUNT];
+    std::atomic<uint64_t> dropped[STREAM_COUNT];
+    std::atomic<double> latency_avg_ms[STREAM_COUNT];
+    std::atomic<double> latency_max_ms[STREAM_COUNT];
+    std::atomic<uint64_t> latency_us[LATENCY_PATH_COUNT][QUANTILE_COUNT];
+    std::atomic<uint64_t> latency_count[LATENCY_PATH_COUNT];
+    std::atomic<uint64_t> wal_queued{0};
+    std::atomic<uint64_t> wal_records{0};
+    std::atomic<double> wal_sync_max_ms{0};
+    std::atomic<uint64_t> store_rows{0};
+    std::atomic<uint64_t> store_bytes{0};
+    std::atomic<uint64_t> epochs_pending{0};
+    std::atomic<uint64_t> epochs_written{0};
+    std::atomic<uint64_t> connection_gaps{0};
+    std::atomic<uint64_t> triggers{0};
+
+    Metrics();
+    void publish_streams(const StreamRates rates[STREAM_COUNT]);
+    void publish_latency();
+    //text exposition format
+    std::string render() const;
+};
+
+//minimal HTTP/1.0 server answering GET /metrics on the shared io thread
+class MetricsServer {
+public:
+    MetricsServer(asio::io_context& io, const Metrics& metrics);
+    ~MetricsServer();
+    //throws std::system_error if the address cannot be bound
+    void start(const std::string& address, unsigned short port);
+    void stop();
+private:
+    void accept();
+    static constexpr std::chrono::milliseconds ACCEPT_RETRY{100}; //after a failed accept
+    asio::io_context& io;
+    const Metrics& metrics;
+    asio::ip::tcp::acceptor acceptor;
+    asio::steady_timer retry;
+};
@@ -0,0 +1,203 @@
+#include "param_pulse.hpp"
+#include "ts_codec.hpp"
+#include "write_ahead_log.hpp"
+#include "trace.hpp"
+#include <algorithm>
+#include <cstring>
+
+static const size_t SEGMENT_HEADER_SIZE = 4 + 4 + 8 + 8;
+
+static void put_le(uint8_t* out, uint64_t v, size_t bytes) {
+    for (size_t i = 0; i < bytes; i++) out[i] = (uint8_t)(v >> (8 * i));
+}
+
+static uint64_t get_le(const uint8_t* in, size_t bytes) {
+    uint64_t v = 0;
+    for (size_t i = 0; i < bytes; i++) v |= (uint64_t)in[i] << (8 * i);
+    return v;
+}
+
+ParamPulseWriter::~ParamPulseWriter() {
+    close();
+}
+
+bool ParamPulseWriter::open(const std::string& filename) {
+    std::lock_guard<std::mutex> lock(mtx);
+    file.open(filename, std::ios::out | std::ios::binary | std::ios::trunc);
+    if (!file.is_open()) return false;
+    file.write("CTPPULS1", 8);
+    bytes_written = 8;
+    if (!segment) {
+        heap_segment.resize(PARAM_PULSE_SEGMENT_BYTES);
+        heap_offsets.resize(PARAM_PULSE_SEGMENT_RECORDS);
+        segment = heap_segment.data();
+        offsets = heap_offsets.data();
+    }
+    return file.good();
+}
+
+void ParamPulseWriter::close() {
+    flush();
+    std::lock_guard<std::mutex> lock(mtx);
+    if (file.is_open()) file.close();
+}
+
+void ParamPulseWriter::flush() {
+    std::lock_guard<std::mutex> lock(mtx);
+    emit();
+    if (file.is_open()) file.flush();
+}
+
+void ParamPulseWriter::place(SessionArena& arena) {
+    std::lock_guard<std::mutex> lock(mtx);
+    emit();
+    uint8_t* s = (uint8_t*)arena.allocate(PARAM_PULSE_SEGMENT_BYTES, 64);
+    uint32_t* o = (uint32_t*)arena.allocate(PARAM_PULSE_SEGMENT_RECORDS * sizeof(uint32_t), alignof(uint32_t));
+    if (!s || !o) return;
+    segment = s;
+    offsets = o;
+    std::vector<uint8_t>().swap(heap_segment);
+    std::vector<uint32_t>().swap(heap_offsets);
+}
+
+void ParamPulseWriter::push(const libct_param_pulse_t* dp, unsigned int n) {
+    std::lock_guard<std::mutex> lock(mtx);
+    if (!segment) return;
+    //the library's own for_each_dp indexes datapoints directly, so this does too
+    for (unsigned int i = 0; i < n; i++)
+        if (dp[i].valid) append(dp[i]);
+}
+
+void ParamPulseWriter::append(const libct_param_pulse_t& dp) {
+    if (used + PARAM_PULSE_MAX_RECORD > PARAM_PULSE_SEGMENT_BYTES || count == PARAM_PULSE_SEGMENT_RECORDS) emit();
+    int64_t ts = (int64_t)dp.timestamp;
+    if (count == 0) {
+        t_base = ts;
+        t_max = ts;
+    }
+    t_max = std::max(t_max, ts);
+    offsets[count++] = (uint32_t)used;
+    uint8_t* p = segment + used;
+    p = put_varint(p, zigzag_encode(ts - t_base));
+    p = put_varint(p, zigzag_encode(dp.t0));
+    p = put_varint(p, zigzag_encode(dp.t1));
+    p = put_varint(p, zigzag_encode(dp.t2));
+    p = put_varint(p, zigzag_encode(dp.t3));
+    p = put_varint(p, zigzag_encode(dp.p0));
+    p = put_varint(p, zigzag_encode(dp.p1));
+    p = put_varint(p, zigzag_encode(dp.p2));
+    p = put_varint(p, zigzag_encode(dp.p3));
+    p = put_varint(p, zigzag_encode(dp.ibi));
+    p = put_varint(p, zigzag_encode(dp.as));
+    p = put_varint(p, zigzag_encode(dp.sqe));
+    p = put_varint(p, zigzag_encode(dp.pressure));
+    int len = std::min(std::max(dp.waveform_len, 0), PARAM_PULSE_MAX_WAVEFORM);
+    p = put_varint(p, (uint64_t)len);
+    memcpy(p, dp.waveform, len);
+    used = (p + len) - segment;
+}
+
+void ParamPulseWriter::emit() {
+    if (count == 0) return;
+    TRACE_SCOPE("param pulse segment");
+    uint8_t head[SEGMENT_HEADER_SIZE];
+    put_le(head, count, 4);
+    put_le(head + 4, used, 4);
+    put_le(head + 8, (uint64_t)t_base, 8);
+    put_le(head + 16, (uint64_t)t_max, 8);
+    //offsets go out little endian in place, they are not needed again once the segment is written
+    for (size_t i = 0; i < count; i++) put_le((uint8_t*)&offsets[i], offsets[i], 4);
+    uint32_t crc = crc32_update(crc32_update(0, (const uint8_t*)offsets, count * 4), segment, used);
+    uint8_t tail[4];
+    put_le(tail, crc, 4);
+    if (file.is_open()) {
+        file.write((const char*)head, sizeof(head));
+        file.write((const char*)offsets, count * 4);
+        file.write((const char*)segment, used);
+        file.write((const char*)tail, sizeof(tail));
+        bytes_written += sizeof(head) + count * 4 + used + sizeof(tail);
+        records_written += count;
+    }
+    count = 0;
+    used = 0;
+}
+
+bool ParamPulseReader::open(const std::string& filename) {
+    file.open(filename, std::ios::in | std::ios::binary);
+    if (!file.is_open()) return false;
+    char magic[8];
+    if (!file.read(magic, 8) || std::string(magic, 8) != "CTPPULS1") return false;
+    index.clear();
+    loaded = SIZE_MAX;
+    uint64_t offset = 8;
+    uint8_t head[SEGMENT_HEADER_SIZE];
+    while (file.seekg(offset), file.read((char*)head, sizeof(head))) {
+        SegmentEntry e;
+        e.offset = offset;
+        e.count = (uint32_t)get_le(head, 4);
+        e.data_bytes = (uint32_t)get_le(head + 4, 4);
+        e.t_base = (int64_t)get_le(head + 8, 8);
+        e.t_max = (int64_t)get_le(head + 16, 8);
+        if (e.count > PARAM_PULSE_SEGMENT_RECORDS || e.data_bytes > PARAM_PULSE_SEGMENT_BYTES) break;
+        index.push_back(e);
+        //a segment only counts once its crc checks out, so a crash mid-write loses just that segment
+        if (!load(index.size() - 1)) {
+            index.pop_back();
+            break;
+        }
+        offset += SEGMENT_HEADER_SIZE + (uint64_t)e.count * 4 + e.data_bytes + 4;
+    }
+    file.clear();
+    return true;
+}
+
+size_t ParamPulseReader::count() const {
+    size_t n = 0;
+    for (auto& e : index) n += e.count;
+    return n;
+}
+
+bool ParamPulseReader::load(size_t segment) {
+    if (segment == loaded) return true;
+    if (segment >= index.size()) return false;
+    const SegmentEntry& e = index[segment];
+    file.clear();
+    file.seekg(e.offset + SEGMENT_HEADER_SIZE);
+    buf.resize((size_t)e.count * 4 + e.data_bytes + 4);
+    if (!file.read((char*)buf.data(), buf.size())) return false;
+    size_t body = buf.size() - 4;
+    if (crc32(buf.data(), body) != (uint32_t)get_le(buf.data() + body, 4)) return false;
+    loaded = segment;
+    return true;
+}
+
+bool ParamPulseReader::read_record(size_t segment, size_t record, ParamPulse& out) {
+    if (!load(segment) || record >= index[segment].count) return false;
+    const SegmentEntry& e = index[segment];
+    const uint8_t* data = buf.data() + (size_t)e.count * 4;
+    const uint8_t* end = data + e.data_bytes;
+    uint32_t at = (uint32_t)get_le(buf.data() + record * 4, 4);
+    if (at >= e.data_bytes) return false;
+    const uint8_t* p = data + at;
+    out.timestamp = e.t_base + zigzag_decode(get_varint(p, end));
+    for (auto& t : out.t) t = (int16_t)zigzag_decode(get_varint(p, end));
+    for (auto& v : out.p) v = (int32_t)zigzag_decode(get_varint(p, end));
+    out.ibi = (int16_t)zigzag_decode(get_varint(p, end));
+    out.as = (int16_t)zigzag_decode(get_varint(p, end));
+    out.sqe = (int16_t)zigzag_decode(get_varint(p, end));
+    out.pressure = (int16_t)zigzag_decode(get_varint(p, end));
+    size_t len = (size_t)get_varint(p, end);
+    if (len > (size_t)(end - p)) return false;
+    out.waveform.assign((const int8_t*)p, (const int8_t*)p + len);
+    return true;
+}
+
+bool ParamPulseReader::read_segment(size_t segment, std::vector<ParamPulse>& out) {
+    if (!load(segment)) return false;
+    for (size_t i = 0; i < index[segment].count; i++) {
+        ParamPulse r;
+        if (!read_record(segment, i, r)) return false;
+        out.push_back(std::move(r));
+    }
+    return true;
+}
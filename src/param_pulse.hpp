@@ -0,0 +1,85 @@
+#pragma once
+#include <caretaker_static.h>
+#include <atomic>
+#include <cstdint>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "session_arena.hpp"
+
+//one parameterised pulse: the decomposition of a beat plus its snapshot waveform
+struct ParamPulse {
+    int64_t timestamp = 0;
+    int16_t t[4] = {};   //onset and three peak indices
+    int32_t p[4] = {};   //integrated values at those indices
+    int16_t ibi = 0;
+    int16_t as = 0;
+    int16_t sqe = 0;
+    int16_t pressure = 0;
+    std::vector<int8_t> waveform;
+};
+
+const size_t PARAM_PULSE_SEGMENT_BYTES = 64 * 1024;
+const int PARAM_PULSE_MAX_WAVEFORM = 4096;             //longer snapshots are cut to this
+const size_t PARAM_PULSE_MAX_RECORD = 80 + PARAM_PULSE_MAX_WAVEFORM;
+const size_t PARAM_PULSE_SEGMENT_RECORDS = PARAM_PULSE_SEGMENT_BYTES / 24; //a record without waveform takes at least 24 bytes
+
+/* Param pulse capture (<session>.ppulse). Each record is copied on arrival into a bump allocated
+ * segment with a table of record offsets; a full segment is written out whole and the bump reset.
+ * File layout: "CTPPULS1", then segments of
+ *   uint32 count, uint32 data_bytes, int64 t_base, int64 t_max, count x uint32 offset, data, uint32 crc32
+ * The crc covers offsets and data. A record is zigzag varints of timestamp - t_base, t0-t3, p0-p3,
+ * ibi, as, sqe, pressure and the waveform length, followed by the waveform bytes. */
+class ParamPulseWriter {
+public:
+    ~ParamPulseWriter();
+    bool open(const std::string& filename);
+    void close();
+    //writes out the current segment
+    void flush();
+    //moves the segment buffers into the arena
+    void place(SessionArena& arena);
+    void push(const libct_param_pulse_t* datapoints, unsigned int count);
+    uint64_t records() const {return records_written;}
+    uint64_t bytes() const {return bytes_written;}
+private:
+    void append(const libct_param_pulse_t& dp);
+    void emit();
+    std::mutex mtx;
+    std::ofstream file;
+    uint8_t* segment = nullptr;
+    uint32_t* offsets = nullptr;
+    size_t used = 0;
+    size_t count = 0;
+    int64_t t_base = 0;
+    int64_t t_max = 0;
+    std::vector<uint8_t> heap_segment; //until place() provides arena memory
+    std::vector<uint32_t> heap_offsets;
+    std::atomic<uint64_t> records_written{0};
+    std::atomic<uint64_t> bytes_written{0};
+};
+
+class ParamPulseReader {
+public:
+    //indexes the segments; a torn last segment is ignored
+    bool open(const std::string& filename);
+    size_t segments() const {return index.size();}
+    size_t count() const;
+    bool read_segment(size_t segment, std::vector<ParamPulse>& out);
+    //one record through the offset table, without decoding its neighbours
+    bool read_record(size_t segment, size_t record, ParamPulse& out);
+private:
+    struct SegmentEntry {
+        uint64_t offset; //of the count field
+        uint32_t count;
+        uint32_t data_bytes;
+        int64_t t_base;
+        int64_t t_max;
+    };
+    bool load(size_t segment);
+    std::ifstream file;
+    std::vector<SegmentEntry> index;
+    std::vector<uint8_t> buf; //offsets and data of the loaded segment
+    size_t loaded = SIZE_MAX;
+};
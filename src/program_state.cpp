@@ -1,4 +1,5 @@
 #include "program_state.hpp"
+#include <cstdio>
 
 
 std::string get_name(PROGRAM_STATE state){
@@ -13,10 +14,94 @@ std::string get_name(PROGRAM_STATE state){
     }
 }
 
-static PROGRAM_STATE system_state = IDLE;
+std::string get_name(PROGRAM_EVENT event){
+    switch(event){
+        case EV_CONNECT: return "connect";
+        case EV_LINK_UP: return "link up";
+        case EV_START: return "start";
+        case EV_STOP: return "stop";
+        case EV_EXIT: return "exit";
+        default:
+            return "unknown";
+    }
+}
+
+static int64_t steady_ms(StateMachine::Clock::time_point t) {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(t.time_since_epoch()).count();
+}
+
+//written only by StateMachine::fire, the release store publishes entered_ms along with the state
+static std::atomic<PROGRAM_STATE> system_state{IDLE};
+static std::atomic<int64_t> state_entered_ms{steady_ms(StateMachine::Clock::now())};
 PROGRAM_STATE get_state(){
-    return system_state;
+    return system_state.load(std::memory_order_acquire);
+}
+int64_t get_state_entered_ms(){
+    return state_entered_ms.load(std::memory_order_acquire);
+}
+
+StateMachine::StateMachine(std::vector<Transition> table, std::function<void(std::string)> log)
+    : table(table), log(log) {
+    records.reserve(HISTORY);
+    state_entered_ms.store(steady_ms(Clock::now()), std::memory_order_relaxed);
+    system_state.store(IDLE, std::memory_order_release);
+}
+
+const StateMachine::Transition* StateMachine::find(PROGRAM_STATE from, PROGRAM_EVENT event) const {
+    //first match wins, so specific rows go above ANY rows
+    for (const Transition& t : table)
+        if (t.event == event && (t.from == from || t.from == ANY)) return &t;
+    return nullptr;
+}
+
+bool StateMachine::accepts(PROGRAM_EVENT event) const {
+    const Transition* t = find(get_state(), event);
+    return t && t->to != get_state();
+}
+
+double StateMachine::ms_in_state() const {
+    return (double)(steady_ms(Clock::now()) - get_state_entered_ms());
+}
+
+std::vector<StateMachine::Record> StateMachine::history() const {
+    std::vector<Record> h;
+    h.reserve(records.size());
+    //next_record is the oldest entry once the ring has wrapped, and 0 before
+    size_t oldest = records.size() < HISTORY ? 0 : next_record;
+    for (size_t i = 0; i < records.size(); i++) h.push_back(records[(oldest + i) % records.size()]);
+    return h;
+}
+
+bool StateMachine::fire(PROGRAM_EVENT event) {
+    PROGRAM_STATE from = get_state();
+    const Transition* t = find(from, event);
+    //a self transition would rerun exit/entry for nothing, e.g. stop while already idle
+    if (!t || t->to == from) return false;
+    Clock::time_point start = Clock::now();
+    if (t->guard && !t->guard()) return false;
+    if (exit[from]) exit[from]();
+    Clock::time_point changed = Clock::now();
+    int64_t entered = get_state_entered_ms();
+    state_entered_ms.store(steady_ms(changed), std::memory_order_relaxed);
+    system_state.store(t->to, std::memory_order_release);
+    if (entry[t->to]) entry[t->to]();
+
+    Record r;
+    r.from = from;
+    r.to = t->to;
+    r.event = event;
+    r.at_ms = steady_ms(changed);
+    r.in_state_ms = (double)(r.at_ms - entered);
+    r.took_us = std::chrono::duration<double, std::micro>(Clock::now() - start).count();
+    if (records.size() < HISTORY) records.push_back(r);
+    else records[next_record] = r;
+    next_record = (next_record + 1) % HISTORY;
+    if (transition) transition(r);
+    if (log) {
+        char buf[160];
+        snprintf(buf, sizeof(buf), "Moving state %s to %s on %s after %.0f ms (transition %.0f us)",
+            get_name(from).c_str(), get_name(t->to).c_str(), get_name(event).c_str(), r.in_state_ms, r.took_us);
+        log(buf);
+    }
+    return true;
 }
-void set_state(PROGRAM_STATE state) {
-    system_state = state;
-}
\ No newline at end of file
@@ -1,13 +1,80 @@
 #pragma once
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
 #include <string>
+#include <vector>
 
 enum PROGRAM_STATE {
     IDLE,
     CONNECTING_CARETAKER,
     CONNECTED,
     RUNNING,
-    QUIT
+    QUIT,
+    STATE_COUNT
+};
+enum PROGRAM_EVENT {
+    EV_CONNECT,       //operator asked to connect the trigger box and caretaker
+    EV_LINK_UP,       //caretaker reported a connection
+    EV_START,         //operator started the readings
+    EV_STOP,          //operator stopped, everything is torn down
+    EV_EXIT,          //window closed
+    EVENT_COUNT
 };
 std::string get_name(PROGRAM_STATE state);
+std::string get_name(PROGRAM_EVENT event);
+//safe from any thread, the gui and metrics read it while the main loop moves it
 PROGRAM_STATE get_state();
-void set_state(PROGRAM_STATE state);
\ No newline at end of file
+//steady time in ms at which the current state was entered
+int64_t get_state_entered_ms();
+
+/* Table-driven program state machine. Only the thread calling fire() changes the state; every
+ * other thread just loads it. A transition runs guard -> exit(from) -> entry(to), and a guard
+ * returning false leaves the state untouched, so a half-failed connect stays in IDLE. Each
+ * transition is timed and reported through the log hook together with how long the old state
+ * lasted, and handed to the on_transition hook to be journalled. */
+class StateMachine {
+public:
+    typedef std::chrono::steady_clock Clock;
+    typedef std::function<bool()> Guard;
+    typedef std::function<void()> Action;
+    struct Transition {
+        int from;             //a PROGRAM_STATE or ANY
+        PROGRAM_EVENT event;
+        PROGRAM_STATE to;
+        Guard guard;
+    };
+    struct Record {
+        PROGRAM_STATE from;
+        PROGRAM_STATE to;
+        PROGRAM_EVENT event;
+        int64_t at_ms;        //steady ms of the transition
+        double in_state_ms;   //time spent in from
+        double took_us;       //guard and actions
+    };
+    static const int ANY = -1;
+    static constexpr size_t HISTORY = 64;
+
+    StateMachine(std::vector<Transition> table, std::function<void(std::string)> log);
+    void on_entry(PROGRAM_STATE state, Action action) {entry[state] = action;}
+    void on_exit(PROGRAM_STATE state, Action action) {exit[state] = action;}
+    void on_transition(std::function<void(const Record&)> hook) {transition = hook;}
+    //false if no transition matches or its guard refused
+    bool fire(PROGRAM_EVENT event);
+    //whether event has a transition from the current state, without running it
+    bool accepts(PROGRAM_EVENT event) const;
+    PROGRAM_STATE state() const {return get_state();}
+    double ms_in_state() const;
+    //most recent last, bounded to HISTORY entries
+    std::vector<Record> history() const;
+private:
+    const Transition* find(PROGRAM_STATE from, PROGRAM_EVENT event) const;
+    std::vector<Transition> table;
+    std::function<void(std::string)> log;
+    Action entry[STATE_COUNT];
+    Action exit[STATE_COUNT];
+    std::function<void(const Record&)> transition;
+    std::vector<Record> records; //a ring once HISTORY entries are in
+    size_t next_record = 0;
+};
@@ -0,0 +1,100 @@
+#include "session_arena.hpp"
+#include "session_store.hpp"
+#include "param_pulse.hpp"
+#include <algorithm>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+static size_t page_size() {
+#ifdef _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return info.dwPageSize;
+#else
+    return (size_t)sysconf(_SC_PAGESIZE);
+#endif
+}
+
+bool SessionArena::reserve(size_t bytes, bool lock_pages) {
+    release();
+    size_t page = page_size();
+    bytes = (bytes + page - 1) / page * page;
+#ifdef _WIN32
+    void* p = VirtualAlloc(nullptr, bytes, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+    if (!p) return false;
+#else
+    void* p = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED) return false;
+#endif
+    base = (char*)p;
+    cap = bytes;
+    offset.store(0, std::memory_order_relaxed);
+    //one write per page takes every fault now instead of during the recording
+    for (size_t i = 0; i < cap; i += page) ((volatile char*)base)[i] = 0;
+    if (lock_pages) {
+#ifdef _WIN32
+        //VirtualLock is limited by the minimum working set, which has to grow first
+        SIZE_T min_ws, max_ws;
+        if (GetProcessWorkingSetSize(GetCurrentProcess(), &min_ws, &max_ws))
+            SetProcessWorkingSetSize(GetCurrentProcess(), min_ws + cap, max_ws + cap);
+        is_locked = VirtualLock(base, cap) != 0;
+#else
+        is_locked = mlock(base, cap) == 0;
+#endif
+    }
+    return true;
+}
+
+void SessionArena::release() {
+    if (!base) return;
+#ifdef _WIN32
+    if (is_locked) VirtualUnlock(base, cap);
+    VirtualFree(base, 0, MEM_RELEASE);
+#else
+    if (is_locked) munlock(base, cap);
+    munmap(base, cap);
+#endif
+    base = nullptr;
+    cap = 0;
+    is_locked = false;
+    offset.store(0, std::memory_order_relaxed);
+}
+
+void* SessionArena::allocate(size_t size, size_t align) {
+    if (!base) return nullptr;
+    size_t cur = offset.load(std::memory_order_relaxed);
+    for (;;) {
+        size_t start = (cur + align - 1) & ~(align - 1);
+        if (start + size > cap) return nullptr;
+        if (offset.compare_exchange_weak(cur, start + size, std::memory_order_relaxed)) return base + start;
+    }
+}
+
+//every stop flushes partial chunks, so each start/stop cycle can add one per channel
+static const size_t FLUSH_CHUNKS = 64;
+static const size_t CSV_ROW_BYTES = 128;
+static const size_t CSV_ROWS = 16;
+
+SessionBudget::SessionBudget(int expected_minutes) : minutes(std::max(expected_minutes, 1)) {
+    store_chunks = 0;
+    //the table's nominal rates are on the high side, so a normal recording stays inside its budget
+    for (int s = 0; s < STREAM_COUNT; s++) {
+        const StreamDesc& d = stream_desc(s);
+        uint64_t rows = (uint64_t)minutes * 60 * d.nominal_hz;
+        uint32_t chunk_rows = d.chunk_rows;
+        store_chunks += (size_t)((rows + chunk_rows - 1) / chunk_rows) + FLUSH_CHUNKS;
+    }
+    //the flusher drains at least once a second, 4096 rows is far more than triggers produce in that time
+    wal_records = 4096;
+    csv_bytes = CSV_ROW_BYTES * CSV_ROWS;
+    param_pulse_bytes = PARAM_PULSE_SEGMENT_BYTES + PARAM_PULSE_SEGMENT_RECORDS * sizeof(uint32_t) + 64;
+}
+
+size_t SessionBudget::arena_bytes() const {
+    //the index is reserved once, with room left for one doubling should a session outrun its budget
+    return 3 * store_chunks * sizeof(ChunkIndexEntry) + csv_bytes + param_pulse_bytes + 64 * 1024;
+}
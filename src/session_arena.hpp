@@ -0,0 +1,100 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <type_traits>
+#include <vector>
+
+/* One block of memory per session, reserved at Start, touched page by page so the recording never
+ * takes a first-touch fault on it, and optionally locked into RAM. allocate() is a lock-free bump
+ * and nothing is freed individually; the whole block goes with release(). */
+class SessionArena {
+public:
+    SessionArena() {}
+    ~SessionArena() {release();}
+    SessionArena(const SessionArena&) = delete;
+    SessionArena& operator=(const SessionArena&) = delete;
+
+    //false if the block could not be reserved; a failed lock still reserves, see locked()
+    bool reserve(size_t bytes, bool lock_pages);
+    void release();
+    //nullptr once the block is exhausted
+    void* allocate(size_t size, size_t align = alignof(std::max_align_t));
+    bool owns(const void* p) const {return base && (const char*)p >= base && (const char*)p < base + cap;}
+    const char* data() const {return base;}
+
+    size_t capacity() const {return cap;}
+    size_t used() const {return offset.load(std::memory_order_relaxed);}
+    bool locked() const {return is_locked;}
+    //allocations that did not fit and went to the heap instead
+    uint64_t fallbacks() const {return heap_fallbacks.load(std::memory_order_relaxed);}
+    void count_fallback() {heap_fallbacks.fetch_add(1, std::memory_order_relaxed);}
+private:
+    char* base = nullptr;
+    size_t cap = 0;
+    bool is_locked = false;
+    std::atomic<size_t> offset{0};
+    std::atomic<uint64_t> heap_fallbacks{0};
+};
+
+/* Places a container in the arena. The allocator binds to the block reserved when it is made, so
+ * before reserve() or once the block is full, allocations go to the heap. deallocate() tells the two
+ * apart by the bound address range alone and never touches the arena, so a container may outlive
+ * it: the arena memory is simply gone with the block. */
+template<typename T>
+class ArenaAllocator {
+public:
+    typedef T value_type;
+    typedef std::true_type propagate_on_container_move_assignment;
+    typedef std::true_type propagate_on_container_swap;
+
+    ArenaAllocator(SessionArena* arena = nullptr)
+        : arena(arena), base(arena ? arena->data() : nullptr), cap(arena ? arena->capacity() : 0) {}
+    template<typename U>
+    ArenaAllocator(const ArenaAllocator<U>& o) : arena(o.arena), base(o.base), cap(o.cap) {}
+
+    T* allocate(size_t n) {
+        //a block reserved after this allocator was made is not one it can recognise
+        if (base && arena->data() == base) {
+            if (void* p = arena->allocate(n * sizeof(T), alignof(T))) return (T*)p;
+            arena->count_fallback();
+        }
+        return (T*)::operator new(n * sizeof(T));
+    }
+    void deallocate(T* p, size_t) {
+        if (!in_block(p)) ::operator delete(p);
+    }
+    bool in_block(const void* p) const {return base && (const char*)p >= base && (const char*)p < base + cap;}
+    template<typename U>
+    bool operator==(const ArenaAllocator<U>& o) const {return arena == o.arena && base == o.base;}
+    template<typename U>
+    bool operator!=(const ArenaAllocator<U>& o) const {return !(*this == o);}
+
+    SessionArena* arena;
+    const char* base;
+    size_t cap;
+};
+template<typename T>
+using ArenaVector = std::vector<T, ArenaAllocator<T>>;
+
+//grows capacity to n and writes every new element once, so the pages are resident before they are needed
+template<typename T, typename A>
+void prefault_reserve(std::vector<T, A>& v, size_t n) {
+    size_t size = v.size();
+    if (n <= size) return;
+    v.resize(n);
+    v.resize(size);
+}
+
+/* Memory a recording of the expected length needs, from the nominal stream rates. Only what grows
+ * with the session is budgeted; the per-sample buffers are fixed sizes already. */
+struct SessionBudget {
+    explicit SessionBudget(int expected_minutes);
+    int minutes;
+    size_t store_chunks;  //chunk index entries across all channels
+    size_t wal_records;   //journal records queued between two flushes
+    size_t csv_bytes;     //one trigger's rows, formatted before the single write
+    size_t param_pulse_bytes; //the param pulse segment and its offset table
+    size_t arena_bytes() const;
+};
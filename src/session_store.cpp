@@ -0,0 +1,287 @@
+#include "session_store.hpp"
+#include "trace.hpp"
+#include <algorithm>
+#include <array>
+#include <cstdio>
+
+//one channel per stream of the stream table, columns in table order
+static const std::array<ChannelLayout, STREAM_COUNT> layouts = []{
+    std::array<ChannelLayout, STREAM_COUNT> out = {};
+    for (int s = 0; s < STREAM_COUNT; s++) {
+        const StreamDesc& d = stream_desc(s);
+        out[s] = {d.channel, d.member, d.int_fields, d.float_fields, {}, d.chunk_rows, (STREAM_ID)s};
+        for (int f = 0; f < d.field_count; f++) out[s].columns[f] = field_desc(d.first_field + f).column;
+    }
+    return out;
+}();
+
+const ChannelLayout* channel_layout(int channel) {
+    for (auto& l : layouts)
+        if (l.channel == channel) return &l;
+    return nullptr;
+}
+
+SessionStoreWriter::SessionStoreWriter() {
+    for (auto& l : layouts) encoders.emplace_back(l.channel, l.int_columns, l.float_columns);
+}
+
+SessionStoreWriter::~SessionStoreWriter() {
+    close();
+}
+
+bool SessionStoreWriter::open(const std::string& filename) {
+    std::lock_guard<std::mutex> lock(mtx);
+    file.open(filename, std::ios::out | std::ios::binary | std::ios::trunc);
+    if (!file.is_open()) return false;
+    file.write("CTSTORE1", 8);
+    bytes_written = 8;
+    std::fill(have_last, have_last + STREAM_COUNT, false);
+    return file.good();
+}
+
+template<typename T>
+static void put_le(std::vector<uint8_t>& out, T v) {
+    for (size_t i = 0; i < sizeof(T); i++) out.push_back((uint8_t)((uint64_t)v >> (8 * i)));
+}
+
+template<typename T>
+static T get_le(const uint8_t*& p) {
+    uint64_t v = 0;
+    for (size_t i = 0; i < sizeof(T); i++) v |= (uint64_t)(*p++) << (8 * i);
+    return (T)v;
+}
+
+void SessionStoreWriter::close() {
+    flush();
+    std::lock_guard<std::mutex> lock(mtx);
+    if (!file.is_open()) return;
+    out.clear();
+    for (auto& e : index) {
+        out.push_back(e.channel);
+        put_le<uint32_t>(out, e.rows);
+        put_le<int64_t>(out, e.t_min);
+        put_le<int64_t>(out, e.t_max);
+        put_le<uint64_t>(out, e.offset);
+    }
+    put_le<uint32_t>(out, (uint32_t)index.size());
+    put_le<uint64_t>(out, bytes_written);
+    out.insert(out.end(), {'C','T','I','N','D','E','X','1'});
+    file.write((const char*)out.data(), out.size());
+    file.close();
+    index.clear();
+}
+
+void SessionStoreWriter::flush() {
+    std::lock_guard<std::mutex> lock(mtx);
+    for (auto& enc : encoders) emit(enc);
+    if (file.is_open()) file.flush();
+}
+
+void SessionStoreWriter::emit(ChunkEncoder& enc) {
+    if (enc.rows() == 0) return;
+    TRACE_SCOPE("store chunk");
+    rows_written += enc.rows();
+    const ChunkHeader& h = enc.current();
+    ChunkIndexEntry entry = {h.channel, h.count, h.t_min, h.t_max, bytes_written};
+    out.clear();
+    enc.finish(out);
+    if (!file.is_open()) return;
+    file.write((const char*)out.data(), out.size());
+    bytes_written += out.size();
+    index.push_back(entry);
+}
+
+void SessionStoreWriter::reserve(SessionArena& arena, const SessionBudget& budget) {
+    std::lock_guard<std::mutex> lock(mtx);
+    ArenaVector<ChunkIndexEntry> placed{ArenaAllocator<ChunkIndexEntry>(&arena)};
+    placed.reserve(index.size() + budget.store_chunks);
+    placed.insert(placed.end(), index.begin(), index.end());
+    index.swap(placed);
+    size_t largest = 0;
+    for (auto& l : layouts) largest = std::max(largest, (size_t)l.chunk_rows * (1 + l.int_columns + l.float_columns) * 6);
+    prefault_reserve(out, CHUNK_HEADER_SIZE + largest);
+    for (int s = 0; s < STREAM_COUNT; s++) encoders[s].reserve(layouts[s].chunk_rows);
+}
+
+static bool same_values(const ChannelLayout& l, const StreamRow& a, const StreamRow& b) {
+    return std::equal(a.ints, a.ints + l.int_columns, b.ints) && std::equal(a.floats, a.floats + l.float_columns, b.floats);
+}
+
+void SessionStoreWriter::add(STREAM_ID stream, const StreamRow& row) {
+    //a change-only stream keeps just the rows that start a new state, a state lasts until the next row
+    if (stream_desc(stream).changes_only) {
+        if (have_last[stream] && same_values(layouts[stream], last_stored[stream], row)) return;
+        last_stored[stream] = row;
+        have_last[stream] = true;
+    }
+    ChunkEncoder& enc = encoders[stream];
+    enc.add_row(row.timestamp, row.ints, row.floats);
+    if (enc.rows() >= layouts[stream].chunk_rows) emit(enc);
+}
+
+void SessionStoreWriter::push(STREAM_ID stream, const StreamRow& row) {
+    std::lock_guard<std::mutex> lock(mtx);
+    add(stream, row);
+}
+
+struct SessionStoreWriter::StoreSink {
+    SessionStoreWriter* writer;
+    void row(STREAM_ID stream, const StreamRow& row) {writer->add(stream, row);}
+    void packet(STREAM_ID, const StreamPacket&) {}
+};
+
+void SessionStoreWriter::push(const libct_stream_data_t* data) {
+    std::lock_guard<std::mutex> lock(mtx);
+    StoreSink sink{this};
+    ingest_streams(data, sink);
+}
+
+bool SessionReader::open(const std::string& filename) {
+    file.open(filename, std::ios::in | std::ios::binary);
+    if (!file.is_open()) return false;
+    char magic[8];
+    if (!file.read(magic, 8) || std::string(magic, 8) != "CTSTORE1") return false;
+    file.seekg(0, std::ios::end);
+    file_size = (uint64_t)file.tellg();
+    index.clear();
+    if (!read_footer()) scan_chunks();
+    for (auto& c : by_channel) {
+        c.entries.clear();
+        c.max_t_max.clear();
+    }
+    for (auto& e : index) by_channel[e.channel].entries.push_back(e);
+    for (auto& c : by_channel) {
+        std::stable_sort(c.entries.begin(), c.entries.end(), [](const ChunkIndexEntry& a, const ChunkIndexEntry& b){return a.t_min < b.t_min;});
+        int64_t running = INT64_MIN;
+        for (auto& e : c.entries) {
+            running = std::max(running, e.t_max);
+            c.max_t_max.push_back(running);
+        }
+    }
+    return true;
+}
+
+bool SessionReader::read_footer() {
+    if (file_size < 8 + 12 + 8) return false;
+    uint8_t tail[20];
+    file.seekg(file_size - sizeof(tail));
+    if (!file.read((char*)tail, sizeof(tail)) || std::string((char*)tail + 12, 8) != "CTINDEX1") return false;
+    const uint8_t* p = tail;
+    uint32_t count = get_le<uint32_t>(p);
+    uint64_t offset = get_le<uint64_t>(p);
+    if (offset + (uint64_t)count * INDEX_ENTRY_SIZE + sizeof(tail) != file_size) return false;
+    buf.resize(count * INDEX_ENTRY_SIZE);
+    file.seekg(offset);
+    if (!file.read((char*)buf.data(), buf.size())) return false;
+    p = buf.data();
+    for (uint32_t i = 0; i < count; i++) {
+        ChunkIndexEntry e;
+        e.channel = *p++;
+        e.rows = get_le<uint32_t>(p);
+        e.t_min = get_le<int64_t>(p);
+        e.t_max = get_le<int64_t>(p);
+        e.offset = get_le<uint64_t>(p);
+        index.push_back(e);
+    }
+    return true;
+}
+
+void SessionReader::scan_chunks() {
+    file.clear();
+    uint64_t offset = 8;
+    uint8_t head[CHUNK_HEADER_SIZE];
+    while (offset + CHUNK_HEADER_SIZE <= file_size) {
+        file.seekg(offset);
+        if (!file.read((char*)head, CHUNK_HEADER_SIZE)) break;
+        ChunkHeader h;
+        ChunkDecoder::read_header(head, CHUNK_HEADER_SIZE, h);
+        uint64_t size = CHUNK_HEADER_SIZE + (uint64_t)h.varint_bytes + h.float_bytes;
+        if (!channel_layout(h.channel) || offset + size > file_size) break; //torn tail
+        index.push_back({h.channel, h.count, h.t_min, h.t_max, offset});
+        offset += size;
+    }
+    file.clear();
+}
+
+bool SessionReader::decode_chunk(const ChunkIndexEntry& e, int64_t t0, int64_t t1, std::vector<StoredRow>& rows) {
+    file.clear();
+    file.seekg(e.offset);
+    buf.resize(CHUNK_HEADER_SIZE);
+    if (!file.read((char*)buf.data(), CHUNK_HEADER_SIZE)) return false;
+    ChunkHeader h;
+    ChunkDecoder::read_header(buf.data(), CHUNK_HEADER_SIZE, h);
+    buf.resize(CHUNK_HEADER_SIZE + h.varint_bytes + h.float_bytes);
+    if (!file.read((char*)buf.data() + CHUNK_HEADER_SIZE, buf.size() - CHUNK_HEADER_SIZE)) return false;
+    decoded++;
+    int ni = std::min<int>(h.int_columns, 8), nf = std::min<int>(h.float_columns, 8);
+    return ChunkDecoder::decode(buf.data(), buf.size(), [&](int64_t ts, const int64_t* ints, const float* floats) {
+        if (ts < t0 || ts > t1) return;
+        StoredRow r = {};
+        r.timestamp = ts;
+        std::copy(ints, ints + ni, r.ints);
+        std::copy(floats, floats + nf, r.floats);
+        rows.push_back(r);
+    });
+}
+
+SessionReader::Range SessionReader::query(int channel, int64_t t0, int64_t t1) {
+    ChannelIndex& c = by_channel[channel & 0xff];
+    size_t first = std::lower_bound(c.max_t_max.begin(), c.max_t_max.end(), t0) - c.max_t_max.begin();
+    return Range{this, channel & 0xff, first, t0, t1};
+}
+
+SessionReader::Iterator::Iterator(SessionReader* reader, int channel, size_t chunk, int64_t t0, int64_t t1)
+    : reader(reader), channel(channel), chunk(chunk), t0(t0), t1(t1) {
+    if (reader) load();
+}
+
+void SessionReader::Iterator::load() {
+    auto& entries = reader->by_channel[channel].entries;
+    rows.clear();
+    pos = 0;
+    while (rows.empty()) {
+        if (chunk >= entries.size() || entries[chunk].t_min > t1) {
+            reader = nullptr;
+            return;
+        }
+        const ChunkIndexEntry& e = entries[chunk++];
+        if (e.t_max >= t0) reader->decode_chunk(e, t0, t1, rows);
+    }
+}
+
+SessionReader::Iterator& SessionReader::Iterator::operator++() {
+    if (++pos >= rows.size()) load();
+    return *this;
+}
+
+int export_session_csv(const std::string& filename, std::function<void(std::string)> log) {
+    SessionReader reader;
+    if (!reader.open(filename)) {
+        log("Could not read session store " + filename);
+        return -1;
+    }
+    std::string base = filename.size() > 4 && filename.compare(filename.size() - 4, 4, ".cts") == 0 ? filename.substr(0, filename.size() - 4) : filename;
+    int files = 0;
+    for (auto& l : layouts) {
+        if (reader.chunk_index(l.channel).empty()) continue;
+        std::string path = base + "." + l.name + ".csv";
+        FILE* f = fopen(path.c_str(), "wb");
+        if (!f) {
+            log("Could not create " + path);
+            continue;
+        }
+        fputs(stream_csv_header(l.stream).c_str(), f);
+        size_t rows = 0;
+        for (auto& row : reader.query(l.channel, INT64_MIN, INT64_MAX)) {
+            fprintf(f, "\n%lld", (long long)row.timestamp);
+            for (int i = 0; i < l.int_columns; i++) fprintf(f, ",%lld", (long long)row.ints[i]);
+            for (int i = 0; i < l.float_columns; i++) fprintf(f, ",%.9g", row.floats[i]);
+            rows++;
+        }
+        fputc('\n', f);
+        fclose(f);
+        log("Exported " + std::to_string(rows) + " " + stream_name(l.stream) + " rows to " + path);
+        files++;
+    }
+    return files;
+}
@@ -0,0 +1,126 @@
+#pragma once
+#include <caretaker_static.h>
+#include "ts_codec.hpp"
+#include "session_arena.hpp"
+#include "stream_table.hpp"
+#include <string>
+#include <fstream>
+#include <mutex>
+#include <atomic>
+#include <vector>
+#include <functional>
+
+//column layout of each stored channel, int columns first then float columns; generated from the stream table
+struct ChannelLayout {
+    STREAM_CHANNEL channel;
+    const char* name;
+    int int_columns;
+    int float_columns;
+    const char* columns[STREAM_MAX_FIELDS];
+    uint32_t chunk_rows;
+    STREAM_ID stream;
+};
+const ChannelLayout* channel_layout(int channel);
+
+struct ChunkIndexEntry {
+    uint8_t channel;
+    uint32_t rows;
+    int64_t t_min;
+    int64_t t_max;
+    uint64_t offset;
+};
+const size_t INDEX_ENTRY_SIZE = 1 + 4 + 8 + 8 + 8;
+
+/* Compressed per-session store (<session>.cts).
+ * File layout: "CTSTORE1", serialised chunks in arrival order, then on close an index footer of
+ * ChunkIndexEntry records followed by uint32 entry count, uint64 footer offset and "CTINDEX1".
+ * A file without footer (crashed session) is still readable, the reader rebuilds the index by scanning. */
+class SessionStoreWriter {
+public:
+    SessionStoreWriter();
+    ~SessionStoreWriter();
+    bool open(const std::string& filename);
+    void close();
+    //writes out every partially filled chunk
+    void flush();
+    //every valid row of every stream in the packet; of param pulses only the decomposition columns,
+    //the waveforms go to ParamPulseWriter
+    void push(const libct_stream_data_t* data);
+    void push(STREAM_ID stream, const StreamRow& row);
+    //moves the chunk index into the arena sized for the session and presizes the chunk buffers
+    void reserve(SessionArena& arena, const SessionBudget& budget);
+    uint64_t bytes() const {return bytes_written;}
+    uint64_t rows() const {return rows_written;}
+private:
+    struct StoreSink;
+    void add(STREAM_ID stream, const StreamRow& row);
+    void emit(ChunkEncoder& enc);
+    std::mutex mtx;
+    std::ofstream file;
+    std::vector<ChunkEncoder> encoders; //by STREAM_ID
+    StreamRow last_stored[STREAM_COUNT]; //for streams that store changes only
+    bool have_last[STREAM_COUNT] = {};
+    std::vector<uint8_t> out;
+    ArenaVector<ChunkIndexEntry> index;
+    std::atomic<uint64_t> bytes_written{0};
+    std::atomic<uint64_t> rows_written{0};
+};
+
+struct StoredRow {
+    int64_t timestamp;
+    int64_t ints[8];
+    float floats[8];
+};
+
+class SessionReader {
+public:
+    bool open(const std::string& filename);
+    size_t chunks() const {return index.size();}
+    size_t chunks_decoded() const {return decoded;}
+    const std::vector<ChunkIndexEntry>& chunk_index(int channel) {return by_channel[channel & 0xff].entries;}
+
+    class Iterator {
+    public:
+        Iterator(SessionReader* reader, int channel, size_t chunk, int64_t t0, int64_t t1);
+        const StoredRow& operator*() const {return rows[pos];}
+        const StoredRow* operator->() const {return &rows[pos];}
+        Iterator& operator++();
+        bool operator!=(const Iterator& other) const {return reader != other.reader;}
+    private:
+        void load();
+        SessionReader* reader;
+        int channel;
+        size_t chunk;
+        int64_t t0, t1;
+        std::vector<StoredRow> rows;
+        size_t pos = 0;
+    };
+    struct Range {
+        SessionReader* reader;
+        int channel;
+        size_t first;
+        int64_t t0, t1;
+        Iterator begin() const {return Iterator(reader, channel, first, t0, t1);}
+        Iterator end() const {return Iterator(nullptr, channel, 0, t0, t1);}
+    };
+    //rows of channel with t0 <= timestamp <= t1, decoding only the chunks that overlap the range
+    Range query(int channel, int64_t t0, int64_t t1);
+private:
+    struct ChannelIndex {
+        std::vector<ChunkIndexEntry> entries; //sorted by t_min
+        std::vector<int64_t> max_t_max;       //running maximum of t_max for the binary search
+    };
+    bool read_footer();
+    void scan_chunks();
+    bool decode_chunk(const ChunkIndexEntry& e, int64_t t0, int64_t t1, std::vector<StoredRow>& rows);
+    std::ifstream file;
+    uint64_t file_size = 0;
+    std::vector<ChunkIndexEntry> index;
+    ChannelIndex by_channel[256];
+    std::vector<uint8_t> buf;
+    size_t decoded = 0;
+};
+
+//writes each stored stream of a session to <session>.<stream>.csv, headers from the stream table;
+//returns the number of files written, -1 if the session could not be read
+int export_session_csv(const std::string& filename, std::function<void(std::string)> log);
@@ -0,0 +1,59 @@
+#pragma once
+#include <chrono>
+#include <cstdio>
+#include <future>
+#include <mutex>
+#include <string>
+#include <vector>
+
+//times the startup phases, which may run on several threads at once
+class StartupReport {
+public:
+    typedef std::chrono::steady_clock Clock;
+    StartupReport() : t0(Clock::now()) {}
+
+    Clock::time_point started() const {return t0;}
+    void mark(const std::string& phase, Clock::time_point start, Clock::time_point end) {
+        std::lock_guard<std::mutex> lock(mtx);
+        phases.push_back({phase, start, end});
+    }
+    template <typename F>
+    auto run(const std::string& phase, F fn) -> decltype(fn()) {
+        Timer timer(*this, phase);
+        return fn();
+    }
+    template <typename F>
+    auto run_async(const std::string& phase, F fn) -> std::future<decltype(fn())> {
+        return std::async(std::launch::async, [this, phase, fn]{return run(phase, fn);});
+    }
+    //"Startup ready in 412 ms: gui 0-380 ms, libct init 2-122 ms, ..."
+    std::string summary(Clock::time_point ready) {
+        std::lock_guard<std::mutex> lock(mtx);
+        char buf[96];
+        snprintf(buf, sizeof(buf), "Startup ready in %.0f ms:", ms(ready));
+        std::string out = buf;
+        for (size_t i = 0; i < phases.size(); i++) {
+            snprintf(buf, sizeof(buf), "%s %s %.0f ms (at %.0f)", i ? "," : "", phases[i].name.c_str(),
+                ms(phases[i].end) - ms(phases[i].start), ms(phases[i].start));
+            out += buf;
+        }
+        return out;
+    }
+private:
+    struct Phase {
+        std::string name;
+        Clock::time_point start;
+        Clock::time_point end;
+    };
+    struct Timer {
+        Timer(StartupReport& r, const std::string& phase) : r(r), phase(phase), start(Clock::now()) {}
+        ~Timer() {r.mark(phase, start, Clock::now());}
+        StartupReport& r;
+        std::string phase;
+        Clock::time_point start;
+    };
+    double ms(Clock::time_point t) const {return std::chrono::duration<double, std::milli>(t - t0).count();}
+    Clock::time_point t0;
+    std::mutex mtx;
+    std::vector<Phase> phases;
+};
@@ -0,0 +1,167 @@
+#include "stream_stats.hpp"
+#include <algorithm>
+#include <cstdio>
+
+enum {PREV_PACKETS, PREV_SAMPLES, PREV_BYTES, PREV_GAPS, PREV_LAT_SUM, PREV_LAT_COUNT, PREV_DROPPED, PREV_INTERVALS, PREV_DEVICE_MS, PREV_COUNT};
+
+static long long wall_ms() {
+    using namespace std::chrono;
+    return duration_cast<milliseconds>(system_clock::now().time_since_epoch()).count();
+}
+
+static std::atomic<uint64_t> next_stats_id{1};
+
+StreamStats::StreamStats() : id(next_stats_id++), last_aggregate(std::chrono::steady_clock::now()) {
+    for (int s = 0; s < STREAM_COUNT; s++) gap_threshold_ms[s] = stream_desc(s).gap_threshold_ms;
+}
+
+ThreadStreamCounters& StreamStats::local() {
+    //one block per (stats object, thread); blocks live until the stats object goes away
+    thread_local std::vector<std::pair<uint64_t, ThreadStreamCounters*>> mine;
+    for (auto& m : mine)
+        if (m.first == id) return *m.second;
+    std::lock_guard<std::mutex> lock(registry_mtx);
+    threads.emplace_back(new ThreadStreamCounters());
+    mine.push_back({id, threads.back().get()});
+    return *threads.back();
+}
+
+void StreamStats::record(int stream, uint64_t samples, uint64_t bytes, long long first_ts, long long last_ts, long receive_time) {
+    if (stream < 0 || stream >= STREAM_COUNT || samples == 0) return;
+    StreamCounters& c = local().streams[stream];
+    add(c.packets, 1);
+    add(c.samples, samples);
+    add(c.bytes, bytes);
+
+    //timestamp gaps against the previous packet of this stream
+    if (samples > 1 && last_ts > first_ts) {
+        long long cadence = (last_ts - first_ts) / (long long)(samples - 1);
+        if (cadence > 0 && (c.min_delta == 0 || cadence < c.min_delta)) c.min_delta = cadence;
+    }
+    bool continues = false;
+    if (c.last_ts >= 0 && first_ts > c.last_ts) {
+        long long delta = first_ts - c.last_ts;
+        long long threshold = gap_threshold_ms[stream] > 0 ? gap_threshold_ms[stream] : 2 * c.min_delta;
+        continues = true;
+        if (threshold > 0 && delta > threshold) {
+            add(c.gaps, 1);
+            if (gap_threshold_ms[stream] == 0) add(c.dropped, (uint64_t)(delta / c.min_delta - 1));
+            continues = false;
+        }
+        if (gap_threshold_ms[stream] == 0 && samples == 1 && (c.min_delta == 0 || delta < c.min_delta)) c.min_delta = delta;
+    }
+    //the device rate: a packet that continues the last one adds its samples over the time since it,
+    //any other only the intervals within it
+    if (continues) {
+        add(c.intervals, samples);
+        add(c.device_ms, (uint64_t)(last_ts - c.last_ts));
+    } else if (samples > 1 && last_ts > first_ts) {
+        add(c.intervals, samples - 1);
+        add(c.device_ms, (uint64_t)(last_ts - first_ts));
+    }
+    if (last_ts >= 0) c.last_ts = last_ts;
+
+    //the library's receive clock is not ours, so latency is the excess over the best offset seen so far
+    if (receive_time > 0) {
+        long long offset = wall_ms() - receive_time;
+        if (!c.have_offset || offset < c.min_offset) {
+            c.min_offset = offset;
+            c.have_offset = true;
+        }
+        uint64_t us = (uint64_t)(offset - c.min_offset) * 1000;
+        add(c.latency_sum_us, us);
+        add(c.latency_count, 1);
+        if (us > c.latency_max_us.load(std::memory_order_relaxed)) c.latency_max_us.store(us, std::memory_order_relaxed);
+    }
+}
+
+bool StreamStats::aggregate(double min_interval_s) {
+    auto now = std::chrono::steady_clock::now();
+    double elapsed = std::chrono::duration<double>(now - last_aggregate).count();
+    if (elapsed < min_interval_s || elapsed <= 0) return false;
+    last_aggregate = now;
+
+    uint64_t totals[STREAM_COUNT][PREV_COUNT] = {};
+    uint64_t max_us[STREAM_COUNT] = {};
+    {
+        std::lock_guard<std::mutex> lock(registry_mtx);
+        for (auto& t : threads) {
+            for (int s = 0; s < STREAM_COUNT; s++) {
+                StreamCounters& c = t->streams[s];
+                totals[s][PREV_PACKETS] += c.packets.load(std::memory_order_relaxed);
+                totals[s][PREV_SAMPLES] += c.samples.load(std::memory_order_relaxed);
+                totals[s][PREV_BYTES] += c.bytes.load(std::memory_order_relaxed);
+                totals[s][PREV_GAPS] += c.gaps.load(std::memory_order_relaxed);
+                totals[s][PREV_LAT_SUM] += c.latency_sum_us.load(std::memory_order_relaxed);
+                totals[s][PREV_LAT_COUNT] += c.latency_count.load(std::memory_order_relaxed);
+                totals[s][PREV_DROPPED] += c.dropped.load(std::memory_order_relaxed);
+                totals[s][PREV_INTERVALS] += c.intervals.load(std::memory_order_relaxed);
+                totals[s][PREV_DEVICE_MS] += c.device_ms.load(std::memory_order_relaxed);
+                //the writer only ever raises the max, taking it starts the next window
+                max_us[s] = std::max<uint64_t>(max_us[s], c.latency_max_us.exchange(0, std::memory_order_relaxed));
+            }
+        }
+    }
+    std::lock_guard<std::mutex> lock(snap_mtx);
+    for (int s = 0; s < STREAM_COUNT; s++) {
+        StreamRates& r = rates[s];
+        r.packets_per_s = (totals[s][PREV_PACKETS] - prev[s][PREV_PACKETS]) / elapsed;
+        r.samples_per_s = (totals[s][PREV_SAMPLES] - prev[s][PREV_SAMPLES]) / elapsed;
+        r.bytes_per_s = (totals[s][PREV_BYTES] - prev[s][PREV_BYTES]) / elapsed;
+        r.gaps = totals[s][PREV_GAPS];
+        r.dropped = totals[s][PREV_DROPPED];
+        uint64_t count = totals[s][PREV_LAT_COUNT] - prev[s][PREV_LAT_COUNT];
+        r.latency_avg_ms = count ? (totals[s][PREV_LAT_SUM] - prev[s][PREV_LAT_SUM]) / 1000.0 / count : 0;
+        r.latency_max_ms = max_us[s] / 1000.0;
+        r.device_s = totals[s][PREV_DEVICE_MS] / 1000.0;
+        r.device_hz = r.device_s > 0 ? totals[s][PREV_INTERVALS] / r.device_s : 0;
+        std::copy(totals[s], totals[s] + PREV_COUNT, prev[s]);
+    }
+    return true;
+}
+
+void StreamStats::snapshot(StreamRates out[STREAM_COUNT]) {
+    std::lock_guard<std::mutex> lock(snap_mtx);
+    std::copy(rates, rates + STREAM_COUNT, out);
+}
+
+uint64_t StreamStats::total_gaps() {
+    std::lock_guard<std::mutex> lock(snap_mtx);
+    uint64_t total = 0;
+    for (auto& r : rates) total += r.gaps;
+    return total;
+}
+
+std::string StreamStats::summary() {
+    StreamRates r[STREAM_COUNT];
+    snapshot(r);
+    std::string out = "Streams:";
+    char buf[128];
+    for (int s = 0; s < STREAM_COUNT; s++) {
+        if (r[s].packets_per_s == 0 && r[s].gaps == 0) continue;
+        snprintf(buf, sizeof(buf), " %s %.0f/s %llu gaps %.1f/%.1f ms;", stream_name(s), r[s].samples_per_s,
+            (unsigned long long)r[s].gaps, r[s].latency_avg_ms, r[s].latency_max_ms);
+        out += buf;
+    }
+    if (out.back() == ';') out.pop_back();
+    return out;
+}
+
+bool StreamStats::check_sample_rates(std::string& problem, double tolerance, double min_s) {
+    StreamRates r[STREAM_COUNT];
+    snapshot(r);
+    problem.clear();
+    bool any = false;
+    char buf[128];
+    for (int s = 0; s < STREAM_COUNT; s++) {
+        int hz = stream_desc(s).sample_hz;
+        if (hz == 0 || r[s].device_s == 0) continue;
+        if (r[s].device_s < min_s) return false;
+        any = true;
+        if (r[s].device_hz < hz * (1 - tolerance) || r[s].device_hz > hz * (1 + tolerance)) {
+            snprintf(buf, sizeof(buf), "%s%s runs at %.1f Hz, exports assume %d Hz", problem.empty() ? "" : "; ", stream_name(s), r[s].device_hz, hz);
+            problem += buf;
+        }
+    }
+    return any;
+}
@@ -0,0 +1,77 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "stream_table.hpp"
+
+//counters of one stream written by a single thread, padded so neighbouring streams and threads never share a line
+struct alignas(64) StreamCounters {
+    std::atomic<uint64_t> packets{0};
+    std::atomic<uint64_t> samples{0};
+    std::atomic<uint64_t> bytes{0};
+    std::atomic<uint64_t> gaps{0};
+    std::atomic<uint64_t> dropped{0}; //samples missing from gaps on streams with a learned cadence
+    std::atomic<uint64_t> latency_sum_us{0};
+    std::atomic<uint64_t> latency_count{0};
+    std::atomic<uint64_t> latency_max_us{0};
+    //sample intervals and the device milliseconds they span, gaps left out
+    std::atomic<uint64_t> intervals{0};
+    std::atomic<uint64_t> device_ms{0};
+    //writer-thread only state
+    long long last_ts = -1;
+    long long min_delta = 0;
+    long long min_offset = 0;
+    bool have_offset = false;
+};
+
+struct ThreadStreamCounters {
+    StreamCounters streams[STREAM_COUNT];
+};
+
+struct StreamRates {
+    double packets_per_s = 0;
+    double samples_per_s = 0;
+    double bytes_per_s = 0;
+    uint64_t gaps = 0;
+    uint64_t dropped = 0;
+    double latency_avg_ms = 0;
+    double latency_max_ms = 0;
+    double device_hz = 0; //sample rate by the device timestamps, over the whole recording
+    double device_s = 0;  //device time that rate was measured over
+};
+
+/* Per-stream throughput, timestamp gap and latency accounting.
+ * record() runs on the acquisition threads and only touches that thread's counters with relaxed
+ * single-writer updates; aggregate() folds all threads together once per second. */
+class StreamStats {
+public:
+    StreamStats();
+    //first_ts/last_ts: device timestamps spanned by the packet, receive_time: libct's packet receive stamp (ms)
+    void record(int stream, uint64_t samples, uint64_t bytes, long long first_ts, long long last_ts, long receive_time);
+    //returns true when a new snapshot was produced, at most once per min_interval_s
+    bool aggregate(double min_interval_s = 1.0);
+    void snapshot(StreamRates out[STREAM_COUNT]);
+    std::string summary();
+    uint64_t total_gaps();
+    //compares device_hz of every stream with a table sample_hz against it; false until each one with data
+    //has min_s of it. problem lists the streams off by more than tolerance, empty if they all agree
+    bool check_sample_rates(std::string& problem, double tolerance = 0.02, double min_s = 10);
+
+    //gap thresholds in device milliseconds, 0 means twice the shortest interval seen so far; from the stream table
+    long long gap_threshold_ms[STREAM_COUNT];
+private:
+    ThreadStreamCounters& local();
+    static void add(std::atomic<uint64_t>& c, uint64_t v) {c.store(c.load(std::memory_order_relaxed) + v, std::memory_order_relaxed);}
+
+    const uint64_t id;
+    std::mutex registry_mtx;
+    std::vector<std::unique_ptr<ThreadStreamCounters>> threads;
+    std::mutex snap_mtx;
+    StreamRates rates[STREAM_COUNT];
+    uint64_t prev[STREAM_COUNT][9] = {}; //totals at the last aggregate
+    std::chrono::steady_clock::time_point last_aggregate;
+};
@@ -0,0 +1,107 @@
+#include "stream_table.hpp"
+#include <algorithm>
+#include <array>
+#include <cstdio>
+
+static constexpr std::array<FieldDesc, FIELD_COUNT> make_fields() {
+    std::array<FieldDesc, FIELD_COUNT> fields = {{
+#define FIELD_DESC(id, member, column, kind, label) {STREAM_##id, column, FIELD_##kind, label, 0},
+#define STREAM_FIELDS(id, ...) id##_FIELDS(FIELD_DESC, id)
+        CARETAKER_STREAMS(STREAM_FIELDS)
+#undef STREAM_FIELDS
+#undef FIELD_DESC
+    }};
+    int ints[STREAM_COUNT] = {};
+    int floats[STREAM_COUNT] = {};
+    for (auto& f : fields) f.slot = f.kind == FIELD_INT ? ints[f.stream]++ : floats[f.stream]++;
+    return fields;
+}
+static constexpr std::array<FieldDesc, FIELD_COUNT> FIELDS = make_fields();
+
+static constexpr bool STORE_ALL = false;
+static constexpr bool STORE_CHANGES = true;
+
+static constexpr std::array<StreamDesc, STREAM_COUNT> make_streams() {
+    std::array<StreamDesc, STREAM_COUNT> streams = {{
+#define STREAM_DESC(id, member, Row, flag, config, channel, chunk_rows, store, hz, sample_hz, gap_ms, name) \
+        {name, #member, config, flag, channel, chunk_rows, STORE_##store, hz, sample_hz, gap_ms, 0, 0, 0, 0},
+        CARETAKER_STREAMS(STREAM_DESC)
+#undef STREAM_DESC
+    }};
+    for (int i = FIELD_COUNT - 1; i >= 0; i--) {
+        StreamDesc& s = streams[FIELDS[i].stream];
+        s.first_field = i;
+        s.field_count++;
+        (FIELDS[i].kind == FIELD_INT ? s.int_fields : s.float_fields)++;
+    }
+    return streams;
+}
+static constexpr std::array<StreamDesc, STREAM_COUNT> STREAMS = make_streams();
+
+//the store and the chunk codec take all int columns first
+static constexpr bool ints_before_floats() {
+    for (int i = 1; i < FIELD_COUNT; i++)
+        if (FIELDS[i].stream == FIELDS[i - 1].stream && FIELDS[i].kind == FIELD_INT && FIELDS[i - 1].kind == FIELD_FLOAT) return false;
+    return true;
+}
+static_assert(ints_before_floats(), "a stream lists a FLOAT field before an INT field");
+
+static constexpr bool fits_store() {
+    for (auto& s : STREAMS)
+        if (s.field_count == 0 || s.field_count > STREAM_MAX_FIELDS) return false;
+    return true;
+}
+static_assert(fits_store(), "a stream has no fields or more columns than the store keeps");
+
+const StreamDesc& stream_desc(int stream) {
+    return STREAMS[stream];
+}
+
+const FieldDesc& field_desc(int field) {
+    return FIELDS[field];
+}
+
+const char* stream_name(int stream) {
+    return stream >= 0 && stream < STREAM_COUNT ? STREAMS[stream].name : "?";
+}
+
+std::string stream_csv_header(int stream) {
+    const StreamDesc& s = STREAMS[stream];
+    std::string out = "timestamp";
+    for (int f = s.first_field; f < s.first_field + s.field_count; f++) out += std::string(",") + FIELDS[f].column;
+    return out;
+}
+
+int format_field(int field, const StreamRow& row, char* out, size_t cap) {
+    const FieldDesc& f = FIELDS[field];
+    //the same text std::to_string gives, without the allocation
+    int n = f.kind == FIELD_INT ? snprintf(out, cap, "%lld", (long long)row.ints[f.slot]) : snprintf(out, cap, "%f", row.floats[f.slot]);
+    return n < 0 ? 0 : std::min(n, (int)cap - 1);
+}
+
+void LiveValues::update(STREAM_ID stream, const StreamRow& row) {
+    Slot& s = slots[stream];
+    const StreamDesc& d = STREAMS[stream];
+    uint32_t seq = s.seq.load(std::memory_order_relaxed);
+    s.seq.store(seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    s.timestamp.store(row.timestamp, std::memory_order_relaxed);
+    for (int i = 0; i < d.int_fields; i++) s.ints[i].store(row.ints[i], std::memory_order_relaxed);
+    for (int i = 0; i < d.float_fields; i++) s.floats[i].store(row.floats[i], std::memory_order_relaxed);
+    s.seq.store(seq + 2, std::memory_order_release);
+}
+
+bool LiveValues::read(int stream, StreamRow& out) const {
+    const Slot& s = slots[stream];
+    const StreamDesc& d = STREAMS[stream];
+    for (;;) {
+        uint32_t before = s.seq.load(std::memory_order_acquire);
+        if (before == 0) return false;
+        if (before & 1) continue;
+        out.timestamp = s.timestamp.load(std::memory_order_relaxed);
+        for (int i = 0; i < d.int_fields; i++) out.ints[i] = s.ints[i].load(std::memory_order_relaxed);
+        for (int i = 0; i < d.float_fields; i++) out.floats[i] = s.floats[i].load(std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (s.seq.load(std::memory_order_relaxed) == before) return true;
+    }
+}
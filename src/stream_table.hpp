@@ -0,0 +1,263 @@
+#pragma once
+#include <caretaker_static.h>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include "ts_codec.hpp"
+#include "device_status.hpp"
+
+/* Every libct stream the application captures, described once. Capture, statistics, the session
+ * store layout, the trigger rows, the CSV export and the live display are all generated from this
+ * list, so a new stream is one line here and one field list below.
+ *   X(id, stream_data member, row type, monitor flag, config name, store channel, chunk rows,
+ *     ALL or CHANGES stored, nominal stored rows per s, sample rate Hz, gap threshold ms, display name)
+ * A config name of nullptr means the stream cannot be requested on its own; raw pulse comes with
+ * int pulse, temperature and pulse ox come whenever the device sends them. CHANGES stores a row
+ * only when it differs from the last one stored. The nominal rate is a generous upper bound that
+ * only budgets memory; the sample rate is the device's actual rate for a stream exported as a
+ * regular signal (EDF, BrainVision, LSL) and 0 for the rest. The int pulse rate is libct's
+ * documented 500 Hz, StreamStats checks it against the device timestamps while recording.
+ * A gap threshold of 0 learns the cadence from the data. */
+#define CARETAKER_STREAMS(X) \
+    X(INT_PULSE,      int_pulse,      WaveformSample,         LIBCT_MONITOR_INT_PULSE,       "int_pulse",      CHANNEL_INT_PULSE,      4096,  ALL,      1000,  500,   0,      "int pulse") \
+    X(VITALS,         vitals,         libct_vitals_t,         LIBCT_MONITOR_VITALS,          "vitals",         CHANNEL_VITALS,         256,   ALL,      2,     0,     5000,   "vitals") \
+    X(VITALS2,        vitals2,        libct_vitals2_t,        LIBCT_MONITOR_VITALS2,         "vitals2",        CHANNEL_VITALS2,        256,   ALL,      2,     0,     5000,   "vitals2") \
+    X(CUFF,           cuff_pressure,  libct_cuff_pressure_t,  LIBCT_MONITOR_CUFF_PRESSURE,   "cuff",           CHANNEL_CUFF,           256,   ALL,      50,    0,     2000,   "cuff") \
+    X(DEVICE_STATUS,  device_status,  DeviceStatusRow,        LIBCT_MONITOR_DEVICE_STATUS,   "device_status",  CHANNEL_DEVICE_STATUS,  256,   CHANGES,  1,     0,     5000,   "status") \
+    X(PARAM_PULSE,    param_pulse,    libct_param_pulse_t,    LIBCT_MONITOR_PARAM_PULSE,     "param_pulse",    CHANNEL_PARAM_PULSE,    256,   ALL,      2,     0,     5000,   "param pulse") \
+    X(TEMPERATURE,    temperature,    libct_temperature_t,    0,                             nullptr,          CHANNEL_TEMPERATURE,    256,   ALL,      1,     0,     10000,  "temperature") \
+    X(PULSE_OX,       pulse_ox,       libct_pulse_ox_t,       0,                             nullptr,          CHANNEL_PULSE_OX,       256,   ALL,      1,     0,     10000,  "pulse ox") \
+    X(BATTERY,        battery_info,   libct_battery_info_t,   LIBCT_MONITOR_BATTERY_INFO,    "battery",        CHANNEL_BATTERY,        256,   ALL,      1,     0,     10000,  "battery") \
+    X(RAW_PULSE,      raw_pulse,      WaveformSample,         0,                             nullptr,          CHANNEL_RAW_PULSE,      4096,  ALL,      1000,  0,     0,      "raw pulse") \
+    X(CAL_CURVE,      cal_curve,      libct_cal_curve_t,      LIBCT_MONITOR_CAL_CURVE_DATA,  "cal_curve",      CHANNEL_CAL_CURVE,      256,   ALL,      1,     0,     0,      "cal curve")
+
+/* Exported fields of each stream, F(id, row member, column, INT or FLOAT, trigger label).
+ * Int fields come before float fields, the order the store columns take. Fields with a trigger
+ * label get a row in the trigger CSV; the labels are the ones earlier versions wrote. */
+#define INT_PULSE_FIELDS(F, id) \
+    F(id, sample, "sample", INT, "int pulse")
+#define VITALS_FIELDS(F, id) \
+    F(id, systolic, "systolic", INT, "systolic") \
+    F(id, diastolic, "diastolic", INT, "diastolic") \
+    F(id, map, "map", INT, "map") \
+    F(id, heart_rate, "heart_rate", INT, "heart_rate") \
+    F(id, respiration, "respiration", INT, "respiration") \
+    F(id, as, "as", INT, nullptr) \
+    F(id, sqe, "sqe", INT, nullptr)
+#define VITALS2_FIELDS(F, id) \
+    F(id, blood_volume, "blood_volume", INT, nullptr) \
+    F(id, cardiac_output, "cardiac_output", INT, "cardiac_output") \
+    F(id, ibi, "ibi", INT, nullptr) \
+    F(id, lvet, "lvet", INT, nullptr) \
+    F(id, strokeVolume, "stroke_volume", INT, "stroke_volume") \
+    F(id, p2p1, "p2p1", FLOAT, nullptr) \
+    F(id, pr, "pr", FLOAT, nullptr)
+#define CUFF_FIELDS(F, id) \
+    F(id, target, "target", INT, nullptr) \
+    F(id, snr, "snr", INT, nullptr) \
+    F(id, value, "value", FLOAT, "cuff")
+#define DEVICE_STATUS_FIELDS(F, id) \
+    F(id, word, "word", INT, "status")
+#define PARAM_PULSE_FIELDS(F, id) \
+    F(id, t0, "t0", INT, nullptr) \
+    F(id, t1, "t1", INT, nullptr) \
+    F(id, t2, "t2", INT, nullptr) \
+    F(id, t3, "t3", INT, nullptr) \
+    F(id, p0, "p0", INT, nullptr) \
+    F(id, p1, "p1", INT, nullptr) \
+    F(id, p2, "p2", INT, nullptr) \
+    F(id, p3, "p3", INT, nullptr)
+#define TEMPERATURE_FIELDS(F, id) \
+    F(id, value, "value", FLOAT, "temperature")
+#define PULSE_OX_FIELDS(F, id) \
+    F(id, sao2, "sao2", INT, "sao2") \
+    F(id, pulse_rate, "pulse_rate", INT, "pulse_ox_rate")
+#define BATTERY_FIELDS(F, id) \
+    F(id, voltage, "voltage", INT, "battery_mv")
+#define RAW_PULSE_FIELDS(F, id) \
+    F(id, sample, "sample", INT, nullptr)
+#define CAL_CURVE_FIELDS(F, id) \
+    F(id, data_id, "data_id", INT, nullptr) \
+    F(id, val1, "val1", FLOAT, nullptr) \
+    F(id, val2, "val2", FLOAT, nullptr) \
+    F(id, val3, "val3", FLOAT, nullptr)
+
+enum STREAM_ID {
+#define STREAM_ENUM(id, ...) STREAM_##id,
+    CARETAKER_STREAMS(STREAM_ENUM)
+#undef STREAM_ENUM
+    STREAM_COUNT
+};
+
+enum FIELD_ID {
+#define FIELD_ENUM(id, member, ...) FIELD_##id##_##member,
+#define STREAM_FIELDS(id, ...) id##_FIELDS(FIELD_ENUM, id)
+    CARETAKER_STREAMS(STREAM_FIELDS)
+#undef STREAM_FIELDS
+#undef FIELD_ENUM
+    FIELD_COUNT
+};
+
+enum FIELD_KIND {FIELD_INT, FIELD_FLOAT};
+const int STREAM_MAX_FIELDS = 8; //per stream, as many columns as the store keeps
+
+struct StreamDesc {
+    const char* name;        //display name
+    const char* member;      //libct_stream_data_t member, also the store channel and export name
+    const char* config_name; //monitor list entry, nullptr if not requested separately
+    int monitor_flag;
+    STREAM_CHANNEL channel;
+    uint32_t chunk_rows;
+    bool changes_only;
+    int nominal_hz;          //upper bound for budgeting
+    int sample_hz;           //actual rate of a regularly sampled export, 0 if none
+    long long gap_threshold_ms;
+    int first_field;
+    int field_count;
+    int int_fields;
+    int float_fields;
+};
+struct FieldDesc {
+    STREAM_ID stream;
+    const char* column;
+    FIELD_KIND kind;
+    const char* trigger_label; //nullptr if triggers do not record it
+    int slot;                  //index among the stream's fields of the same kind
+};
+const StreamDesc& stream_desc(int stream);
+const FieldDesc& field_desc(int field);
+const char* stream_name(int stream);
+//"timestamp" and the stream's columns in store order, without a line break
+std::string stream_csv_header(int stream);
+
+//one sample of a waveform stream, so waveforms go through the same path as datapoint streams
+struct WaveformSample {
+    short sample;
+    long long timestamp;
+    bool valid;
+};
+
+//device status as its packed word, see device_status.hpp
+struct DeviceStatusRow {
+    bool valid;
+    long long timestamp;
+    uint64_t word;
+};
+
+//one row of a stream: ints and floats in column order
+struct StreamRow {
+    int64_t timestamp = -1;
+    int64_t ints[STREAM_MAX_FIELDS] = {};
+    float floats[STREAM_MAX_FIELDS] = {};
+};
+//formats a field of row as the trigger CSV writes it, returns the length
+int format_field(int field, const StreamRow& row, char* out, size_t cap);
+
+/* What one packet held for one stream, handed to the sink after its rows. last is the final valid
+ * row, the one live displays and triggers want. */
+struct StreamPacket {
+    size_t rows;
+    size_t bytes;
+    int64_t first_ts;
+    int64_t last_ts;
+    const StreamRow* last;
+};
+
+namespace stream_table {
+template<typename Row>
+int64_t row_time(const Row& r, long) {return (int64_t)r.timestamp;}
+//cal curve points carry no device time, the packet's receive time stands in
+inline int64_t row_time(const libct_cal_curve_t&, long receive_time) {return receive_time;}
+
+template<typename Row>
+size_t row_bytes() {return sizeof(Row);}
+template<>
+inline size_t row_bytes<WaveformSample>() {return sizeof(short) + sizeof(long long);}
+
+template<FIELD_KIND kind, typename T>
+inline void put(const T& v, StreamRow& row, int& ni, int& nf) {
+    if constexpr (kind == FIELD_INT) row.ints[ni++] = (int64_t)v;
+    else row.floats[nf++] = (float)v;
+}
+
+//waveforms are sample and timestamp arrays, the rest arrays of datapoints or a single datapoint
+template<typename Row, typename M, typename Fn>
+auto for_each_row(const M& m, Fn&& fn) -> decltype(m.samples, void()) {
+    for (unsigned int i = 0; i < m.count; i++) fn(WaveformSample{m.samples[i], m.timestamps[i], true});
+}
+template<typename Row, typename M, typename Fn>
+auto for_each_row(const M& m, Fn&& fn) -> decltype(m.datapoints, void()) {
+    //the library's own for_each_dp indexes datapoints directly, so this does too
+    for (unsigned int i = 0; i < m.count; i++) fn(m.datapoints[i]);
+}
+template<typename Row, typename Fn>
+void for_each_row(const Row& single, Fn&& fn) {
+    fn(single);
+}
+template<typename Row, typename Fn>
+void for_each_row(const libct_device_status_t& s, Fn&& fn) {
+    fn(DeviceStatusRow{s.valid, s.timestamp, s.valid ? pack_device_status(s) : 0});
+}
+
+template<STREAM_ID S>
+struct Traits;
+#define FIELD_PUT(id, member, column, kind, label) put<FIELD_##kind>(r.member, row, ni, nf);
+#define STREAM_TRAITS(id, member, Row, ...) \
+    template<> struct Traits<STREAM_##id> { \
+        typedef Row row_type; \
+        static const auto& of(const libct_stream_data_t* data) {return data->member;} \
+        static void fields(const Row& r, StreamRow& row) {int ni = 0, nf = 0; id##_FIELDS(FIELD_PUT, id) (void)ni; (void)nf;} \
+    };
+CARETAKER_STREAMS(STREAM_TRAITS)
+#undef STREAM_TRAITS
+#undef FIELD_PUT
+
+template<STREAM_ID S, typename Sink>
+void ingest(const libct_stream_data_t* data, Sink& sink) {
+    typedef Traits<S> T;
+    typedef typename T::row_type Row;
+    StreamRow row;
+    size_t rows = 0;
+    int64_t first_ts = -1;
+    for_each_row<Row>(T::of(data), [&](const Row& r) {
+        if (!r.valid) return;
+        row.timestamp = row_time(r, data->receive_time);
+        T::fields(r, row);
+        sink.row(S, row);
+        if (rows++ == 0) first_ts = row.timestamp;
+    });
+    if (rows) sink.packet(S, StreamPacket{rows, rows * row_bytes<Row>(), first_ts, row.timestamp, &row});
+}
+}
+
+/* Walks every stream of a packet, generated from the table: sink.row(STREAM_ID, const StreamRow&)
+ * for each valid row, then sink.packet(STREAM_ID, const StreamPacket&) for each stream that had any.
+ * Runs on the data callback, so a sink should do bounded work per row and not allocate. The file
+ * sinks (session store, EDF, BrainVision) fill preallocated buffers and write a whole chunk or record
+ * to a buffered stream when it completes, so the callback pays an occasional buffered write, never
+ * one per row; anything slower belongs on a writer thread. */
+template<typename Sink>
+void ingest_streams(const libct_stream_data_t* data, Sink& sink) {
+#define STREAM_INGEST(id, ...) stream_table::ingest<STREAM_##id>(data, sink);
+    CARETAKER_STREAMS(STREAM_INGEST)
+#undef STREAM_INGEST
+}
+
+/* Latest row of every stream, written by the data callback and read by triggers and the display.
+ * Each stream has a sequence counter so a reader never sees half of one row and half of another. */
+class LiveValues {
+public:
+    //single writer
+    void update(STREAM_ID stream, const StreamRow& row);
+    //false if the stream has produced nothing yet
+    bool read(int stream, StreamRow& out) const;
+private:
+    struct alignas(64) Slot {
+        std::atomic<uint32_t> seq{0};
+        std::atomic<int64_t> timestamp{-1};
+        std::atomic<int64_t> ints[STREAM_MAX_FIELDS] = {};
+        std::atomic<float> floats[STREAM_MAX_FIELDS] = {};
+    };
+    Slot slots[STREAM_COUNT];
+};
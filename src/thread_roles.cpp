@@ -0,0 +1,227 @@
+#include "thread_roles.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <mutex>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sched.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+const char* thread_role_name(THREAD_ROLE role) {
+    switch (role) {
+        case ROLE_CALLBACK: return "callback";
+        case ROLE_MAIN: return "main";
+        case ROLE_GUI: return "gui";
+        case ROLE_IO: return "io";
+        case ROLE_WRITER: return "writer";
+        case ROLE_TRIGGER: return "trigger";
+        default: return "unknown";
+    }
+}
+
+namespace {
+struct RegisteredThread {
+    THREAD_ROLE role;
+    bool alive = true;
+#ifdef _WIN32
+    HANDLE handle = nullptr;
+    DWORD tid = 0;
+#else
+    pid_t tid = 0;
+#endif
+};
+struct RoleRegistry {
+    std::mutex mtx;
+    std::vector<RegisteredThread> threads; //entries of exited threads stay, marked dead
+    ThreadPolicy policies[ROLE_COUNT];
+    bool configured = false;
+    std::function<void(std::string)> log;
+};
+//never destroyed: threads joined by other statics' destructors, like the io thread, unregister after it would be
+RoleRegistry& registry() {
+    static RoleRegistry* r = new RoleRegistry;
+    return *r;
+}
+
+std::string cpu_list(const std::vector<int>& cpus) {
+    std::string out;
+    for (size_t i = 0; i < cpus.size(); i++) {
+        size_t j = i;
+        while (j + 1 < cpus.size() && cpus[j + 1] == cpus[j] + 1) j++;
+        out += (out.empty() ? "" : ",") + std::to_string(cpus[i]);
+        if (j > i) out += "-" + std::to_string(cpus[j]);
+        i = j;
+    }
+    return out;
+}
+
+#ifdef _WIN32
+int windows_priority(const ThreadPolicy& p) {
+    if (p.policy == "fifo" || p.policy == "rr") return p.priority >= 50 ? THREAD_PRIORITY_TIME_CRITICAL : THREAD_PRIORITY_HIGHEST;
+    if (p.priority <= -10) return THREAD_PRIORITY_HIGHEST;
+    if (p.priority < 0) return THREAD_PRIORITY_ABOVE_NORMAL;
+    if (p.priority == 0) return THREAD_PRIORITY_NORMAL;
+    return p.priority < 10 ? THREAD_PRIORITY_BELOW_NORMAL : THREAD_PRIORITY_LOWEST;
+}
+
+std::string apply(const RegisteredThread& t, const ThreadPolicy& p) {
+    std::string out;
+    if (p.policy == "fifo" || p.policy == "rr" || p.policy == "nice") {
+        int prio = windows_priority(p);
+        out = "priority " + std::to_string(prio) + (SetThreadPriority(t.handle, prio) ? "" : " refused");
+    } else if (p.policy != "default") {
+        out = "unknown policy " + p.policy;
+    }
+    if (!p.cpus.empty()) {
+        DWORD_PTR mask = 0;
+        for (int c : p.cpus)
+            if (c >= 0 && c < (int)(8 * sizeof(mask))) mask |= (DWORD_PTR)1 << c;
+        out += (out.empty() ? "" : ", ") + std::string("cpus ") + cpu_list(p.cpus) + (SetThreadAffinityMask(t.handle, mask) ? "" : " refused");
+    }
+    return out;
+}
+
+std::string current(const RegisteredThread& t) {
+    return "priority " + std::to_string(GetThreadPriority(t.handle));
+}
+#else
+std::string apply(const RegisteredThread& t, const ThreadPolicy& p) {
+    std::string out;
+    bool set_nice = false;
+    int nice = 0;
+    if (p.policy == "fifo" || p.policy == "rr") {
+        int policy = p.policy == "fifo" ? SCHED_FIFO : SCHED_RR;
+        sched_param sp = {};
+        sp.sched_priority = std::min(std::max(p.priority, sched_get_priority_min(policy)), sched_get_priority_max(policy));
+        out = (policy == SCHED_FIFO ? "SCHED_FIFO " : "SCHED_RR ") + std::to_string(sp.sched_priority);
+        if (sched_setscheduler(t.tid, policy, &sp) != 0) {
+            //without CAP_SYS_NICE or an rtprio limit, a raised nice is the next best thing
+            out += std::string(" refused (") + strerror(errno) + ")";
+            set_nice = true;
+            nice = -std::min(std::max((p.priority + 9) / 10, 1), 20);
+        }
+    } else if (p.policy == "nice") {
+        set_nice = true;
+        nice = p.priority;
+    } else if (p.policy != "default") {
+        out = "unknown policy " + p.policy;
+    }
+    if (set_nice) {
+        out += (out.empty() ? "" : ", ") + std::string("nice ") + std::to_string(nice);
+        if (setpriority(PRIO_PROCESS, (id_t)t.tid, nice) != 0) out += std::string(" refused (") + strerror(errno) + ")";
+    }
+    if (!p.cpus.empty()) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        for (int c : p.cpus)
+            if (c >= 0 && c < CPU_SETSIZE) CPU_SET(c, &set);
+        out += (out.empty() ? "" : ", ") + std::string("cpus ") + cpu_list(p.cpus);
+        if (sched_setaffinity(t.tid, sizeof(set), &set) != 0) out += std::string(" refused (") + strerror(errno) + ")";
+    }
+    return out;
+}
+
+std::string current(const RegisteredThread& t) {
+    int policy = sched_getscheduler(t.tid);
+    if (policy < 0) return "gone";
+    std::string out;
+    if (policy == SCHED_FIFO || policy == SCHED_RR) {
+        sched_param sp = {};
+        sched_getparam(t.tid, &sp);
+        out = (policy == SCHED_FIFO ? "SCHED_FIFO " : "SCHED_RR ") + std::to_string(sp.sched_priority);
+    } else {
+        errno = 0;
+        int nice = getpriority(PRIO_PROCESS, (id_t)t.tid);
+        out = errno ? "SCHED_OTHER" : "nice " + std::to_string(nice);
+    }
+    cpu_set_t set;
+    if (sched_getaffinity(t.tid, sizeof(set), &set) == 0) {
+        std::vector<int> cpus;
+        for (int c = 0; c < CPU_SETSIZE; c++)
+            if (CPU_ISSET(c, &set)) cpus.push_back(c);
+        out += " on cpus " + cpu_list(cpus);
+    }
+    return out;
+}
+#endif
+
+std::string describe(const RegisteredThread& t, const std::string& applied) {
+    return std::string(thread_role_name(t.role)) + " thread " + std::to_string((long long)t.tid) + ": "
+        + (applied.empty() ? "" : applied + ", now ") + current(t);
+}
+
+//marks the entry dead when its thread exits, so nothing is applied to a reused id
+struct Registration {
+    int index = -1;
+    ~Registration() {
+        if (index < 0) return;
+        RoleRegistry& r = registry();
+        std::lock_guard<std::mutex> lock(r.mtx);
+        RegisteredThread& t = r.threads[index];
+        t.alive = false;
+#ifdef _WIN32
+        CloseHandle(t.handle);
+        t.handle = nullptr;
+#endif
+    }
+};
+}
+
+void register_thread(THREAD_ROLE role) {
+    thread_local Registration registration;
+    if (registration.index >= 0) return;
+    RegisteredThread t;
+    t.role = role;
+#ifdef _WIN32
+    t.tid = GetCurrentThreadId();
+    t.handle = OpenThread(THREAD_SET_INFORMATION | THREAD_QUERY_INFORMATION, FALSE, t.tid);
+#else
+    t.tid = (pid_t)syscall(SYS_gettid);
+#endif
+    RoleRegistry& r = registry();
+    std::string message;
+    std::function<void(std::string)> log;
+    {
+        std::lock_guard<std::mutex> lock(r.mtx);
+        registration.index = (int)r.threads.size();
+        r.threads.push_back(t);
+        const ThreadPolicy& p = r.policies[role];
+        if (r.configured && (p.policy != "default" || !p.cpus.empty())) {
+            message = describe(t, apply(t, p));
+            log = r.log;
+        }
+    }
+    if (log) log("Scheduling " + message);
+}
+
+void configure_thread_roles(const ThreadPolicy* policies, std::function<void(std::string)> log) {
+    RoleRegistry& r = registry();
+    std::vector<std::string> messages;
+    {
+        std::lock_guard<std::mutex> lock(r.mtx);
+        std::copy(policies, policies + ROLE_COUNT, r.policies);
+        r.configured = true;
+        r.log = log;
+        for (auto& t : r.threads) {
+            const ThreadPolicy& p = r.policies[t.role];
+            if (!t.alive || (p.policy == "default" && p.cpus.empty())) continue;
+            messages.push_back(describe(t, apply(t, p)));
+        }
+    }
+    if (log)
+        for (auto& m : messages) log("Scheduling " + m);
+}
+
+std::string thread_roles_report() {
+    RoleRegistry& r = registry();
+    std::lock_guard<std::mutex> lock(r.mtx);
+    std::string out = "Threads:";
+    for (auto& t : r.threads)
+        if (t.alive) out += "\n  " + describe(t, "");
+    return out;
+}
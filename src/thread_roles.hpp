@@ -0,0 +1,34 @@
+#pragma once
+#include <functional>
+#include <string>
+#include <vector>
+
+enum THREAD_ROLE {
+    ROLE_CALLBACK,  //libct data callbacks
+    ROLE_MAIN,      //state machine loop
+    ROLE_GUI,       //render thread
+    ROLE_IO,        //asio context: serial input, metrics endpoint
+    ROLE_WRITER,    //journal flusher and other file writers
+    ROLE_TRIGGER,   //trigger schedule dispatch
+    ROLE_COUNT
+};
+const char* thread_role_name(THREAD_ROLE role);
+
+/* Scheduling wanted for one role. policy is "default" (leave alone), "fifo" or "rr" (real-time at
+ * priority 1-99, falling back to a negative nice if refused) or "nice" (priority is the nice value).
+ * An empty cpu list leaves the affinity alone. On Windows the policy maps onto thread priorities. */
+struct ThreadPolicy {
+    std::string policy = "default";
+    int priority = 0;
+    std::vector<int> cpus;
+    bool operator==(const ThreadPolicy& o) const {return policy == o.policy && priority == o.priority && cpus == o.cpus;}
+    bool operator!=(const ThreadPolicy& o) const {return !(*this == o);}
+};
+
+//marks the calling thread as role; cheap after the first call, so callbacks can call it every time
+void register_thread(THREAD_ROLE role);
+//sets the policies and applies them to every thread registered so far and every one registered later;
+//each application is reported through log
+void configure_thread_roles(const ThreadPolicy* policies, std::function<void(std::string)> log);
+//what each registered thread is actually running with, read back from the OS
+std::string thread_roles_report();
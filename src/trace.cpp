@@ -0,0 +1,104 @@
+#include "trace.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace {
+struct TraceRegistry {
+    std::mutex mtx;
+    std::vector<std::unique_ptr<TraceBuffer>> buffers; //never shrinks, buffers outlive their threads
+    std::chrono::steady_clock::time_point epoch = std::chrono::steady_clock::now();
+};
+TraceRegistry& registry() {
+    static TraceRegistry r;
+    return r;
+}
+TraceBuffer& local_buffer() {
+    thread_local TraceBuffer* buffer = nullptr;
+    if (!buffer) {
+        TraceRegistry& r = registry();
+        std::lock_guard<std::mutex> lock(r.mtx);
+        r.buffers.emplace_back(new TraceBuffer());
+        buffer = r.buffers.back().get();
+        buffer->tid = (int)r.buffers.size();
+    }
+    return *buffer;
+}
+struct CopiedEvent {
+    const char* name;
+    int64_t start_ns;
+    int64_t dur_ns;
+};
+void write_json_string(FILE* f, const char* s) {
+    fputc('"', f);
+    for (; *s; s++) {
+        if (*s == '"' || *s == '\\') fputc('\\', f);
+        if ((unsigned char)*s >= 0x20) fputc(*s, f);
+    }
+    fputc('"', f);
+}
+}
+
+int64_t trace_now_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - registry().epoch).count();
+}
+
+void trace_record(const char* name, int64_t start_ns, int64_t end_ns) {
+    TraceBuffer& b = local_buffer();
+    uint64_t i = b.head.load(std::memory_order_relaxed);
+    TraceEvent& e = b.events[i & (TraceBuffer::CAPACITY - 1)];
+    e.name.store(name, std::memory_order_relaxed);
+    e.start_ns.store(start_ns, std::memory_order_relaxed);
+    e.dur_ns.store(end_ns - start_ns, std::memory_order_relaxed);
+    b.head.store(i + 1, std::memory_order_release);
+}
+
+void trace_thread_name(const char* name) {
+    local_buffer().thread_name.store(name, std::memory_order_relaxed);
+}
+
+long trace_dump(const std::string& path) {
+    FILE* f = fopen(path.c_str(), "w");
+    if (!f) return -1;
+    TraceRegistry& r = registry();
+    std::lock_guard<std::mutex> lock(r.mtx);
+    long written = 0;
+    bool first = true;
+    fprintf(f, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    std::vector<CopiedEvent> copy;
+    for (auto& b : r.buffers) {
+        const char* thread = b->thread_name.load(std::memory_order_relaxed);
+        if (thread) {
+            fprintf(f, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":", first ? "" : ",\n", b->tid);
+            write_json_string(f, thread);
+            fprintf(f, "}}");
+            first = false;
+        }
+        uint64_t end = b->head.load(std::memory_order_acquire);
+        uint64_t begin = end > TraceBuffer::CAPACITY ? end - TraceBuffer::CAPACITY : 0;
+        copy.clear();
+        for (uint64_t i = begin; i < end; i++) {
+            TraceEvent& e = b->events[i & (TraceBuffer::CAPACITY - 1)];
+            copy.push_back({e.name.load(std::memory_order_relaxed), e.start_ns.load(std::memory_order_relaxed),
+                e.dur_ns.load(std::memory_order_relaxed)});
+        }
+        //the writer kept going while we copied, anything it lapped is torn, and so may be the slot of
+        //span after, which it could be filling in right now
+        uint64_t after = b->head.load(std::memory_order_acquire);
+        uint64_t valid_from = after + 1 > TraceBuffer::CAPACITY ? after + 1 - TraceBuffer::CAPACITY : 0;
+        for (uint64_t i = std::max(begin, valid_from); i < end; i++) {
+            const CopiedEvent& e = copy[i - begin];
+            if (!e.name) continue;
+            fprintf(f, "%s{\"name\":", first ? "" : ",\n");
+            write_json_string(f, e.name);
+            fprintf(f, ",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}", b->tid, e.start_ns / 1000.0, e.dur_ns / 1000.0);
+            first = false;
+            written++;
+        }
+    }
+    fprintf(f, "\n]}\n");
+    fclose(f);
+    return written;
+}
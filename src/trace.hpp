@@ -0,0 +1,59 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+/* Scoped trace spans for the hot paths, dumped as Chrome/Perfetto trace-event JSON.
+ * Each thread records into its own fixed ring (single writer, no locks); the dump copies the rings
+ * without stopping the writers and drops any slot overwritten while it was being read.
+ * Build with CARETAKER_TRACE defined to enable, otherwise TRACE_SCOPE compiles to nothing. */
+
+#ifdef CARETAKER_TRACE
+#define TRACE_CONCAT_INNER(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_INNER(a, b)
+//name must be a string literal, only the pointer is stored
+#define TRACE_SCOPE(name) TraceScope TRACE_CONCAT(trace_scope_, __LINE__)(name)
+//for spans that run in a tight loop, only those lasting at least min_us are kept
+#define TRACE_SCOPE_ABOVE(name, min_us) TraceScope TRACE_CONCAT(trace_scope_, __LINE__)(name, (min_us) * 1000)
+#define TRACE_THREAD_NAME(name) trace_thread_name(name)
+#else
+#define TRACE_SCOPE(name) ((void)0)
+#define TRACE_SCOPE_ABOVE(name, min_us) ((void)0)
+#define TRACE_THREAD_NAME(name) ((void)0)
+#endif
+
+struct TraceEvent {
+    std::atomic<const char*> name{nullptr};
+    std::atomic<int64_t> start_ns{0};
+    std::atomic<int64_t> dur_ns{0};
+};
+
+struct TraceBuffer {
+    static constexpr size_t CAPACITY = 16384; //power of two
+    TraceEvent events[CAPACITY];
+    std::atomic<uint64_t> head{0};
+    std::atomic<const char*> thread_name{nullptr};
+    int tid = 0;
+};
+
+int64_t trace_now_ns();
+void trace_record(const char* name, int64_t start_ns, int64_t end_ns);
+void trace_thread_name(const char* name);
+//writes every buffered span to path, returns the number of events written or -1 on error
+long trace_dump(const std::string& path);
+
+class TraceScope {
+public:
+    explicit TraceScope(const char* name, int64_t min_ns = 0) : name(name), min_ns(min_ns), start(trace_now_ns()) {}
+    ~TraceScope() {
+        int64_t end = trace_now_ns();
+        if (end - start >= min_ns) trace_record(name, start, end);
+    }
+    TraceScope(const TraceScope&) = delete;
+    TraceScope& operator=(const TraceScope&) = delete;
+private:
+    const char* name;
+    int64_t min_ns;
+    int64_t start;
+};
@@ -0,0 +1,241 @@
+#include "trigger_scheduler.hpp"
+#include "latency_histogram.hpp"
+#include "thread_roles.hpp"
+#include "trace.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+
+static std::string trim(const std::string& s) {
+    size_t b = s.find_first_not_of(" \t\r");
+    if (b == std::string::npos) return "";
+    return s.substr(b, s.find_last_not_of(" \t\r") - b + 1);
+}
+
+static long long ms_to_us(const std::string& field) {
+    size_t used = 0;
+    double ms = std::stod(field, &used);
+    if (used != field.size()) throw std::invalid_argument("not a number");
+    return std::llround(ms * 1000);
+}
+
+bool parse_trigger_schedule(const std::string& text, std::vector<ScheduledTrigger>& out, std::string& error) {
+    std::vector<ScheduledTrigger> parsed;
+    std::istringstream in(text);
+    std::string line;
+    long long free_from = 0; //when the previous trigger's code is reset at the latest
+    for (int number = 1; std::getline(in, line); number++) {
+        line = trim(line.substr(0, line.find('#')));
+        if (line.empty()) continue;
+        std::vector<std::string> fields;
+        std::istringstream cells(line);
+        for (std::string cell; std::getline(cells, cell, ',');) fields.push_back(trim(cell));
+        std::string where = "line " + std::to_string(number) + ": ";
+        if (fields.size() < 3 || fields.size() > 4) {
+            error = where + "expected offset_ms,code,width_ms[,jitter_ms]";
+            return false;
+        }
+        ScheduledTrigger t;
+        try {
+            t.offset_us = ms_to_us(fields[0]);
+            size_t used = 0;
+            int code = std::stoi(fields[1], &used);
+            if (used != fields[1].size() || code < 1 || code > 255) {
+                error = where + "code must be 1-255";
+                return false;
+            }
+            t.code = (unsigned char)code;
+            t.width_us = ms_to_us(fields[2]);
+            t.jitter_us = fields.size() > 3 ? ms_to_us(fields[3]) : 0;
+        } catch (const std::exception&) {
+            error = where + "not a number";
+            return false;
+        }
+        if (t.offset_us < 0 || t.width_us <= 0 || t.jitter_us < 0) {
+            error = where + "offset and jitter must not be negative, width must be positive";
+            return false;
+        }
+        if (t.offset_us < free_from) {
+            error = where + "starts before the previous trigger is reset";
+            return false;
+        }
+        free_from = t.offset_us + t.jitter_us + t.width_us;
+        parsed.push_back(t);
+    }
+    out.swap(parsed);
+    return true;
+}
+
+bool load_trigger_schedule(const std::string& filename, std::vector<ScheduledTrigger>& out, std::string& error) {
+    std::ifstream in(filename);
+    if (!in.is_open()) {
+        error = "cannot open " + filename;
+        return false;
+    }
+    std::stringstream text;
+    text << in.rdbuf();
+    return parse_trigger_schedule(text.str(), out, error);
+}
+
+TimerWheel::TimerWheel(long long tick_us, size_t slots) : tick_us(tick_us), slots(slots) {}
+
+void TimerWheel::add(long long due_us, int id) {
+    //an event already due goes in the cursor's slot so the next expire finds it
+    long long tick = std::max(due_us / tick_us, cursor);
+    slots[(size_t)(tick % (long long)slots.size())].push_back({due_us, id});
+    count++;
+}
+
+long long TimerWheel::next_due() const {
+    if (count == 0) return -1;
+    //the first slot holding an event of this turn has the earliest one
+    for (size_t i = 0; i < slots.size(); i++) {
+        long long tick = cursor + (long long)i;
+        long long best = -1;
+        for (auto& e : slots[(size_t)(tick % (long long)slots.size())])
+            if (e.due_us / tick_us <= tick && (best < 0 || e.due_us < best)) best = e.due_us;
+        if (best >= 0) return best;
+    }
+    //nothing within a turn, the wheel only holds later turns
+    long long best = -1;
+    for (auto& slot : slots)
+        for (auto& e : slot)
+            if (best < 0 || e.due_us < best) best = e.due_us;
+    return best;
+}
+
+void TimerWheel::expire(long long now_us, std::vector<Event>& out) {
+    size_t first = out.size();
+    long long now_tick = now_us / tick_us;
+    for (long long tick = cursor; tick <= now_tick && tick < cursor + (long long)slots.size(); tick++) {
+        auto& slot = slots[(size_t)(tick % (long long)slots.size())];
+        for (size_t i = 0; i < slot.size();) {
+            if (slot[i].due_us <= now_us) {
+                out.push_back(slot[i]);
+                slot[i] = slot.back();
+                slot.pop_back();
+                count--;
+            } else i++;
+        }
+    }
+    cursor = std::max(cursor, now_tick);
+    std::sort(out.begin() + first, out.end(), [](const Event& a, const Event& b) {
+        return a.due_us < b.due_us || (a.due_us == b.due_us && a.id < b.id);
+    });
+}
+
+TriggerScheduler::TriggerScheduler(long long spin_us) : spin_us(spin_us) {}
+
+TriggerScheduler::~TriggerScheduler() {
+    stop();
+}
+
+void TriggerScheduler::load(const std::vector<ScheduledTrigger>& triggers, unsigned int seed) {
+    if (active) return;
+    if (worker.joinable()) worker.join();
+    std::mt19937 rng(seed);
+    schedule = triggers;
+    planned.clear();
+    for (auto& t : schedule)
+        planned.push_back(t.offset_us + (t.jitter_us > 0 ? std::uniform_int_distribution<long long>(0, t.jitter_us)(rng) : 0));
+    std::lock_guard<std::mutex> lock(mtx);
+    emissions.clear();
+    emissions.reserve(schedule.size());
+    drained = 0;
+}
+
+bool TriggerScheduler::start(Emit e) {
+    if (active || schedule.empty()) return false;
+    if (worker.joinable()) worker.join();
+    wheel = TimerWheel();
+    //even ids put a code out, odd ones reset it
+    for (size_t i = 0; i < schedule.size(); i++) {
+        wheel.add(planned[i], (int)(2 * i));
+        wheel.add(planned[i] + schedule[i].width_us, (int)(2 * i + 1));
+    }
+    emit = e ? e : [](unsigned char) {return std::chrono::steady_clock::now();};
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        emissions.clear();
+        drained = 0;
+        stopping = false;
+    }
+    done = false;
+    active = true;
+    t0 = std::chrono::steady_clock::now();
+    worker = std::thread([this]{run();});
+    return true;
+}
+
+void TriggerScheduler::stop() {
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        stopping = true;
+    }
+    cv.notify_all();
+    if (worker.joinable()) worker.join();
+    active = false;
+}
+
+long long TriggerScheduler::elapsed_us() const {
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - t0).count();
+}
+
+void TriggerScheduler::run() {
+    register_thread(ROLE_TRIGGER);
+    TRACE_THREAD_NAME("trigger");
+    std::vector<TimerWheel::Event> due;
+    due.reserve(4);
+    bool code_out = false;
+    bool stopped = false;
+    for (long long next; (next = wheel.next_due()) >= 0;) {
+        auto target = t0 + std::chrono::microseconds(next);
+        {
+            //the sleep can overshoot by a scheduler quantum, so it ends spin_us early
+            std::unique_lock<std::mutex> lock(mtx);
+            if (cv.wait_until(lock, target - std::chrono::microseconds(spin_us), [this]{return stopping;})) {
+                stopped = true;
+                break;
+            }
+        }
+        while (std::chrono::steady_clock::now() < target) {}
+        due.clear();
+        wheel.expire(elapsed_us(), due);
+        for (auto& e : due) {
+            size_t index = (size_t)(e.id / 2);
+            bool reset = e.id % 2 == 1;
+            auto written = emit(reset ? 0 : schedule[index].code);
+            code_out = !reset;
+            if (reset) continue;
+            long long actual = std::chrono::duration_cast<std::chrono::microseconds>(written - t0).count();
+            latency_histogram(LATENCY_SCHEDULE_TO_BYTE).record((uint64_t)std::llabs(actual - planned[index]));
+            std::lock_guard<std::mutex> lock(mtx);
+            emissions.push_back({(int)index, schedule[index].code, planned[index], actual, written});
+        }
+    }
+    if (code_out) emit(0);
+    //running() is false by the time finished() is true
+    active = false;
+    done = !stopped;
+}
+
+size_t TriggerScheduler::drain(std::vector<TriggerEmission>& out) {
+    std::lock_guard<std::mutex> lock(mtx);
+    size_t n = emissions.size() - drained;
+    out.insert(out.end(), emissions.begin() + drained, emissions.end());
+    drained = emissions.size();
+    return n;
+}
+
+bool TriggerScheduler::report(const std::string& filename) {
+    FILE* f = fopen(filename.c_str(), "wb");
+    if (!f) return false;
+    fputs("index,code,planned_us,actual_us,error_us\n", f);
+    std::lock_guard<std::mutex> lock(mtx);
+    for (auto& e : emissions)
+        fprintf(f, "%d,%d,%lld,%lld,%lld\n", e.index, (int)e.code, e.planned_us, e.actual_us, e.actual_us - e.planned_us);
+    fclose(f);
+    return true;
+}
@@ -0,0 +1,97 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+//one line of a trigger schedule, times from the start of the schedule
+struct ScheduledTrigger {
+    long long offset_us;
+    unsigned char code;
+    long long width_us;  //how long the code is held before the lines go back to 0
+    long long jitter_us; //a uniform random 0..jitter_us is added to the offset, 0 for none
+};
+
+//what happened to one trigger, planned includes the drawn jitter
+struct TriggerEmission {
+    int index;
+    unsigned char code;
+    long long planned_us;
+    long long actual_us;
+    std::chrono::steady_clock::time_point written; //when the code was handed to the port
+};
+
+/* Parses "offset_ms,code,width_ms[,jitter_ms]" lines; times may have fractions, '#' starts a comment.
+ * A trigger must not start before the previous one, jitter included, has been reset.
+ * On failure error names the line. */
+bool parse_trigger_schedule(const std::string& text, std::vector<ScheduledTrigger>& out, std::string& error);
+bool load_trigger_schedule(const std::string& filename, std::vector<ScheduledTrigger>& out, std::string& error);
+
+/* Hashed timer wheel of microsecond due times, one slot per tick. Events further out than a turn
+ * stay in their slot until the cursor comes round to their turn. */
+class TimerWheel {
+public:
+    struct Event {
+        long long due_us;
+        int id;
+    };
+    TimerWheel(long long tick_us = 1000, size_t slots = 256);
+    void add(long long due_us, int id);
+    //earliest due time, -1 if empty
+    long long next_due() const;
+    //appends the events due at or before now_us, in due order
+    void expire(long long now_us, std::vector<Event>& out);
+    size_t size() const {return count;}
+private:
+    long long tick_us;
+    std::vector<std::vector<Event>> slots;
+    long long cursor = 0; //tick all earlier events have been expired up to
+    size_t count = 0;
+};
+
+/* Plays a schedule on its own thread (ROLE_TRIGGER). Each trigger and each reset to 0 is an event on
+ * a timer wheel; the thread sleeps until spin_us before the next one and then spins on steady_clock
+ * so the byte goes out on time despite the coarse sleep of the OS. emit writes a code and returns
+ * when it was handed to the port. Emissions are collected for drain() and report(). */
+class TriggerScheduler {
+public:
+    typedef std::function<std::chrono::steady_clock::time_point(unsigned char)> Emit;
+    TriggerScheduler(long long spin_us = 2000);
+    ~TriggerScheduler();
+    //replaces a schedule that is not running; jitter is drawn here
+    void load(const std::vector<ScheduledTrigger>& schedule, unsigned int seed = std::random_device{}());
+    bool start(Emit emit);
+    //stops early, a code that is out is reset
+    void stop();
+    bool running() const {return active;}
+    //true once every trigger of a started schedule went out
+    bool finished() const {return done;}
+    //emissions since the last call
+    size_t drain(std::vector<TriggerEmission>& out);
+    //"index,code,planned_us,actual_us,error_us" for every emission so far
+    bool report(const std::string& filename);
+    size_t size() const {return planned.size();}
+private:
+    void run();
+    long long elapsed_us() const;
+    long long spin_us;
+    std::vector<ScheduledTrigger> schedule;
+    std::vector<long long> planned; //per trigger, offset plus jitter
+    TimerWheel wheel;
+    Emit emit;
+    std::chrono::steady_clock::time_point t0;
+    std::thread worker;
+    std::mutex mtx;
+    std::condition_variable cv;
+    std::vector<TriggerEmission> emissions; //reserved at load, appended by the worker
+    size_t drained = 0;
+    bool stopping = false;
+    std::atomic<bool> active{false};
+    std::atomic<bool> done{false};
+};
@@ -0,0 +1,138 @@
+#include "ts_codec.hpp"
+#include "session_arena.hpp"
+#include <algorithm>
+
+static int count_leading(uint32_t x) {
+    int n = 0;
+    for (uint32_t mask = 0x80000000u; mask && !(x & mask); mask >>= 1) n++;
+    return n;
+}
+
+static int count_trailing(uint32_t x) {
+    int n = 0;
+    for (uint32_t mask = 1; mask && !(x & mask); mask <<= 1) n++;
+    return n;
+}
+
+template<typename T>
+static void put_le(std::vector<uint8_t>& out, T v) {
+    for (size_t i = 0; i < sizeof(T); i++) out.push_back((uint8_t)((uint64_t)v >> (8 * i)));
+}
+
+template<typename T>
+static T get_le(const uint8_t*& p) {
+    uint64_t v = 0;
+    for (size_t i = 0; i < sizeof(T); i++) v |= (uint64_t)(*p++) << (8 * i);
+    return (T)v;
+}
+
+void serialise_header(const ChunkHeader& h, std::vector<uint8_t>& out) {
+    out.push_back(h.channel);
+    out.push_back(h.int_columns);
+    out.push_back(h.float_columns);
+    put_le<uint32_t>(out, h.count);
+    put_le<int64_t>(out, h.t_min);
+    put_le<int64_t>(out, h.t_max);
+    put_le<uint32_t>(out, h.varint_bytes);
+    put_le<uint32_t>(out, h.float_bytes);
+}
+
+bool ChunkDecoder::read_header(const uint8_t* data, size_t len, ChunkHeader& h) {
+    if (len < CHUNK_HEADER_SIZE) return false;
+    const uint8_t* p = data;
+    h.channel = *p++;
+    h.int_columns = *p++;
+    h.float_columns = *p++;
+    h.count = get_le<uint32_t>(p);
+    h.t_min = get_le<int64_t>(p);
+    h.t_max = get_le<int64_t>(p);
+    h.varint_bytes = get_le<uint32_t>(p);
+    h.float_bytes = get_le<uint32_t>(p);
+    return len >= CHUNK_HEADER_SIZE + (size_t)h.varint_bytes + h.float_bytes;
+}
+
+ChunkEncoder::ChunkEncoder(uint8_t channel, int int_columns, int float_columns)
+    : prev_ints(int_columns), prev_floats(float_columns), prev_leading(float_columns), prev_trailing(float_columns) {
+    header.channel = channel;
+    header.int_columns = (uint8_t)int_columns;
+    header.float_columns = (uint8_t)float_columns;
+    reset();
+}
+
+void ChunkEncoder::reset() {
+    header.count = 0;
+    header.t_min = 0;
+    header.t_max = 0;
+    varints.clear();
+    floats.clear();
+    prev_ts = 0;
+    prev_delta = 0;
+    std::fill(prev_leading.begin(), prev_leading.end(), -1);
+}
+
+void ChunkEncoder::add_row(int64_t timestamp, const int64_t* ints, const float* fvals) {
+    uint32_t r = header.count;
+    if (r == 0) {
+        put_varint(varints, zigzag_encode(timestamp));
+        header.t_min = timestamp;
+        header.t_max = timestamp;
+    } else {
+        int64_t delta = timestamp - prev_ts;
+        put_varint(varints, zigzag_encode(r == 1 ? delta : delta - prev_delta));
+        prev_delta = delta;
+        if (timestamp < header.t_min) header.t_min = timestamp;
+        if (timestamp > header.t_max) header.t_max = timestamp;
+    }
+    prev_ts = timestamp;
+    for (int c = 0; c < header.int_columns; c++) {
+        put_varint(varints, zigzag_encode(r == 0 ? ints[c] : ints[c] - prev_ints[c]));
+        prev_ints[c] = ints[c];
+    }
+    for (int c = 0; c < header.float_columns; c++) {
+        uint32_t bits;
+        std::memcpy(&bits, &fvals[c], sizeof(float));
+        if (r == 0) {
+            floats.write(bits, 32);
+        } else {
+            uint32_t x = bits ^ prev_floats[c];
+            if (x == 0) {
+                floats.write(0, 1);
+            } else {
+                floats.write(1, 1);
+                int leading = count_leading(x);
+                int trailing = count_trailing(x);
+                if (prev_leading[c] >= 0 && leading >= prev_leading[c] && trailing >= prev_trailing[c]) {
+                    //fits inside the previous meaningful window
+                    floats.write(0, 1);
+                    floats.write(x >> prev_trailing[c], 32 - prev_leading[c] - prev_trailing[c]);
+                } else {
+                    int meaningful = 32 - leading - trailing;
+                    floats.write(1, 1);
+                    floats.write((uint32_t)leading, 5);
+                    floats.write((uint32_t)(meaningful - 1), 5);
+                    floats.write(x >> trailing, meaningful);
+                    prev_leading[c] = leading;
+                    prev_trailing[c] = trailing;
+                }
+            }
+        }
+        prev_floats[c] = bits;
+    }
+    header.count++;
+}
+
+void ChunkEncoder::reserve(uint32_t rows) {
+    //timestamp deltas and int columns rarely take more than 3 varint bytes, floats at worst 43 bits
+    prefault_reserve(varints, (size_t)rows * (1 + header.int_columns) * 3);
+    prefault_reserve(floats.bytes, (size_t)rows * header.float_columns * 6);
+}
+
+void ChunkEncoder::finish(std::vector<uint8_t>& out) {
+    if (header.count == 0) return;
+    header.varint_bytes = (uint32_t)varints.size();
+    header.float_bytes = (uint32_t)floats.bytes.size();
+    serialise_header(header, out);
+    out.insert(out.end(), varints.begin(), varints.end());
+    out.insert(out.end(), floats.bytes.begin(), floats.bytes.end());
+    reset();
+}
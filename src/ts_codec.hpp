@@ -0,0 +1,182 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include <cstring>
+
+/* Chunked time-series codec for recorded streams.
+ * Timestamps are stored as delta-of-delta, integer columns as deltas, both as zigzag varints.
+ * Float columns use Gorilla style XOR encoding into a separate bit stream.
+ * Every chunk is self contained so a chunk can be decoded without touching its neighbours. */
+
+inline uint64_t zigzag_encode(int64_t v) {return ((uint64_t)v << 1) ^ (uint64_t)(v >> 63);}
+inline int64_t zigzag_decode(uint64_t v) {return (int64_t)(v >> 1) ^ -(int64_t)(v & 1);}
+
+inline void put_varint(std::vector<uint8_t>& out, uint64_t v) {
+    while (v >= 0x80) {
+        out.push_back((uint8_t)(v | 0x80));
+        v >>= 7;
+    }
+    out.push_back((uint8_t)v);
+}
+
+//writes into a buffer with at least 10 bytes free, returns the byte after the varint
+inline uint8_t* put_varint(uint8_t* out, uint64_t v) {
+    while (v >= 0x80) {
+        *out++ = (uint8_t)(v | 0x80);
+        v >>= 7;
+    }
+    *out++ = (uint8_t)v;
+    return out;
+}
+
+inline uint64_t get_varint(const uint8_t*& p, const uint8_t* end) {
+    uint64_t v = 0;
+    int shift = 0;
+    while (p < end && shift < 64) {
+        uint8_t b = *p++;
+        v |= (uint64_t)(b & 0x7f) << shift;
+        if (!(b & 0x80)) break;
+        shift += 7;
+    }
+    return v;
+}
+
+class BitWriter {
+public:
+    void write(uint32_t bits, int count) {
+        for (int i = count - 1; i >= 0; i--) {
+            if (used == 0) bytes.push_back(0);
+            if ((bits >> i) & 1) bytes.back() |= (uint8_t)(0x80 >> used);
+            used = (used + 1) & 7;
+        }
+    }
+    void clear() {bytes.clear(); used = 0;}
+    std::vector<uint8_t> bytes;
+private:
+    int used = 0;
+};
+
+class BitReader {
+public:
+    BitReader(const uint8_t* data, size_t len) : data(data), len(len) {}
+    uint32_t read(int count) {
+        uint32_t v = 0;
+        for (int i = 0; i < count; i++) {
+            size_t byte = pos >> 3;
+            uint32_t bit = byte < len ? (data[byte] >> (7 - (pos & 7))) & 1 : 0;
+            v = (v << 1) | bit;
+            pos++;
+        }
+        return v;
+    }
+private:
+    const uint8_t* data;
+    size_t len;
+    size_t pos = 0;
+};
+
+enum STREAM_CHANNEL : uint8_t {
+    CHANNEL_INT_PULSE = 1,
+    CHANNEL_VITALS = 2,
+    CHANNEL_VITALS2 = 3,
+    CHANNEL_CUFF = 4,
+    CHANNEL_PARAM_PULSE = 5,
+    CHANNEL_DEVICE_STATUS = 6,
+    CHANNEL_TEMPERATURE = 7,
+    CHANNEL_PULSE_OX = 8,
+    CHANNEL_BATTERY = 9,
+    CHANNEL_RAW_PULSE = 10,
+    CHANNEL_CAL_CURVE = 11,
+};
+
+struct ChunkHeader {
+    uint8_t channel;
+    uint8_t int_columns;
+    uint8_t float_columns;
+    uint32_t count;
+    int64_t t_min;
+    int64_t t_max;
+    uint32_t varint_bytes;
+    uint32_t float_bytes;
+};
+const size_t CHUNK_HEADER_SIZE = 3 + 4 + 8 + 8 + 4 + 4;
+
+class ChunkEncoder {
+public:
+    ChunkEncoder(uint8_t channel, int int_columns, int float_columns);
+    void add_row(int64_t timestamp, const int64_t* ints, const float* floats);
+    uint32_t rows() const {return header.count;}
+    //appends the serialised chunk to out and starts a new chunk
+    void finish(std::vector<uint8_t>& out);
+    const ChunkHeader& current() const {return header;}
+    //sizes and touches the buffers for a chunk of this many rows, so filling it never allocates
+    void reserve(uint32_t rows);
+private:
+    void reset();
+    ChunkHeader header;
+    std::vector<uint8_t> varints;
+    BitWriter floats;
+    int64_t prev_ts;
+    int64_t prev_delta;
+    std::vector<int64_t> prev_ints;
+    std::vector<uint32_t> prev_floats;
+    std::vector<int> prev_leading;
+    std::vector<int> prev_trailing;
+};
+
+class ChunkDecoder {
+public:
+    //parses the header at data; returns false if the buffer is too short for the header and payload
+    static bool read_header(const uint8_t* data, size_t len, ChunkHeader& header);
+    //decodes one serialised chunk, calling row(timestamp, ints, floats) for each row
+    template<typename F>
+    static bool decode(const uint8_t* data, size_t len, F&& row);
+};
+
+void serialise_header(const ChunkHeader& h, std::vector<uint8_t>& out);
+
+template<typename F>
+bool ChunkDecoder::decode(const uint8_t* data, size_t len, F&& row) {
+    ChunkHeader h;
+    if (!read_header(data, len, h)) return false;
+    const uint8_t* p = data + CHUNK_HEADER_SIZE;
+    const uint8_t* vend = p + h.varint_bytes;
+    BitReader bits(vend, h.float_bytes);
+    int64_t ints[256];
+    float floats[256];
+    uint32_t prev_floats[256] = {};
+    int leading[256] = {};
+    int trailing[256] = {};
+    int64_t ts = 0, delta = 0;
+    for (uint32_t r = 0; r < h.count; r++) {
+        int64_t v = zigzag_decode(get_varint(p, vend));
+        if (r == 0) ts = v;
+        else {
+            delta = (r == 1) ? v : delta + v;
+            ts += delta;
+        }
+        for (int c = 0; c < h.int_columns; c++) {
+            int64_t d = zigzag_decode(get_varint(p, vend));
+            ints[c] = r == 0 ? d : ints[c] + d;
+        }
+        for (int c = 0; c < h.float_columns; c++) {
+            uint32_t bitsv;
+            if (r == 0) bitsv = bits.read(32);
+            else if (bits.read(1) == 0) bitsv = prev_floats[c];
+            else {
+                if (bits.read(1) == 1) {
+                    leading[c] = (int)bits.read(5);
+                    int meaningful = (int)bits.read(5) + 1;
+                    trailing[c] = 32 - leading[c] - meaningful;
+                }
+                int meaningful = 32 - leading[c] - trailing[c];
+                uint32_t x = bits.read(meaningful) << trailing[c];
+                bitsv = prev_floats[c] ^ x;
+            }
+            prev_floats[c] = bitsv;
+            std::memcpy(&floats[c], &bitsv, sizeof(float));
+        }
+        row(ts, (const int64_t*)ints, (const float*)floats);
+    }
+    return true;
+}
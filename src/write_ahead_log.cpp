@@ -0,0 +1,291 @@
+#include "write_ahead_log.hpp"
+#include "trace.hpp"
+#include "thread_roles.hpp"
+#include "CSVWriter.h"
+#include "session_arena.hpp"
+#include <chrono>
+#include <cstring>
+#include <array>
+#include <algorithm>
+#ifdef _MSC_VER
+#include <io.h>
+#define fsync _commit
+#define fileno _fileno
+#else
+#include <unistd.h>
+#endif
+
+uint32_t crc32(const uint8_t* data, size_t len) {
+    return crc32_update(0, data, len);
+}
+
+uint32_t crc32_update(uint32_t crc, const uint8_t* data, size_t len) {
+    static const std::array<uint32_t, 256> table = []{
+        std::array<uint32_t, 256> t;
+        for (uint32_t i = 0; i < 256; i++) {
+            uint32_t c = i;
+            for (int k = 0; k < 8; k++) c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            t[i] = c;
+        }
+        return t;
+    }();
+    crc ^= 0xFFFFFFFFu;
+    for (size_t i = 0; i < len; i++) crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    return crc ^ 0xFFFFFFFFu;
+}
+
+template<typename T>
+static void put_le(uint8_t*& p, T v) {
+    for (size_t i = 0; i < sizeof(T); i++) *p++ = (uint8_t)((uint64_t)v >> (8 * i));
+}
+
+template<typename T>
+static T get_le(const uint8_t*& p) {
+    uint64_t v = 0;
+    for (size_t i = 0; i < sizeof(T); i++) v |= (uint64_t)(*p++) << (8 * i);
+    return (T)v;
+}
+
+void wal_serialise(const WalRecord& r, uint8_t* out) {
+    uint8_t* p = out;
+    put_le<uint32_t>(p, r.seq);
+    put_le<uint16_t>(p, r.type);
+    put_le<int16_t>(p, r.trigger);
+    put_le<int64_t>(p, r.ct_timestamp);
+    put_le<int64_t>(p, r.pc_timestamp);
+    memcpy(p, r.label, sizeof(r.label)); p += sizeof(r.label);
+    memcpy(p, r.value, sizeof(r.value)); p += sizeof(r.value);
+    put_le<uint32_t>(p, r.extra);
+    put_le<uint32_t>(p, crc32(out, WAL_RECORD_SIZE - 4));
+}
+
+bool wal_parse(const uint8_t* in, WalRecord& r) {
+    const uint8_t* crcp = in + WAL_RECORD_SIZE - 4;
+    if (get_le<uint32_t>(crcp) != crc32(in, WAL_RECORD_SIZE - 4)) return false;
+    const uint8_t* p = in;
+    r.seq = get_le<uint32_t>(p);
+    r.type = get_le<uint16_t>(p);
+    r.trigger = get_le<int16_t>(p);
+    r.ct_timestamp = get_le<int64_t>(p);
+    r.pc_timestamp = get_le<int64_t>(p);
+    memcpy(r.label, p, sizeof(r.label)); p += sizeof(r.label);
+    memcpy(r.value, p, sizeof(r.value)); p += sizeof(r.value);
+    r.extra = get_le<uint32_t>(p);
+    r.label[sizeof(r.label)-1] = 0;
+    r.value[sizeof(r.value)-1] = 0;
+    return true;
+}
+
+//returns the characters copied
+static size_t copy_field(char* dst, size_t size, const char* src) {
+    size_t n = strnlen(src, size - 1);
+    memcpy(dst, src, n);
+    dst[n] = 0;
+    return n;
+}
+
+static size_t dir_end(const std::string& path) {
+    size_t slash = path.find_last_of("/\\");
+    return slash == std::string::npos ? 0 : slash + 1;
+}
+
+//data rows of a session CSV, each starts on a new line after the header, npos if there is no file
+static size_t csv_rows(const std::string& filename) {
+    FILE* f = fopen(filename.c_str(), "rb");
+    if (!f) return std::string::npos;
+    size_t lines = 0;
+    char buf[4096];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), f)) > 0) lines += std::count(buf, buf + n, '\n');
+    fclose(f);
+    return lines;
+}
+
+WriteAheadLog::WriteAheadLog(int sync_interval_ms) : sync_interval_ms(sync_interval_ms) {
+    queue.reserve(256);
+}
+
+WriteAheadLog::~WriteAheadLog() {
+    close();
+}
+
+bool WriteAheadLog::open(const std::string& path, const std::string& session_name) {
+    file = fopen(path.c_str(), "wb");
+    if (!file) return false;
+    stopping = false;
+    WalRecord r;
+    r.type = WAL_SESSION_OPEN;
+    std::string base = session_name.substr(dir_end(session_name));
+    if (base.size() > sizeof(r.label) + sizeof(r.value) - 2) {
+        fclose(file);
+        file = nullptr;
+        return false;
+    }
+    size_t n = copy_field(r.label, sizeof(r.label), base.c_str());
+    copy_field(r.value, sizeof(r.value), base.c_str() + n);
+    push(r);
+    flusher = std::thread([this]{run();});
+    return true;
+}
+
+void WriteAheadLog::close() {
+    if (!file) return;
+    WalRecord r;
+    r.type = WAL_SESSION_CLOSED;
+    push(r);
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        stopping = true;
+    }
+    cv.notify_one();
+    if (flusher.joinable()) flusher.join();
+    fclose(file);
+    file = nullptr;
+}
+
+void WriteAheadLog::append(int trigger, const std::string& label, const std::string& value, int64_t ct_timestamp, int64_t pc_timestamp) {
+    append(trigger, label.c_str(), value.c_str(), ct_timestamp, pc_timestamp);
+}
+
+void WriteAheadLog::append(int trigger, const char* label, const char* value, int64_t ct_timestamp, int64_t pc_timestamp) {
+    WalRecord r;
+    r.type = WAL_ROW;
+    r.trigger = (int16_t)trigger;
+    r.ct_timestamp = ct_timestamp;
+    r.pc_timestamp = pc_timestamp;
+    copy_field(r.label, sizeof(r.label), label);
+    copy_field(r.value, sizeof(r.value), value);
+    push(r);
+}
+
+void WriteAheadLog::append_transition(int event, const char* from, const char* to, int64_t in_state_ms, uint32_t took_us, int64_t pc_timestamp) {
+    WalRecord r;
+    r.type = WAL_TRANSITION;
+    r.trigger = (int16_t)event;
+    r.ct_timestamp = in_state_ms;
+    r.pc_timestamp = pc_timestamp;
+    r.extra = took_us;
+    copy_field(r.label, sizeof(r.label), from);
+    copy_field(r.value, sizeof(r.value), to);
+    push(r);
+}
+
+void WriteAheadLog::push(WalRecord& r) {
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        r.seq = next_seq++;
+        queue.push_back(r);
+    }
+    cv.notify_one();
+}
+
+void WriteAheadLog::reserve(size_t records) {
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        prefault_reserve(queue, records);
+    }
+    //the flusher's batch is swapped with the queue, it grows its own on the next pass
+    queue_capacity = std::max(queue_capacity.load(), records);
+}
+
+WalStats WriteAheadLog::stats() {
+    std::lock_guard<std::mutex> lock(stats_mtx);
+    return wal_stats;
+}
+
+void WriteAheadLog::run() {
+    TRACE_THREAD_NAME("wal flusher");
+    register_thread(ROLE_WRITER);
+    std::vector<WalRecord> batch;
+    batch.reserve(queue_capacity);
+    auto last_sync = std::chrono::steady_clock::now();
+    bool dirty = false;
+    for (;;) {
+        bool stop;
+        {
+            std::unique_lock<std::mutex> lock(mtx);
+            cv.wait_for(lock, std::chrono::milliseconds(sync_interval_ms), [this]{return stopping || !queue.empty();});
+            batch.swap(queue);
+            stop = stopping;
+        }
+        if (batch.capacity() < queue_capacity) batch.reserve(queue_capacity);
+        if (!batch.empty()) {
+            write_pending(batch);
+            dirty = true;
+        }
+        auto now = std::chrono::steady_clock::now();
+        if (dirty && (stop || now - last_sync >= std::chrono::milliseconds(sync_interval_ms))) {
+            sync();
+            last_sync = now;
+            dirty = false;
+        }
+        if (stop) break;
+    }
+}
+
+void WriteAheadLog::write_pending(std::vector<WalRecord>& batch) {
+    TRACE_SCOPE("wal write");
+    uint8_t buf[WAL_RECORD_SIZE];
+    for (auto& r : batch) {
+        wal_serialise(r, buf);
+        fwrite(buf, 1, WAL_RECORD_SIZE, file);
+    }
+    //hand the batch to the OS now, the live CSV is flushed per row and must not outrun the journal
+    fflush(file);
+    std::lock_guard<std::mutex> lock(stats_mtx);
+    wal_stats.records += batch.size();
+    batch.clear();
+}
+
+void WriteAheadLog::sync() {
+    TRACE_SCOPE("wal sync");
+    auto t0 = std::chrono::steady_clock::now();
+    fflush(file);
+    fsync(fileno(file));
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+    std::lock_guard<std::mutex> lock(stats_mtx);
+    wal_stats.syncs++;
+    wal_stats.sync_total_ms += ms;
+    if (ms > wal_stats.sync_max_ms) wal_stats.sync_max_ms = ms;
+}
+
+std::string WriteAheadLog::recover(const std::string& path, std::function<void(std::string)> log) {
+    FILE* f = fopen(path.c_str(), "rb");
+    if (!f) return "";
+    uint8_t buf[WAL_RECORD_SIZE];
+    WalRecord r;
+    std::string session;
+    std::vector<WalRecord> rows;
+    bool closed = false;
+    size_t torn = 0;
+    while (fread(buf, 1, WAL_RECORD_SIZE, f) == WAL_RECORD_SIZE) {
+        //a bad checksum marks the torn tail of the last write, nothing after it is trusted
+        if (!wal_parse(buf, r)) {torn++; break;}
+        if (r.type == WAL_SESSION_OPEN) session = path.substr(0, dir_end(path)) + r.label + r.value;
+        else if (r.type == WAL_ROW) rows.push_back(r);
+        else if (r.type == WAL_SESSION_CLOSED) closed = true;
+    }
+    fclose(f);
+    if (session.empty() || closed) return "";
+
+    //the live CSV is flushed row by row, it is never behind the journal once that has reached the OS
+    std::string filename = session + ".csv";
+    size_t existing = csv_rows(filename);
+    if (existing != std::string::npos && existing >= rows.size()) {
+        log("Unfinished session " + session + " already has all " + std::to_string(rows.size()) + " journalled rows in " + filename);
+        return "";
+    }
+    //a partial CSV is kept as it is, the journal's copy goes beside it
+    if (existing != std::string::npos) filename = session + ".recovered.csv";
+    CSVWriter csv(",", 5);
+    csv << "trigger" << "datatype" << "recent value" << "ct timestamp" << "computer timestamp";
+    for (auto& row : rows)
+        csv << (int)row.trigger << row.label << row.value << (long long)row.ct_timestamp << (unsigned long long)row.pc_timestamp;
+    if (!csv.writeToFile(filename)) {
+        log("Failed to rebuild " + filename + " from the write-ahead log");
+        return "";
+    }
+    log("Recovered " + std::to_string(rows.size()) + " rows of unfinished session " + session + " into " + filename
+        + (torn ? " (discarded a torn record)" : ""));
+    return filename;
+}
@@ -0,0 +1,84 @@
+#pragma once
+#include <cstdio>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <atomic>
+#include <functional>
+
+enum WAL_RECORD_TYPE : uint16_t {
+    WAL_SESSION_OPEN = 1,  //label, continued in value, holds the session's file name without its directory
+    WAL_ROW = 2,           //one row of the session CSV
+    WAL_SESSION_CLOSED = 3,
+    WAL_TRANSITION = 4,    //a program state change: trigger holds the event, label and value the old and new
+                           //state, ct_timestamp the ms spent in the old one, extra the transition time in us
+};
+
+//fixed size record, serialised little endian into WAL_RECORD_SIZE bytes with a trailing crc32
+struct WalRecord {
+    uint32_t seq = 0;
+    uint16_t type = WAL_ROW;
+    int16_t trigger = 0;
+    int64_t ct_timestamp = 0;
+    int64_t pc_timestamp = 0;
+    char label[24] = {};
+    char value[24] = {};
+    uint32_t extra = 0;
+};
+const size_t WAL_RECORD_SIZE = 80;
+
+uint32_t crc32(const uint8_t* data, size_t len);
+//continues a crc32 over another buffer, crc32(a+b) == crc32_update(crc32(a), b)
+uint32_t crc32_update(uint32_t crc, const uint8_t* data, size_t len);
+void wal_serialise(const WalRecord& r, uint8_t* out);
+bool wal_parse(const uint8_t* in, WalRecord& r);
+
+struct WalStats {
+    uint64_t records = 0;
+    uint64_t syncs = 0;
+    double sync_total_ms = 0;
+    double sync_max_ms = 0;
+};
+
+/* Append-only journal of session rows. Rows are queued by the caller and written by a background
+ * flusher, which fsyncs at most every sync_interval_ms so the durability cost is bounded. */
+class WriteAheadLog {
+public:
+    WriteAheadLog(int sync_interval_ms = 1000);
+    ~WriteAheadLog();
+    //session_name is journalled without its directory, recovery finds the session beside the journal
+    bool open(const std::string& path, const std::string& session_name);
+    //marks the session as cleanly finished and stops the flusher
+    void close();
+    void append(int trigger, const std::string& label, const std::string& value, int64_t ct_timestamp, int64_t pc_timestamp);
+    void append(int trigger, const char* label, const char* value, int64_t ct_timestamp, int64_t pc_timestamp);
+    void append_transition(int event, const char* from, const char* to, int64_t in_state_ms, uint32_t took_us, int64_t pc_timestamp);
+    //presizes both sides of the queue so appends do not allocate while fewer than records are waiting
+    void reserve(size_t records);
+    WalStats stats();
+    size_t queued() {std::lock_guard<std::mutex> lock(mtx); return queue.size();}
+
+    //rebuilds the CSV of a session that was not closed cleanly, returns the rebuilt file or "" if none;
+    //an existing CSV is never overwritten, a shorter one gets <session>.recovered.csv beside it
+    static std::string recover(const std::string& path, std::function<void(std::string)> log);
+private:
+    void push(WalRecord& r);
+    void run();
+    void write_pending(std::vector<WalRecord>& batch);
+    void sync();
+
+    const int sync_interval_ms;
+    FILE* file = nullptr;
+    std::thread flusher;
+    std::mutex mtx;
+    std::condition_variable cv;
+    std::vector<WalRecord> queue;
+    std::atomic<size_t> queue_capacity{256};
+    bool stopping = false;
+    uint32_t next_seq = 0;
+    WalStats wal_stats;
+    std::mutex stats_mtx;
+};
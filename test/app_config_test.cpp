@@ -0,0 +1,96 @@
+#include <doctest.h>
+#include "app_config.hpp"
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+
+static std::string slurp(const char* path) {
+    std::ifstream in(path, std::ios::binary);
+    return std::string((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+}
+
+TEST_CASE("config store writes defaults and reads them back") {
+    const char* path = "config_test.json";
+    std::remove(path);
+    std::vector<std::string> logs;
+    {
+        ConfigStore store(path, [&](std::string s){logs.push_back(s);});
+        store.load();
+        CHECK(store.get() == AppConfig());
+    }
+    CHECK(slurp(path).find("\"com_port\": \"COM7\"") != std::string::npos);
+
+    ConfigStore store(path, [&](std::string s){logs.push_back(s);});
+    store.load();
+    CHECK(store.get() == AppConfig());
+    std::remove(path);
+}
+
+TEST_CASE("config store saves updates and survives a reload") {
+    const char* path = "config_test.json";
+    std::remove(path);
+    {
+        ConfigStore store(path, [](std::string){});
+        store.load();
+        store.update([](AppConfig& c) {
+            c.com_port = "/dev/ttyUSB0";
+            c.baud = 115200;
+            c.monitor = {"vitals", "cuff"};
+            c.posture = "supine";
+            c.devices.push_back({"AA:BB", "Caretaker 1", 1700000000123ULL, 1700000000456ULL});
+            c.threads[ROLE_TRIGGER].policy = "realtime";
+            c.threads[ROLE_TRIGGER].priority = 2;
+            c.threads[ROLE_TRIGGER].cpus = {1, 3};
+        });
+    }
+    CHECK_FALSE(std::ifstream(std::string(path) + ".tmp").good()); //swapped into place, not left beside it
+    ConfigStore store(path, [](std::string){});
+    store.load();
+    AppConfig c = store.get();
+    CHECK(c.com_port == "/dev/ttyUSB0");
+    CHECK(c.baud == 115200);
+    CHECK(c.monitor == std::vector<std::string>{"vitals", "cuff"});
+    CHECK(c.posture_value() == LIBCT_POSTURE_SUPINE);
+    REQUIRE(c.devices.size() == 1);
+    CHECK(c.devices[0].last_seen_ms == 1700000000123ULL);
+    CHECK(c.devices[0].last_connected_ms == 1700000000456ULL);
+    CHECK(c.threads[ROLE_TRIGGER].cpus == std::vector<int>{1, 3});
+    CHECK(c.threads[ROLE_TRIGGER].priority == 2);
+
+    //an update that changes nothing does not touch the file
+    std::string before = slurp(path);
+    std::remove(path);
+    store.update([](AppConfig&) {});
+    CHECK_FALSE(std::ifstream(path).good());
+    store.update([](AppConfig& c) {c.expected_minutes = 30;});
+    CHECK(slurp(path) != before);
+    std::remove(path);
+}
+
+TEST_CASE("config store keeps defaults for bad values") {
+    const char* path = "config_test.json";
+    {
+        std::ofstream out(path);
+        out << "{\"trigger_box\": {\"com_port\": 7, \"baud\": -1}, \"caretaker\": {\"monitor\": [\"nope\"], \"discover_timeout_ms\": 500},"
+               " \"devices\": [{\"name\": \"no address\"}]}";
+    }
+    std::vector<std::string> logs;
+    ConfigStore store(path, [&](std::string s){logs.push_back(s);});
+    store.load();
+    AppConfig c = store.get();
+    CHECK(c.com_port == AppConfig().com_port);
+    CHECK(c.baud == AppConfig().baud);
+    CHECK(c.monitor == AppConfig().monitor);
+    CHECK(c.discover_timeout_ms == 500);
+    CHECK(c.devices.empty());
+    CHECK(logs.size() >= 4);
+
+    {
+        std::ofstream out(path);
+        out << "{not json";
+    }
+    ConfigStore broken(path, [&](std::string s){logs.push_back(s);});
+    broken.load();
+    CHECK(broken.get() == AppConfig());
+    std::remove(path);
+}
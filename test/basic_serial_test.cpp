@@ -0,0 +1,155 @@
+#include <doctest.h>
+#include "basic_serial.hpp"
+
+//a pseudo-terminal stands in for the trigger box, so these only run where there is one
+#ifdef __linux__
+#include <fcntl.h>
+#include <stdlib.h>
+#include <termios.h>
+#include <unistd.h>
+
+//runs its own io_context rather than the app's io thread, which would stay registered for the other tests
+struct PtyPort {
+    PtyPort() : work(asio::make_work_guard(io)), port(io) {
+        runner = std::thread([this]{io.run();});
+        master = posix_openpt(O_RDWR | O_NOCTTY);
+        REQUIRE(master >= 0);
+        REQUIRE(grantpt(master) == 0);
+        REQUIRE(unlockpt(master) == 0);
+        port.open(ptsname(master));
+        //raw, or the line discipline would hold bytes back until a newline and turn \r into \n
+        termios tio;
+        tcgetattr(port.native_handle(), &tio);
+        cfmakeraw(&tio);
+        tcsetattr(port.native_handle(), TCSANOW, &tio);
+    }
+    ~PtyPort() {
+        work.reset();
+        io.stop();
+        runner.join();
+        close(master);
+    }
+    void send(const std::string& s) {REQUIRE(write(master, s.data(), s.size()) == (ssize_t)s.size());}
+    //closes on the io thread, as the app does, which completes the outstanding read
+    void close_port() {
+        std::promise<void> done;
+        asio::post(io, [&]{
+            asio::error_code ec;
+            port.close(ec);
+            done.set_value();
+        });
+        done.get_future().wait();
+    }
+    asio::io_context io;
+    asio::executor_work_guard<asio::io_context::executor_type> work;
+    std::thread runner;
+    int master;
+    asio::serial_port port;
+};
+
+struct Received {
+    std::mutex mtx;
+    std::condition_variable cv;
+    std::string bytes;
+    std::vector<std::string> lines;
+    size_t frames = 0;
+    //waits for pred under the lock, false after a second
+    template<typename Pred> bool wait(Pred pred) {
+        std::unique_lock<std::mutex> lock(mtx);
+        return cv.wait_for(lock, std::chrono::seconds(1), pred);
+    }
+};
+
+TEST_CASE("serial reader delivers bytes and lines to their subscribers") {
+    PtyPort pty;
+    AsyncSerialReader reader(pty.port);
+    Received r;
+    auto before = std::chrono::steady_clock::now();
+    reader.subscribe(FRAME_BYTES, [&](const SerialFrame& f) {
+        std::lock_guard<std::mutex> lock(r.mtx);
+        CHECK(f.received >= before);
+        r.bytes += f.data;
+        r.frames++;
+        r.cv.notify_all();
+    });
+    reader.subscribe(FRAME_LINES, [&](const SerialFrame& f) {
+        std::lock_guard<std::mutex> lock(r.mtx);
+        r.lines.push_back(f.data);
+        r.cv.notify_all();
+    });
+    reader.start();
+    reader.start(); //a second start does not stack another read
+
+    pty.send("ab\r\ncd\nef");
+    CHECK(r.wait([&]{return r.bytes.size() == 9;}));
+    pty.send(std::string("g\n\x05", 3));
+    //byte subscribers are called before the line ones, wait for both
+    CHECK(r.wait([&]{return r.bytes.size() == 12 && r.lines.size() == 3;}));
+    {
+        std::lock_guard<std::mutex> lock(r.mtx);
+        CHECK(r.bytes == std::string("ab\r\ncd\nefg\n\x05", 12));
+        CHECK(r.frames >= 2);
+        //a line split across reads is joined, \r is dropped
+        CHECK(r.lines == std::vector<std::string>{"ab", "cd", "efg"});
+    }
+    pty.close_port();
+    reader.wait_stopped();
+}
+
+TEST_CASE("serial reader buffers lines only for line subscribers and cuts long ones") {
+    PtyPort pty;
+    std::vector<std::string> logged;
+    AsyncSerialReader reader(pty.port, [&](std::string s){logged.push_back(s);});
+    Received r;
+    reader.subscribe(FRAME_BYTES, [&](const SerialFrame& f) {
+        std::lock_guard<std::mutex> lock(r.mtx);
+        r.bytes += f.data;
+        r.cv.notify_all();
+    });
+    reader.start();
+    //read while nobody wants lines, so the partial line is not kept
+    pty.send("abc");
+    CHECK(r.wait([&]{return r.bytes.size() == 3;}));
+    reader.subscribe(FRAME_LINES, [&](const SerialFrame& f) {
+        std::lock_guard<std::mutex> lock(r.mtx);
+        r.lines.push_back(f.data);
+        r.cv.notify_all();
+    });
+    pty.send("def\n");
+    CHECK(r.wait([&]{return r.lines.size() == 1;}));
+
+    pty.send(std::string(AsyncSerialReader::MAX_LINE + 1000, 'x') + "\n" + std::string(AsyncSerialReader::MAX_LINE + 1, 'y') + "\nok\n");
+    CHECK(r.wait([&]{return r.lines.size() == 4;}));
+    pty.close_port();
+    reader.wait_stopped();
+    std::lock_guard<std::mutex> lock(r.mtx);
+    REQUIRE(r.lines.size() == 4);
+    CHECK(r.lines[0] == "def");
+    CHECK(r.lines[1] == std::string(AsyncSerialReader::MAX_LINE, 'x'));
+    CHECK(r.lines[2] == std::string(AsyncSerialReader::MAX_LINE, 'y'));
+    CHECK(r.lines[3] == "ok");
+    CHECK(logged.size() == 1);
+}
+
+TEST_CASE("serial reader stops once its port is closed") {
+    PtyPort pty;
+    Received r;
+    {
+        AsyncSerialReader reader(pty.port);
+        reader.subscribe(FRAME_BYTES, [&](const SerialFrame& f) {
+            std::lock_guard<std::mutex> lock(r.mtx);
+            r.bytes += f.data;
+            r.cv.notify_all();
+        });
+        reader.start();
+        pty.send("x");
+        CHECK(r.wait([&]{return r.bytes == "x";}));
+        pty.close_port();
+        reader.wait_stopped();
+        //the reader can go away now, no completion is left to call into it
+    }
+    std::lock_guard<std::mutex> lock(r.mtx);
+    CHECK(r.bytes == "x");
+}
+
+#endif
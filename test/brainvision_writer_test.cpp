@@ -0,0 +1,137 @@
+#include <doctest.h>
+#include "brainvision_writer.hpp"
+#include "edf_writer.hpp"
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+
+static std::string slurp(const std::string& path) {
+    std::ifstream in(path, std::ios::binary);
+    return std::string((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+}
+
+TEST_CASE("BrainVision triplet with held vitals and trigger markers") {
+    const std::string base = "bv_test";
+    {
+        BrainVisionWriter w;
+        REQUIRE(w.open(base));
+        w.stimulus(10, 3); //before the first sample, nowhere to put it
+        std::vector<short> samples(100);
+        std::vector<long long> ts(100);
+        long long t = 2000;
+        for (int packet = 0; packet < 10; packet++) {
+            for (int i = 0; i < 100; i++) {
+                ts[i] = t;
+                samples[i] = (short)((t - 2000) / 2); //the point the sample belongs at
+                //five 500 Hz samples missing in the third packet
+                t += packet == 2 && i == 49 ? 12 : 2;
+            }
+            libct_vitals_t v = {};
+            v.valid = true;
+            v.timestamp = (unsigned long long)ts[50];
+            v.heart_rate = (short)(60 + packet);
+            libct_stream_data_t data = {};
+            data.int_pulse.samples = samples.data();
+            data.int_pulse.timestamps = ts.data();
+            data.int_pulse.count = 100;
+            data.vitals.datapoints = &v;
+            data.vitals.count = 1;
+            w.push(&data);
+        }
+        w.stimulus(2500, 7);
+        w.comment(2600, "gap timeout, reconnect");
+        w.close();
+        CHECK(w.points() == 1005);
+        CHECK(w.markers() == 3);
+    }
+
+    std::string vhdr = slurp(base + ".vhdr");
+    CHECK(vhdr.find("DataFile=bv_test.eeg\n") != std::string::npos);
+    CHECK(vhdr.find("MarkerFile=bv_test.vmrk\n") != std::string::npos);
+    CHECK(vhdr.find("DataOrientation=MULTIPLEXED\n") != std::string::npos);
+    CHECK(vhdr.find("NumberOfChannels=" + std::to_string(EdfWriter::signals().size()) + "\n") != std::string::npos);
+    CHECK(vhdr.find("SamplingInterval=2000\n") != std::string::npos);
+    CHECK(vhdr.find("BinaryFormat=IEEE_FLOAT_32\n") != std::string::npos);
+    CHECK(vhdr.find("Ch1=Pulse,,1,AU\n") != std::string::npos);
+    CHECK(vhdr.find("Ch5=HR,,1,bpm\n") != std::string::npos);
+
+    std::string eeg = slurp(base + ".eeg");
+    size_t channels = EdfWriter::signals().size();
+    REQUIRE(eeg.size() == 1005 * channels * sizeof(float));
+    auto value = [&](size_t point, size_t channel) {
+        float f;
+        std::memcpy(&f, eeg.data() + (point * channels + channel) * sizeof(float), sizeof(f));
+        return f;
+    };
+    CHECK(value(0, 0) == 0.0f);
+    CHECK(value(249, 0) == 249.0f);
+    //the dropout is filled with the last sample and positions stay on device time
+    CHECK(value(252, 0) == 249.0f);
+    CHECK(value(255, 0) == 255.0f);
+    //heart rate changes at the point of its own timestamp
+    CHECK(value(49, 4) == 0.0f);
+    CHECK(value(50, 4) == 60.0f);
+    CHECK(value(149, 4) == 60.0f);
+    CHECK(value(150, 4) == 61.0f);
+
+    std::string vmrk = slurp(base + ".vmrk");
+    CHECK(vmrk.find("DataFile=bv_test.eeg\n") != std::string::npos);
+    CHECK(vmrk.find("Mk1=New Segment,,1,1,0,") != std::string::npos);
+    CHECK(vmrk.find("Mk2=Stimulus,S  7,251,1,0\n") != std::string::npos);
+    CHECK(vmrk.find("Mk3=Comment,gap timeout\\1 reconnect,301,1,0\n") != std::string::npos);
+    for (const char* ext : {".vhdr", ".vmrk", ".eeg"}) std::remove((base + ext).c_str());
+}
+
+TEST_CASE("BrainVision starts a new segment after a pause instead of filling it") {
+    const std::string base = "bv_pause";
+    {
+        BrainVisionWriter w;
+        REQUIRE(w.open(base));
+        std::vector<short> samples(100);
+        std::vector<long long> ts(100);
+        libct_stream_data_t data = {};
+        data.int_pulse.samples = samples.data();
+        data.int_pulse.timestamps = ts.data();
+        data.int_pulse.count = 100;
+        //more vitals rows than are queued, with no waveform to place them
+        std::vector<libct_vitals_t> vitals(BRAINVISION_MAX_CHANGES + 10);
+        for (size_t i = 0; i < vitals.size(); i++) {
+            vitals[i] = {};
+            vitals[i].valid = true;
+            vitals[i].timestamp = 100000 + i;
+            vitals[i].heart_rate = (short)i;
+        }
+        //200 ms of pulse at 1000 and at 60000, the vitals arrive during the pause
+        for (long long start : {1000LL, 60000LL}) {
+            for (int i = 0; i < 100; i++) {
+                ts[i] = start + 2 * i;
+                samples[i] = (short)i;
+            }
+            w.push(&data);
+            libct_stream_data_t v = {};
+            v.vitals.datapoints = vitals.data();
+            v.vitals.count = (unsigned int)vitals.size();
+            if (start == 1000) w.push(&v);
+        }
+        w.stimulus(60100, 5);
+        w.close();
+        CHECK(w.points() == 200);
+        CHECK(w.late_samples() == 0);
+    }
+    std::string vmrk = slurp(base + ".vmrk");
+    CHECK(vmrk.find("Mk1=New Segment,,1,1,0,") != std::string::npos);
+    CHECK(vmrk.find("Mk2=New Segment,,101,1,0,") != std::string::npos);
+    //positions count from the segment's own start
+    CHECK(vmrk.find("Mk3=Stimulus,S  5,151,1,0\n") != std::string::npos);
+    std::string eeg = slurp(base + ".eeg");
+    size_t channels = EdfWriter::signals().size();
+    REQUIRE(eeg.size() == 200 * channels * sizeof(float));
+    float f;
+    std::memcpy(&f, eeg.data() + (100 * channels) * sizeof(float), sizeof(f));
+    CHECK(f == 0.0f);
+    //the rows pushed out of the full queue were applied, the rest are still ahead of the waveform
+    std::memcpy(&f, eeg.data() + (199 * channels + 4) * sizeof(float), sizeof(f));
+    CHECK(f == 9.0f);
+    for (const char* ext : {".vhdr", ".vmrk", ".eeg"}) std::remove((base + ext).c_str());
+}
@@ -0,0 +1,113 @@
+#include <doctest.h>
+#include "connection_strategy.hpp"
+#include "libct_stub.hpp"
+
+typedef std::vector<std::string> Calls;
+
+static KnownDevice known(const std::string& address, uint64_t seen_ms, uint64_t connected_ms) {
+    KnownDevice d;
+    d.address = address;
+    d.last_seen_ms = seen_ms;
+    d.last_connected_ms = connected_ms;
+    return d;
+}
+
+TEST_CASE("known devices order by last connection, then last sighting") {
+    std::vector<KnownDevice> devices = {known("A", 50, 0), known("B", 10, 20), known("C", 60, 0), known("D", 5, 30)};
+    ConnectionStrategy::order(devices);
+    REQUIRE(devices.size() == 4);
+    CHECK(devices[0].address == "D");
+    CHECK(devices[1].address == "B");
+    CHECK(devices[2].address == "C");
+    CHECK(devices[3].address == "A");
+}
+
+TEST_CASE("remembering a device updates it in place and keeps the cache bounded") {
+    std::vector<KnownDevice> devices;
+    ConnectionStrategy::remember(devices, "", "nameless", 1, 0); //no address, nothing to reconnect to
+    CHECK(devices.empty());
+    for (size_t i = 0; i < ConnectionStrategy::MAX_KNOWN; i++)
+        ConnectionStrategy::remember(devices, "dev" + std::to_string(i), "", 100 + i, 0);
+    ConnectionStrategy::remember(devices, "dev0", "Caretaker 0", 90, 500);
+    REQUIRE(devices.size() == ConnectionStrategy::MAX_KNOWN);
+    CHECK(devices[0].address == "dev0");
+    CHECK(devices[0].name == "Caretaker 0");
+    CHECK(devices[0].last_seen_ms == 100); //an older sighting does not move it back
+    CHECK(devices[0].last_connected_ms == 500);
+
+    //a new device pushes out the one seen longest ago
+    ConnectionStrategy::remember(devices, "new", "", 1000, 0);
+    REQUIRE(devices.size() == ConnectionStrategy::MAX_KNOWN);
+    CHECK(devices[1].address == "new");
+    for (auto& d : devices) CHECK(d.address != "dev1");
+    ConnectionStrategy::remember(devices, "new", "", 1001, 0);
+    CHECK(devices.size() == ConnectionStrategy::MAX_KNOWN);
+}
+
+TEST_CASE("known devices are tried in turn before discovery") {
+    libct_stub.reset();
+    libct_context_t* context = nullptr;
+    ConnectionStrategy strategy(context, [](std::string){});
+    std::vector<std::string> reported;
+    strategy.on_device = [&](const std::string& address, const std::string&, bool connected) {
+        reported.push_back(address + (connected ? " connected" : " seen"));
+    };
+    REQUIRE(strategy.start({known("A", 1, 0), known("B", 2, 5)}, 1000));
+    CHECK(libct_stub.calls == Calls{"connect B"});
+
+    //a late failure of another address does not skip the attempt in flight
+    libct_stub.device_address = "A";
+    strategy.on_connect_failed(&libct_stub.device);
+    CHECK(libct_stub.calls.size() == 1);
+    libct_stub.device_address = "B";
+    strategy.on_connect_failed(&libct_stub.device);
+    CHECK(libct_stub.calls == Calls{"connect B", "connect A"});
+    libct_stub.device_address = "A";
+    strategy.on_connect_failed(&libct_stub.device);
+    CHECK(libct_stub.calls == Calls{"connect B", "connect A", "stop discovery", "start discovery"});
+    CHECK(strategy.active());
+
+    libct_stub.calls.clear();
+    libct_stub.device_address = "C";
+    libct_stub.device_name = "Caretaker C";
+    strategy.on_discovered(&libct_stub.device);
+    CHECK(libct_stub.calls == Calls{"stop discovery", "connect device C"});
+    strategy.on_connected(&libct_stub.device);
+    CHECK_FALSE(strategy.active());
+    CHECK(reported == std::vector<std::string>{"C seen", "C connected"});
+}
+
+TEST_CASE("callbacks run from inside libct calls neither deadlock nor advance twice") {
+    libct_stub.reset();
+    libct_context_t* context = nullptr;
+    ConnectionStrategy strategy(context, [](std::string){});
+    strategy.direct_timeout_ms = 0;
+    //the first known device fails before libct_connect_to_address returns
+    libct_stub.on_call = [&](const std::string& call) {
+        if (call == "connect B") {
+            libct_stub.device_address = "B";
+            strategy.on_connect_failed(&libct_stub.device);
+        }
+    };
+    REQUIRE(strategy.start({known("A", 1, 0), known("B", 2, 5)}, 1000));
+    CHECK(libct_stub.calls == Calls{"connect B", "connect A"});
+
+    //abandoning A reports its failure from inside libct_disconnect
+    libct_stub.on_call = [&](const std::string& call) {
+        if (call == "disconnect") {
+            libct_stub.device_address = "A";
+            strategy.on_connect_failed(&libct_stub.device);
+            strategy.on_connect_failed(nullptr);
+        }
+    };
+    strategy.tick();
+    CHECK(libct_stub.calls == Calls{"connect B", "connect A", "disconnect", "stop discovery", "start discovery"});
+
+    libct_stub.on_call = [&](const std::string& call) {
+        if (call == "connect device C") strategy.on_connected(&libct_stub.device);
+    };
+    libct_stub.device_address = "C";
+    strategy.on_discovered(&libct_stub.device);
+    CHECK_FALSE(strategy.active());
+    libct_stub.reset();
+}
@@ -0,0 +1,94 @@
+#include <doctest.h>
+#include "connection_supervisor.hpp"
+#include "libct_stub.hpp"
+#include <thread>
+
+typedef std::vector<std::string> Calls;
+
+static void sleep_ms(int ms) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+TEST_CASE("a stalled link is dropped and the gap closes when data resumes") {
+    libct_stub.reset();
+    libct_context_t* context = nullptr;
+    ConnectionSupervisor sup(context, [](std::string){});
+    sup.stall_timeout_ms = 10;
+    std::vector<DataGap> gaps;
+    sup.on_gap = [&](const DataGap& g) {gaps.push_back(g);};
+    libct_stub.device_address = "AA:BB";
+    sup.on_connected(&libct_stub.device);
+    sup.set_measuring(true);
+    sup.on_data(100);
+    sup.tick();
+    CHECK(libct_stub.calls.empty());
+
+    //libct reports the disconnect before libct_disconnect returns, the supervisor lock must be free by then
+    libct_stub.on_call = [&](const std::string& call) {if (call == "disconnect") sup.on_disconnected();};
+    sleep_ms(30);
+    sup.tick();
+    CHECK(libct_stub.calls == Calls{"disconnect", "connect AA:BB"});
+    CHECK(sup.gaps() == 0);
+
+    sup.on_connected(&libct_stub.device);
+    sup.on_data(5000);
+    REQUIRE(gaps.size() == 1);
+    CHECK(sup.gaps() == 1);
+    CHECK(gaps[0].reason == "data stalled");
+    CHECK(gaps[0].last_device_ts == 100);
+    CHECK(gaps[0].first_device_ts == 5000);
+    CHECK(gaps[0].pc_end_ms >= gaps[0].pc_start_ms);
+}
+
+TEST_CASE("reconnect attempts back off and wait for the previous one") {
+    libct_stub.reset();
+    libct_context_t* context = nullptr;
+    ConnectionSupervisor sup(context, [](std::string){});
+    sup.backoff_min_ms = 20;
+    sup.backoff_max_ms = 40;
+    sup.discover_timeout_ms = 30;
+    sup.attempt_timeout_ms = 200;
+    sup.attempts_before_discovery = 2;
+    libct_stub.device_address = "AA:BB";
+    sup.on_connected(&libct_stub.device);
+    sup.on_disconnected();
+
+    sup.tick();
+    CHECK(libct_stub.calls == Calls{"connect AA:BB"});
+    sup.tick(); //inside the backoff
+    sleep_ms(50);
+    sup.tick(); //backoff over, the attempt is still running
+    CHECK(libct_stub.calls.size() == 1);
+
+    sup.on_attempt_failed();
+    sup.tick();
+    CHECK(libct_stub.calls == Calls{"connect AA:BB", "connect AA:BB"});
+
+    //every third attempt falls back to discovery
+    libct_stub.calls.clear();
+    sleep_ms(50);
+    sup.on_attempt_failed();
+    sup.tick();
+    CHECK(libct_stub.calls == Calls{"stop discovery", "start discovery"});
+
+    //an attempt libct never answers is given up after attempt_timeout_ms
+    libct_stub.calls.clear();
+    sleep_ms(50);
+    sup.tick();
+    CHECK(libct_stub.calls.empty());
+    sleep_ms(200);
+    libct_stub.result = LIBCT_STATUS_ERROR;
+    sup.tick();
+    CHECK(libct_stub.calls == Calls{"connect AA:BB"});
+
+    //one that failed to start does not hold up the next
+    sleep_ms(50);
+    sup.tick();
+    CHECK(libct_stub.calls.size() == 2);
+
+    libct_stub.calls.clear();
+    sup.on_connected(&libct_stub.device);
+    sleep_ms(50);
+    sup.tick();
+    CHECK(libct_stub.calls.empty());
+}
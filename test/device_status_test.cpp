@@ -0,0 +1,59 @@
+#include <doctest.h>
+#include "device_status.hpp"
+#include "session_store.hpp"
+#include <cstdio>
+
+TEST_CASE("device status packs into one word and back") {
+    libct_device_status_t s = {};
+    s.motion_event = true;
+    s.cuff_too_loose = true;
+    s.cardiac_output_calibrated = true;
+    s.autocal_pct = 87;
+    s.posture = 2;
+    uint64_t word = pack_device_status(s);
+    CHECK(status_flag(word, STATUS_motion_event));
+    CHECK(status_flag(word, STATUS_cuff_too_loose));
+    CHECK(status_flag(word, STATUS_cardiac_output_calibrated));
+    CHECK_FALSE(status_flag(word, STATUS_poor_signal));
+    CHECK(status_autocal_pct(word) == 87);
+    CHECK(status_posture(word) == 2);
+
+    libct_device_status_t out = {};
+    unpack_device_status(word, out);
+    CHECK(out.motion_event);
+    CHECK(out.cuff_too_loose);
+    CHECK_FALSE(out.calibrating);
+    CHECK(out.autocal_pct == 87);
+    CHECK(pack_device_status(out) == word);
+    CHECK(std::string(status_flag_name(STATUS_poor_signal)) == "poor signal");
+}
+
+TEST_CASE("the store keeps only status changes") {
+    const char* path = "status_changes.cts";
+    {
+        SessionStoreWriter w;
+        REQUIRE(w.open(path));
+        libct_stream_data_t data = {};
+        data.device_status.valid = true;
+        for (int i = 0; i < 1000; i++) {
+            data.device_status.timestamp = i * 40;
+            data.device_status.calibrating = i >= 100 && i < 400;
+            data.device_status.motion_event = i == 700;
+            w.push(&data);
+        }
+        w.close();
+    }
+    SessionReader r;
+    REQUIRE(r.open(path));
+    std::vector<StoredRow> events;
+    for (auto& row : r.query(CHANNEL_DEVICE_STATUS, INT64_MIN, INT64_MAX)) events.push_back(row);
+    REQUIRE(events.size() == 5);
+    CHECK(events[0].timestamp == 0);
+    CHECK(events[1].timestamp == 100 * 40);
+    CHECK(status_flag((uint64_t)events[1].ints[0], STATUS_calibrating));
+    CHECK(events[2].timestamp == 400 * 40);
+    CHECK(events[3].timestamp == 700 * 40);
+    CHECK(status_flag((uint64_t)events[3].ints[0], STATUS_motion_event));
+    CHECK(events[4].ints[0] == 0);
+    std::remove(path);
+}
@@ -0,0 +1,151 @@
+#include <doctest.h>
+#include "edf_writer.hpp"
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+
+static std::string field(const std::string& file, size_t offset, size_t width) {
+    std::string f = file.substr(offset, width);
+    return f.substr(0, f.find_last_not_of(' ') + 1);
+}
+
+static int16_t sample_at(const std::string& file, size_t offset) {
+    return (int16_t)((uint8_t)file[offset] | ((uint8_t)file[offset + 1] << 8));
+}
+
+//2.5 s of 500 Hz pulse from device time 5000, a vitals row every 500 ms
+static void write_edf(const char* path) {
+    EdfWriter w;
+    REQUIRE(w.open(path));
+    std::vector<short> samples(50);
+    std::vector<long long> ts(50);
+    long long t = 5000;
+    for (int packet = 0; packet < 25; packet++) {
+        for (int i = 0; i < 50; i++) {
+            ts[i] = t;
+            samples[i] = (short)(t % 1000 / 2); //the sample's index within its second
+            t += 2;
+        }
+        libct_vitals_t v = {};
+        v.valid = packet % 5 == 0;
+        v.timestamp = (unsigned long long)ts[0];
+        v.systolic = (short)(100 + packet);
+        libct_stream_data_t data = {};
+        data.int_pulse.samples = samples.data();
+        data.int_pulse.timestamps = ts.data();
+        data.int_pulse.count = 50;
+        data.vitals.datapoints = &v;
+        data.vitals.count = 1;
+        w.push(&data);
+        if (packet == 12) w.annotate(6250, "7");
+    }
+    //a sample behind every open record cannot be placed
+    short old = 1;
+    long long old_ts = 4000;
+    libct_stream_data_t data = {};
+    data.int_pulse.samples = &old;
+    data.int_pulse.timestamps = &old_ts;
+    data.int_pulse.count = 1;
+    w.push(&data);
+    CHECK(w.late_samples() == 1);
+    w.close();
+    CHECK(w.records() == 3);
+}
+
+TEST_CASE("EDF+ header and records") {
+    const char* path = "edf_test.edf";
+    write_edf(path);
+    std::ifstream in(path, std::ios::binary);
+    std::string file((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    int ns = (int)EdfWriter::signals().size() + 1;
+    size_t header = 256 * (ns + 1);
+
+    CHECK(field(file, 0, 8) == "0");
+    CHECK(field(file, 184, 8) == std::to_string(header));
+    CHECK(field(file, 192, 44) == "EDF+D");
+    CHECK(field(file, EDF_COUNT_OFFSET, 8) == "3");
+    CHECK(field(file, 244, 8) == "1");
+    CHECK(field(file, 252, 4) == std::to_string(ns));
+    CHECK(field(file, 256, 16) == "Pulse");
+    CHECK(field(file, 256 + 16 * (ns - 1), 16) == "EDF Annotations");
+
+    size_t record = 0;
+    for (auto& s : EdfWriter::signals()) record += s.hz * EDF_RECORD_MS / 1000 * 2;
+    record += EDF_ANNOTATION_BYTES;
+    REQUIRE(file.size() == header + 3 * record);
+
+    //pulse is on the grid from the first sample, the tail of the last record holds the last value
+    CHECK(EdfWriter::signals()[0].hz == 500);
+    CHECK(sample_at(file, header) == 0);
+    CHECK(sample_at(file, header + 2 * 499) == 499);
+    CHECK(sample_at(file, header + record) == 0);
+    CHECK(sample_at(file, header + 2 * record + 2 * 249) == 249);
+    CHECK(sample_at(file, header + 2 * record + 2 * 499) == 249);
+
+    //systolic is held between the valid rows at 0, 500 ms, 1000 ms ...
+    size_t systolic = header + 2 * 500;
+    CHECK(sample_at(file, systolic) == 100);
+    CHECK(sample_at(file, systolic + 2 * 4) == 100);
+    CHECK(sample_at(file, systolic + 2 * 5) == 105);
+    CHECK(sample_at(file, systolic + record + 2 * 9) == 115);
+
+    //time-keeping TAL in every record, the trigger in the record it falls in
+    size_t tal = header + record - EDF_ANNOTATION_BYTES;
+    CHECK(std::memcmp(file.data() + tal, "+0\x14\x14\0", 5) == 0);
+    CHECK(std::memcmp(file.data() + tal + record, "+1\x14\x14\0+1.250\x14" "7\x14\0", 15) == 0);
+    CHECK(std::memcmp(file.data() + tal + 2 * record, "+2\x14\x14\0\0", 6) == 0);
+    in.close();
+    std::remove(path);
+}
+
+TEST_CASE("EDF+ without samples is a valid empty file") {
+    const char* path = "edf_empty.edf";
+    {
+        EdfWriter w;
+        REQUIRE(w.open(path));
+        w.annotate(100, "ignored");
+        w.close();
+        CHECK(w.records() == 0);
+    }
+    std::ifstream in(path, std::ios::binary);
+    std::string file((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    CHECK(file.size() == 256 * (EdfWriter::signals().size() + 2));
+    CHECK(field(file, EDF_COUNT_OFFSET, 8) == "0");
+    in.close();
+    std::remove(path);
+}
+
+TEST_CASE("EDF+ leaves the seconds of a pause out") {
+    const char* path = "edf_pause.edf";
+    {
+        EdfWriter w;
+        REQUIRE(w.open(path));
+        std::vector<short> samples(500, 1);
+        std::vector<long long> ts(500);
+        libct_stream_data_t data = {};
+        data.int_pulse.samples = samples.data();
+        data.int_pulse.timestamps = ts.data();
+        data.int_pulse.count = 500;
+        //one second of pulse, an hour of nothing, another second
+        for (long long start : {0LL, 3600000LL}) {
+            for (int i = 0; i < 500; i++) ts[i] = start + 2 * i;
+            w.push(&data);
+        }
+        w.close();
+        CHECK(w.records() == 2);
+        CHECK(w.late_samples() == 0);
+    }
+    std::ifstream in(path, std::ios::binary);
+    std::string file((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    size_t header = 256 * (EdfWriter::signals().size() + 2);
+    size_t record = 0;
+    for (auto& s : EdfWriter::signals()) record += s.hz * EDF_RECORD_MS / 1000 * 2;
+    record += EDF_ANNOTATION_BYTES;
+    REQUIRE(file.size() == header + 2 * record);
+    CHECK(field(file, EDF_COUNT_OFFSET, 8) == "2");
+    //the second record says where it belongs
+    CHECK(std::memcmp(file.data() + header + 2 * record - EDF_ANNOTATION_BYTES, "+3600\x14\x14\0", 8) == 0);
+    in.close();
+    std::remove(path);
+}
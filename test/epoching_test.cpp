@@ -0,0 +1,157 @@
+#include <doctest.h>
+#include "epoching.hpp"
+#include <cstdio>
+#include <cstring>
+
+TEST_CASE("history ring overwrites the oldest and searches by timestamp") {
+    HistoryRing<PulseSample> ring;
+    ring.push({1, 1}); //no capacity yet, dropped
+    CHECK(ring.size() == 0);
+    ring.reserve(4);
+    for (long long t = 10; t <= 60; t += 10) ring.push({t, (short)t});
+    REQUIRE(ring.size() == 4);
+    CHECK(ring.at(0).timestamp == 30);
+    CHECK(ring.back().timestamp == 60);
+    CHECK(ring.lower_bound(0) == 0);
+    CHECK(ring.lower_bound(35) == 1);
+    CHECK(ring.lower_bound(40) == 1);
+    CHECK(ring.lower_bound(61) == 4);
+
+    std::vector<PulseSample> out;
+    ring.copy_range(35, 50, out);
+    REQUIRE(out.size() == 2);
+    CHECK(out[0].value == 40);
+    CHECK(out[1].value == 50);
+    ring.clear();
+    CHECK(ring.size() == 0);
+}
+
+static void push_ms(EpochEngine& e, long long from, long long to) {
+    std::vector<short> values;
+    std::vector<long long> ts;
+    for (long long t = from; t <= to; t++) {
+        values.push_back((short)(t % 1000));
+        ts.push_back(t);
+    }
+    e.push_pulse(values.data(), ts.data(), (unsigned int)ts.size());
+}
+
+TEST_CASE("epoch engine maps the trigger time and cuts the window once it has passed") {
+    EpochConfig config;
+    config.pre_ms = 100;
+    config.post_ms = 200;
+    EpochEngine engine(config);
+    std::vector<Epoch> epochs;
+    engine.on_epoch = [&](const Epoch& e) {epochs.push_back(e);};
+    CHECK(engine.add_trigger(1) == -1); //nothing to lock to yet
+
+    auto sent = std::chrono::steady_clock::now() - std::chrono::milliseconds(50);
+    push_ms(engine, 1000, 1500);
+    //a trigger sent 50 ms before the latest packet arrived lands at least 50 ms before its last sample
+    long long anchor = engine.add_trigger(7, sent);
+    CHECK(anchor <= 1450);
+    CHECK(anchor >= 1440);
+    CHECK(engine.pending() == 1);
+
+    push_ms(engine, 1501, anchor + 199);
+    CHECK(epochs.empty());
+    push_ms(engine, anchor + 200, anchor + 300);
+    REQUIRE(epochs.size() == 1);
+    CHECK(engine.pending() == 0);
+    CHECK(epochs[0].trigger == 7);
+    CHECK(epochs[0].anchor == anchor);
+    REQUIRE(epochs[0].pulse.size() == 301);
+    CHECK(epochs[0].pulse.front().timestamp == anchor - 100);
+    CHECK(epochs[0].pulse.back().timestamp == anchor + 200);
+
+    engine.reset();
+    CHECK(engine.add_trigger(2) == -1);
+}
+
+TEST_CASE("epoch engine writes its file header and epochs") {
+    const char* path = "epoch_test.epochs";
+    EpochConfig config;
+    config.pre_ms = 10;
+    config.post_ms = 20;
+    {
+        EpochEngine engine(config);
+        REQUIRE(engine.open(path));
+        push_ms(engine, 0, 100);
+        long long anchor = engine.add_trigger(3);
+        push_ms(engine, 101, anchor + 20);
+        CHECK(engine.written() == 1);
+        engine.close();
+    }
+    FILE* f = fopen(path, "rb");
+    REQUIRE(f);
+    char magic[8];
+    int32_t pre = 0, post = 0, trigger = 0;
+    int64_t anchor = 0;
+    uint32_t n_pulse = 0, n_vitals = 0;
+    REQUIRE(fread(magic, 1, 8, f) == 8);
+    CHECK(memcmp(magic, "CTEPOCH2", 8) == 0);
+    REQUIRE(fread(&pre, 4, 1, f) == 1);
+    REQUIRE(fread(&post, 4, 1, f) == 1);
+    CHECK(pre == 10);
+    CHECK(post == 20);
+    REQUIRE(fread(&trigger, 4, 1, f) == 1);
+    REQUIRE(fread(&anchor, 8, 1, f) == 1);
+    REQUIRE(fread(&n_pulse, 4, 1, f) == 1);
+    REQUIRE(fread(&n_vitals, 4, 1, f) == 1);
+    CHECK(trigger == 3);
+    CHECK(n_pulse == 31);
+    CHECK(n_vitals == 0);
+    fclose(f);
+    std::remove(path);
+}
+
+TEST_CASE("epoch vitals merge both streams in time order and leave out fields not yet reported") {
+    EpochConfig config;
+    config.pre_ms = 100;
+    config.post_ms = 200;
+    EpochEngine engine(config);
+    std::vector<Epoch> epochs;
+    engine.on_epoch = [&](const Epoch& e) {epochs.push_back(e);};
+    push_ms(engine, 0, 1000);
+    long long anchor = engine.add_trigger(1);
+
+    //vitals arrive ahead of vitals2, whose batch covers earlier times
+    libct_vitals_t v[2] = {};
+    v[0].timestamp = anchor - 150;
+    v[0].systolic = 120;
+    v[1].timestamp = anchor + 50;
+    v[1].systolic = 125;
+    engine.push_vitals(v, 2);
+    libct_vitals2_t v2[2] = {};
+    v2[0].timestamp = anchor - 20;
+    v2[0].strokeVolume = 70;
+    v2[1].timestamp = anchor + 50;
+    v2[1].strokeVolume = 72;
+    engine.push_vitals2(v2, 2);
+    push_ms(engine, 1001, anchor + 200);
+
+    REQUIRE(epochs.size() == 1);
+    const std::vector<VitalsSample>& vitals = epochs[0].vitals;
+    REQUIRE(vitals.size() == 2);
+    //systolic is held from the update before the window opened
+    CHECK((long long)vitals[0].timestamp == anchor - 20);
+    CHECK(vitals[0].systolic == 120);
+    CHECK(vitals[0].stroke_volume == 70);
+    CHECK(vitals[0].valid == (VITALS_VALID_PRESSURE | VITALS_VALID_OUTPUT));
+    //both streams at the same time are one sample
+    CHECK((long long)vitals[1].timestamp == anchor + 50);
+    CHECK(vitals[1].systolic == 125);
+    CHECK(vitals[1].stroke_volume == 72);
+
+    //an epoch before any vitals2 leaves stroke volume and cardiac output out
+    epochs.clear();
+    engine.reset();
+    push_ms(engine, 0, 1000);
+    anchor = engine.add_trigger(2);
+    v[0].timestamp = anchor;
+    engine.push_vitals(v, 1);
+    push_ms(engine, 1001, anchor + 200);
+    REQUIRE(epochs.size() == 1);
+    REQUIRE(epochs[0].vitals.size() == 1);
+    CHECK(epochs[0].vitals[0].valid == VITALS_VALID_PRESSURE);
+}
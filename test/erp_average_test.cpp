@@ -0,0 +1,64 @@
+#include <doctest.h>
+#include "erp_average.hpp"
+
+TEST_CASE("welford bins match the two-pass mean and variance") {
+    WelfordBins w;
+    w.resize(1);
+    double xs[] = {2, 4, 4, 4, 5, 5, 7, 9};
+    for (double x : xs) w.add(0, x);
+    CHECK(w.n[0] == 8);
+    CHECK(w.mean[0] == doctest::Approx(5.0));
+    CHECK(w.variance(0) == doctest::Approx(32.0 / 7.0));
+}
+
+TEST_CASE("epochs are averaged per trigger value") {
+    EpochConfig config;
+    config.pre_ms = 20;
+    config.post_ms = 20;
+    ErpAverages erp(config, 10);
+    CHECK(erp.bins() == 5);
+
+    Epoch e;
+    e.trigger = 3;
+    e.anchor = 1000;
+    for (long long t = 980; t <= 1020; t++) e.pulse.push_back({t, 10});
+    CHECK(erp.add_epoch(e));
+    for (auto& s : e.pulse) s.value = 20;
+    CHECK(erp.add_epoch(e));
+    e.trigger = 11;
+    CHECK_FALSE(erp.add_epoch(e));
+
+    ErpSnapshot snap;
+    erp.snapshot(3, snap);
+    CHECK(snap.epochs == 2);
+    CHECK(snap.pulse_mean[2] == doctest::Approx(15.0));
+    CHECK(snap.pulse_hi[2] > snap.pulse_mean[2]);
+    erp.snapshot(4, snap);
+    CHECK(snap.epochs == 0);
+}
+
+TEST_CASE("vitals not yet reported are left out of the averages") {
+    EpochConfig config;
+    config.pre_ms = 20;
+    config.post_ms = 20;
+    ErpAverages erp(config, 10);
+    Epoch e;
+    e.trigger = 1;
+    e.anchor = 1000;
+    VitalsSample v = {};
+    v.timestamp = 1005;
+    v.systolic = 120;
+    v.valid = VITALS_VALID_PRESSURE;
+    e.vitals.push_back(v);
+    CHECK(erp.add_epoch(e));
+    CHECK(erp.summary(1).find("stroke_volume -") != std::string::npos);
+
+    e.vitals[0].stroke_volume = 70;
+    e.vitals[0].valid = VITALS_VALID_PRESSURE | VITALS_VALID_OUTPUT;
+    CHECK(erp.add_epoch(e));
+    ErpSnapshot snap;
+    erp.snapshot(1, snap);
+    CHECK(snap.vital_mean[ERP_SYSTOLIC] == doctest::Approx(120.0));
+    //only the second epoch had a stroke volume, the first does not pull it towards 0
+    CHECK(snap.vital_mean[ERP_STROKE_VOLUME] == doctest::Approx(70.0));
+}
@@ -0,0 +1,52 @@
+#include <doctest.h>
+#include "json_value.hpp"
+
+TEST_CASE("json parses and writes back") {
+    JsonValue v = json_parse(" {\"a\": [1, -2, 3.5, true, null], \"s\": \"q\\\"\\n\\u00e9\\ud83d\\ude00\", \"big\": 1700000000123, \"o\": {}} ");
+    REQUIRE(v.is_object());
+    const auto& a = v.at("a").as_array();
+    REQUIRE(a.size() == 5);
+    CHECK(a[0].as_int() == 1);
+    CHECK(a[1].as_int() == -2);
+    CHECK(a[2].as_real() == 3.5);
+    CHECK_THROWS(a[2].as_int());
+    CHECK(a[3].as_bool());
+    CHECK(a[4].type() == JSON_NULL);
+    CHECK(v.at("s").as_string() == "q\"\n\xc3\xa9\xf0\x9f\x98\x80");
+    CHECK(v.at("big").as_int() == 1700000000123LL);
+    CHECK(v.at("o").as_members().empty());
+    CHECK(v.find("missing") == nullptr);
+    CHECK_THROWS(v.at("missing"));
+    CHECK_THROWS(v.at("s").as_int());
+
+    std::string text = json_write(v, 0);
+    CHECK(text == "{\"a\":[1,-2,3.5,true,null],\"s\":\"q\\\"\\n\xc3\xa9\xf0\x9f\x98\x80\",\"big\":1700000000123,\"o\":{}}");
+    CHECK(json_write(json_parse(json_write(v, 2)), 0) == text);
+}
+
+TEST_CASE("json rejects malformed documents") {
+    for (const char* bad : {"", "{", "[1,]", "{\"a\" 1}", "{\"a\":1,}", "\"open", "01x", "tru", "[1] 2", "\"\\x\"", "\"\\ud800\""})
+        CHECK_THROWS_AS(json_parse(bad), std::runtime_error);
+    std::string deep(100, '[');
+    CHECK_THROWS(json_parse(deep));
+}
+
+TEST_CASE("json typed reads check their range") {
+    JsonValue v = json_parse("[-1, 4294967295, 4294967296, 2.0]");
+    const auto& a = v.as_array();
+    int i = 0;
+    uint32_t u = 0;
+    uint64_t w = 0;
+    json_get(a[0], i);
+    CHECK(i == -1);
+    CHECK_THROWS(json_get(a[0], u));
+    CHECK_THROWS(json_get(a[0], w));
+    json_get(a[1], u);
+    CHECK(u == 4294967295u);
+    CHECK_THROWS(json_get(a[2], u));
+    CHECK_THROWS(json_get(a[2], i));
+    json_get(a[2], w);
+    CHECK(w == 4294967296ull);
+    json_get(a[3], i);
+    CHECK(i == 2);
+}
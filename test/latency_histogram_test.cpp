@@ -0,0 +1,31 @@
+#include <doctest.h>
+#include <thread>
+#include <vector>
+#include "latency_histogram.hpp"
+
+TEST_CASE("histogram buckets stay within the sub-bucket precision") {
+    for (uint64_t v : {0ull, 1ull, 127ull, 128ull, 129ull, 1000ull, 65535ull, 1234567ull, 987654321ull}) {
+        uint64_t hi = LatencyHistogram::highest_equivalent(LatencyHistogram::index_of(v));
+        CHECK(hi >= v);
+        CHECK(hi - v <= v / 64);
+    }
+    CHECK(LatencyHistogram::index_of(~0ull) == LatencyHistogram::BUCKET_COUNT - 1);
+}
+
+TEST_CASE("percentiles from concurrent writers") {
+    LatencyHistogram h;
+    std::vector<std::thread> writers;
+    for (int t = 0; t < 4; t++)
+        writers.emplace_back([&h]{
+            for (uint64_t v = 1; v <= 1000; v++) h.record(v);
+        });
+    for (auto& w : writers) w.join();
+    h.record(50000);
+    CHECK(h.count() == 4001);
+    CHECK(h.max() == 50000);
+    CHECK(h.percentile(50) == doctest::Approx(500).epsilon(0.02));
+    CHECK(h.percentile(99) == doctest::Approx(990).epsilon(0.02));
+    CHECK(h.percentile(100) == 50000);
+    h.reset();
+    CHECK(h.percentile(99) == 0);
+}
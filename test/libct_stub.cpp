@@ -0,0 +1,46 @@
+#include "libct_stub.hpp"
+
+LibctStub libct_stub;
+
+static const char* LIBCTAPI stub_address(libct_device_t*) {
+    return libct_stub.device_address.c_str();
+}
+
+static const char* LIBCTAPI stub_name(libct_device_t*) {
+    return libct_stub.device_name.c_str();
+}
+
+LibctStub::LibctStub() {
+    device.get_address = stub_address;
+    device.get_name = stub_name;
+}
+
+static int record(const std::string& call, int result) {
+    libct_stub.calls.push_back(call);
+    if (libct_stub.on_call) libct_stub.on_call(call);
+    return result;
+}
+
+extern "C" {
+
+int LIBCTAPI libct_connect(libct_context_t*, libct_device_t* device) {
+    return record(std::string("connect device ") + device->get_address(device), libct_stub.result);
+}
+
+int LIBCTAPI libct_connect_to_address(libct_context_t*, const char* address) {
+    return record(std::string("connect ") + address, libct_stub.result);
+}
+
+int LIBCTAPI libct_disconnect(libct_context_t*) {
+    return record("disconnect", LIBCT_STATUS_OK);
+}
+
+int LIBCTAPI libct_start_discovery(libct_context_t*, unsigned long) {
+    return record("start discovery", libct_stub.result);
+}
+
+int LIBCTAPI libct_stop_discovery(libct_context_t*) {
+    return record("stop discovery", LIBCT_STATUS_OK);
+}
+
+}
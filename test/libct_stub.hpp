@@ -0,0 +1,23 @@
+#pragma once
+#include <caretaker_static.h>
+#include <functional>
+#include <string>
+#include <vector>
+
+/* Stand-in for the libct calls made by the connection code, so it can be tested without the library
+ * or a device. Calls are recorded in order; result is returned by the ones that can fail. */
+struct LibctStub {
+    //"connect <address>", "connect device <address>", "disconnect", "start discovery", "stop discovery"
+    std::vector<std::string> calls;
+    int result = LIBCT_STATUS_OK;
+    //runs inside every call, as libct may run its callbacks before returning
+    std::function<void(const std::string&)> on_call;
+    //a device that reports device_address and device_name, for the on_connected/on_discovered hooks
+    libct_device_t device = {};
+    std::string device_address;
+    std::string device_name;
+
+    LibctStub();
+    void reset() {calls.clear(); result = LIBCT_STATUS_OK; on_call = nullptr;}
+};
+extern LibctStub libct_stub;
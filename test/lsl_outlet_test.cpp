@@ -0,0 +1,93 @@
+#include <doctest.h>
+#include "lsl_outlet.hpp"
+#include <vector>
+
+static libct_stream_data_t pulse_packet(std::vector<short>& samples, std::vector<long long>& ts, long long t, libct_vitals_t* v) {
+    for (size_t i = 0; i < samples.size(); i++) {
+        ts[i] = t + 2 * (long long)i; //500 Hz
+        samples[i] = (short)i;
+    }
+    libct_stream_data_t data = {};
+    data.int_pulse.samples = samples.data();
+    data.int_pulse.timestamps = ts.data();
+    data.int_pulse.count = (unsigned int)samples.size();
+    data.vitals.datapoints = v;
+    data.vitals.count = v ? 1 : 0;
+    return data;
+}
+
+TEST_CASE("clock offset keeps the least delayed packet and follows drift") {
+    ClockOffsetFilter filter(10, 3);
+    CHECK_FALSE(filter.valid());
+    //device time runs 100 s behind, packets arrive 5 to 40 ms late
+    CHECK(filter.update(100.040, 0.0) == doctest::Approx(100.040));
+    CHECK(filter.update(100.505, 0.5) == doctest::Approx(100.005));
+    CHECK(filter.update(101.020, 1.0) == doctest::Approx(100.005)); //a slow packet changes nothing
+    CHECK(filter.valid());
+    //the device clock runs slow by 1 ms per 10 s; once the early windows are out of the ring the
+    //estimate has moved with it
+    double device = 1.0;
+    for (int w = 1; w <= 4; w++) {
+        device += 10;
+        filter.update(100.0 + device + 0.001 * w + 0.005, device);
+    }
+    CHECK(filter.offset() == doctest::Approx(100.007));
+    //a device clock that jumps back is a new start, not a 2 s delay
+    CHECK(filter.update(200.0, 97.0) == doctest::Approx(103.0));
+}
+
+#ifdef CARETAKER_LSL
+#include <lsl_cpp.h>
+
+//a local inlet sees the packet as one chunk on the pulse outlet and the trigger on the marker outlet
+TEST_CASE("LSL outlets reach a local inlet") {
+    LslOutlet outlet;
+    REQUIRE(outlet.open("caretaker-test"));
+    auto pulse_info = lsl::resolve_stream("source_id", "caretaker-test-int_pulse", 1, 5.0);
+    auto marker_info = lsl::resolve_stream("source_id", "caretaker-test-markers", 1, 5.0);
+    REQUIRE(pulse_info.size() == 1);
+    REQUIRE(marker_info.size() == 1);
+    CHECK(pulse_info[0].nominal_srate() == 500.0);
+    lsl::stream_inlet pulse(pulse_info[0]);
+    lsl::stream_inlet markers(marker_info[0]);
+    pulse.open_stream(5.0);
+    markers.open_stream(5.0);
+
+    std::vector<short> samples(100);
+    std::vector<long long> ts(100);
+    libct_vitals_t v = {};
+    v.valid = true;
+    v.timestamp = 1050;
+    v.heart_rate = 72;
+    libct_stream_data_t data = pulse_packet(samples, ts, 1000, &v);
+    outlet.push(&data);
+    outlet.marker(1050, 9);
+
+    std::vector<float> sample;
+    double first = pulse.pull_sample(sample, 5.0);
+    REQUIRE(first != 0.0);
+    CHECK(sample[0] == 0.0f);
+    std::vector<std::string> code;
+    double at = markers.pull_sample(code, 5.0);
+    REQUIRE(at != 0.0);
+    CHECK(code[0] == "9");
+    //the marker keeps its device-clock distance from the pulse
+    CHECK(at - first == doctest::Approx(0.05).epsilon(0.01));
+}
+
+#else
+
+TEST_CASE("LSL outlet without LSL support does nothing") {
+    LslOutlet outlet;
+    CHECK_FALSE(LslOutlet::available());
+    CHECK_FALSE(outlet.open("caretaker-test"));
+    CHECK_FALSE(outlet.is_open());
+    std::vector<short> samples(100);
+    std::vector<long long> ts(100);
+    libct_stream_data_t data = pulse_packet(samples, ts, 1000, nullptr);
+    outlet.push(&data);
+    outlet.marker(1050, 9);
+    CHECK_FALSE(outlet.is_open());
+}
+
+#endif
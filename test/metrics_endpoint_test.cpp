@@ -0,0 +1,44 @@
+#include <doctest.h>
+#include "metrics_endpoint.hpp"
+#include "program_state.hpp"
+#include <sstream>
+
+static bool has_line(const std::string& text, const std::string& line) {
+    std::istringstream in(text);
+    for (std::string l; std::getline(in, l);)
+        if (l == line) return true;
+    return false;
+}
+
+TEST_CASE("metrics render the published values in the text format") {
+    Metrics m;
+    m.program_state = RUNNING;
+    m.connected = true;
+    StreamRates rates[STREAM_COUNT] = {};
+    rates[STREAM_INT_PULSE].samples_per_s = 500;
+    rates[STREAM_INT_PULSE].gaps = 3;
+    m.publish_streams(rates);
+    m.triggers = 12;
+    m.wal_sync_max_ms = 1.5;
+    std::string text = m.render();
+
+    CHECK(has_line(text, "# TYPE caretaker_program_state gauge"));
+    CHECK(has_line(text, "caretaker_program_state{state=\"RUNNING\"} 1"));
+    CHECK(has_line(text, "caretaker_program_state{state=\"IDLE\"} 0"));
+    CHECK(has_line(text, "caretaker_device_connected 1"));
+    //stream names become label values with anything but letters and digits folded into _
+    CHECK(has_line(text, "caretaker_stream_samples_per_second{stream=\"int_pulse\"} 500.000"));
+    CHECK(has_line(text, "caretaker_stream_gaps_total{stream=\"int_pulse\"} 3"));
+    CHECK(has_line(text, "caretaker_stream_gaps_total{stream=\"param_pulse\"} 0"));
+    CHECK(has_line(text, "caretaker_latency_us{path=\"trigger_byte\",quantile=\"0.99\"} 0"));
+    CHECK(has_line(text, "# TYPE caretaker_triggers_total counter"));
+    CHECK(has_line(text, "caretaker_triggers_total 12"));
+    CHECK(has_line(text, "caretaker_wal_sync_max_ms 1.500"));
+    //every sample line belongs to a declared metric
+    std::istringstream in(text);
+    std::string declared;
+    for (std::string l; std::getline(in, l);) {
+        if (l.compare(0, 7, "# TYPE ") == 0) declared = l.substr(7, l.find(' ', 7) - 7);
+        else if (l[0] != '#') CHECK(l.compare(0, declared.size(), declared) == 0);
+    }
+}
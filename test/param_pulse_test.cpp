@@ -0,0 +1,112 @@
+#include <doctest.h>
+#include "param_pulse.hpp"
+#include "session_store.hpp"
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+
+//libct hands these out with the waveform inline after the struct
+static libct_param_pulse_t* make_pulse(long long ts, int len) {
+    libct_param_pulse_t* dp = (libct_param_pulse_t*)calloc(1, sizeof(libct_param_pulse_t) + len);
+    dp->valid = true;
+    dp->timestamp = (unsigned long long)ts;
+    dp->t0 = 3; dp->t1 = 40; dp->t2 = 90; dp->t3 = 150;
+    dp->p0 = -12; dp->p1 = 70000; dp->p2 = 52000; dp->p3 = 31000;
+    dp->ibi = 420;
+    dp->as = 7;
+    dp->sqe = 95;
+    dp->pressure = 1800;
+    dp->waveform_len = len;
+    for (int i = 0; i < len; i++) dp->waveform[i] = (char)(i - 64);
+    return dp;
+}
+
+TEST_CASE("param pulse records survive segments with their waveforms") {
+    const char* path = "param_pulse_test.ppulse";
+    const int N = 400; //several 64 KiB segments with 200 byte waveforms
+    {
+        ParamPulseWriter w;
+        REQUIRE(w.open(path));
+        for (int i = 0; i < N; i++) {
+            libct_param_pulse_t* dp = make_pulse(1000 + i * 850, 100 + i % 200);
+            w.push(dp, 1);
+            free(dp);
+        }
+        libct_param_pulse_t* invalid = make_pulse(0, 0);
+        invalid->valid = false;
+        w.push(invalid, 1);
+        free(invalid);
+        w.close();
+        CHECK(w.records() == N);
+    }
+    ParamPulseReader r;
+    REQUIRE(r.open(path));
+    CHECK(r.segments() > 1);
+    CHECK(r.count() == N);
+    std::vector<ParamPulse> all;
+    for (size_t s = 0; s < r.segments(); s++) REQUIRE(r.read_segment(s, all));
+    REQUIRE(all.size() == N);
+    for (int i = 0; i < N; i += 37) {
+        CHECK(all[i].timestamp == 1000 + i * 850);
+        CHECK(all[i].t[3] == 150);
+        CHECK(all[i].p[0] == -12);
+        CHECK(all[i].p[1] == 70000);
+        CHECK(all[i].pressure == 1800);
+        REQUIRE(all[i].waveform.size() == (size_t)(100 + i % 200));
+        CHECK(all[i].waveform[5] == 5 - 64);
+    }
+    ParamPulse last;
+    REQUIRE(r.read_record(r.segments() - 1, 0, last));
+    CHECK(last.ibi == 420);
+    std::remove(path);
+}
+
+TEST_CASE("a torn param pulse segment is dropped, earlier ones still read") {
+    const char* path = "param_pulse_torn.ppulse";
+    {
+        ParamPulseWriter w;
+        REQUIRE(w.open(path));
+        for (int i = 0; i < 2; i++) {
+            libct_param_pulse_t* dp = make_pulse(i, 10);
+            w.push(dp, 1);
+            free(dp);
+            w.flush(); //one segment each
+        }
+    }
+    std::ifstream in(path, std::ios::binary);
+    std::string bytes((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    in.close();
+    std::ofstream(path, std::ios::binary | std::ios::trunc).write(bytes.data(), bytes.size() - 3);
+    ParamPulseReader r;
+    REQUIRE(r.open(path));
+    CHECK(r.segments() == 1);
+    std::remove(path);
+}
+
+TEST_CASE("param pulse decomposition is queryable as store columns") {
+    const char* path = "param_pulse_store.cts";
+    {
+        SessionStoreWriter w;
+        REQUIRE(w.open(path));
+        for (int i = 0; i < 10; i++) {
+            libct_param_pulse_t* dp = make_pulse(i * 1000, 4);
+            dp->p2 = i;
+            libct_stream_data_t data = {};
+            data.param_pulse.datapoints = dp;
+            data.param_pulse.count = 1;
+            w.push(&data);
+            free(dp);
+        }
+        w.close();
+    }
+    SessionReader r;
+    REQUIRE(r.open(path));
+    int rows = 0;
+    for (const StoredRow& row : r.query(CHANNEL_PARAM_PULSE, 2000, 5000)) {
+        CHECK(row.ints[0] == 3);
+        CHECK(row.ints[6] == row.timestamp / 1000);
+        rows++;
+    }
+    CHECK(rows == 4);
+    std::remove(path);
+}
@@ -0,0 +1,62 @@
+#include <doctest.h>
+#include "program_state.hpp"
+
+TEST_CASE("state machine follows the table and honours guards") {
+    bool allow = false;
+    std::vector<std::string> lines;
+    std::vector<std::string> actions;
+    StateMachine sm({
+        {IDLE, EV_CONNECT, CONNECTING_CARETAKER, [&]{return allow;}},
+        {CONNECTING_CARETAKER, EV_LINK_UP, CONNECTED, nullptr},
+        {CONNECTED, EV_START, RUNNING, nullptr},
+        {StateMachine::ANY, EV_STOP, IDLE, nullptr},
+    }, [&](std::string s){lines.push_back(s);});
+    sm.on_exit(IDLE, [&]{actions.push_back("exit idle");});
+    sm.on_entry(IDLE, [&]{actions.push_back("enter idle");});
+    sm.on_entry(RUNNING, [&]{actions.push_back("enter running");});
+
+    CHECK(get_state() == IDLE);
+    CHECK_FALSE(sm.fire(EV_START));      //no row
+    CHECK_FALSE(sm.fire(EV_CONNECT));    //guard refused
+    CHECK(get_state() == IDLE);
+    CHECK(actions.empty());
+    CHECK_FALSE(sm.fire(EV_STOP));       //already idle
+    allow = true;
+    CHECK(sm.accepts(EV_CONNECT));
+    CHECK(sm.fire(EV_CONNECT));
+    CHECK(sm.fire(EV_LINK_UP));
+    CHECK(sm.fire(EV_START));
+    CHECK(get_state() == RUNNING);
+    CHECK(sm.fire(EV_STOP));
+    CHECK(get_state() == IDLE);
+
+    CHECK(actions == std::vector<std::string>{"exit idle", "enter running", "enter idle"});
+    REQUIRE(sm.history().size() == 4);
+    CHECK(sm.history()[3].from == RUNNING);
+    CHECK(sm.history()[3].event == EV_STOP);
+    CHECK(sm.history()[3].in_state_ms >= 0);
+    REQUIRE(lines.size() == 4);
+    CHECK(lines[0].find("Moving state IDLE to CONNECTING_CARETAKER on connect") == 0);
+}
+
+TEST_CASE("transition history keeps the newest records in order") {
+    std::vector<StateMachine::Record> journal;
+    StateMachine sm({
+        {IDLE, EV_CONNECT, CONNECTING_CARETAKER, nullptr},
+        {StateMachine::ANY, EV_STOP, IDLE, nullptr},
+    }, nullptr);
+    sm.on_transition([&](const StateMachine::Record& r){journal.push_back(r);});
+    const size_t fired = StateMachine::HISTORY + 8;
+    for (size_t i = 0; i < fired; i++) REQUIRE(sm.fire(i % 2 ? EV_STOP : EV_CONNECT));
+    CHECK(journal.size() == fired);
+    auto h = sm.history();
+    REQUIRE(h.size() == StateMachine::HISTORY);
+    //the 8 oldest went out of the ring, the connect and stop pairs are still whole
+    CHECK(h.front().event == EV_CONNECT);
+    CHECK(h.back().event == EV_STOP);
+    CHECK(h.back().at_ms == journal.back().at_ms);
+    for (size_t i = 1; i < h.size(); i++) {
+        CHECK(h[i].from == h[i-1].to);
+        CHECK(h[i].at_ms >= h[i-1].at_ms);
+    }
+}
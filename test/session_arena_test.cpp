@@ -0,0 +1,62 @@
+#include <doctest.h>
+#include "session_arena.hpp"
+#include <memory>
+
+TEST_CASE("session arena bumps aligned allocations and falls back to the heap when full") {
+    SessionArena arena;
+    CHECK(arena.allocate(16) == nullptr); //nothing reserved yet
+    REQUIRE(arena.reserve(10000, false));
+    CHECK(arena.capacity() >= 10000);
+    CHECK(arena.capacity() % 4096 == 0);
+
+    char* a = (char*)arena.allocate(3, 1);
+    char* b = (char*)arena.allocate(8, 8);
+    REQUIRE(a);
+    REQUIRE(b);
+    CHECK((uintptr_t)b % 8 == 0);
+    CHECK(b >= a + 3);
+    CHECK(arena.owns(a));
+    CHECK(arena.allocate(arena.capacity()) == nullptr);
+
+    ArenaVector<int> v{ArenaAllocator<int>(&arena)};
+    v.reserve(100);
+    CHECK(arena.owns(v.data()));
+    for (int i = 0; i < 100; i++) v.push_back(i);
+    CHECK(arena.fallbacks() == 0);
+    v.reserve(arena.capacity()); //more than is left
+    CHECK_FALSE(arena.owns(v.data()));
+    CHECK(arena.fallbacks() == 1);
+    CHECK(v[99] == 99);
+}
+
+TEST_CASE("a placed container can outlive its arena") {
+    auto arena = std::make_unique<SessionArena>();
+    ArenaVector<int> before{ArenaAllocator<int>(arena.get())};
+    before.reserve(10); //made before reserve(), stays on the heap
+    REQUIRE(arena->reserve(4096, false));
+    ArenaVector<int> placed{ArenaAllocator<int>(arena.get())};
+    placed.reserve(10);
+    REQUIRE(arena->owns(placed.data()));
+    CHECK_FALSE(arena->owns(before.data()));
+    before.reserve(20);
+    CHECK_FALSE(arena->owns(before.data()));
+    CHECK(arena->fallbacks() == 0);
+    for (int i = 0; i < 10; i++) placed.push_back(i);
+    arena.reset(); //unmapped while both vectors still hold their blocks
+    //leaving the scope frees the heap block and recognises the arena one by its range alone
+}
+
+TEST_CASE("prefault_reserve grows capacity and keeps contents") {
+    std::vector<int> v = {1, 2, 3};
+    prefault_reserve(v, 1000);
+    CHECK(v.capacity() >= 1000);
+    CHECK(v == std::vector<int>{1, 2, 3});
+}
+
+TEST_CASE("session budget scales with the expected length") {
+    SessionBudget short_session(10);
+    SessionBudget long_session(600);
+    CHECK(long_session.store_chunks > short_session.store_chunks);
+    CHECK(long_session.arena_bytes() > short_session.arena_bytes());
+    CHECK(SessionBudget(0).minutes == 1);
+}
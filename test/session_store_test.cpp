@@ -0,0 +1,83 @@
+#include <doctest.h>
+#include "session_store.hpp"
+#include <cstdio>
+#include <filesystem>
+
+static void write_session(const char* path) {
+    SessionStoreWriter w;
+    REQUIRE(w.open(path));
+    std::vector<short> samples(100);
+    std::vector<long long> ts(100);
+    long long t = 0;
+    for (int packet = 0; packet < 200; packet++) {
+        for (int i = 0; i < 100; i++) {
+            ts[i] = t;
+            samples[i] = (short)(t % 1000);
+            t += 2;
+        }
+        libct_vitals_t v = {};
+        v.valid = true;
+        v.timestamp = (unsigned long long)t;
+        v.heart_rate = (short)(60 + packet % 10);
+        libct_stream_data_t data = {};
+        data.int_pulse.samples = samples.data();
+        data.int_pulse.timestamps = ts.data();
+        data.int_pulse.count = 100;
+        data.vitals.datapoints = &v;
+        data.vitals.count = 1;
+        w.push(&data);
+    }
+    w.close();
+}
+
+TEST_CASE("range queries decode only overlapping chunks") {
+    const char* path = "store_test.cts";
+    write_session(path);
+    SessionReader r;
+    REQUIRE(r.open(path));
+    CHECK(r.chunks_decoded() == 0);
+    CHECK(r.chunk_index(CHANNEL_INT_PULSE).size() == 5);
+
+    size_t n = 0;
+    int64_t expected = 10000;
+    for (auto& row : r.query(CHANNEL_INT_PULSE, 10000, 10198)) {
+        CHECK(row.timestamp == expected);
+        CHECK(row.ints[0] == expected % 1000);
+        expected += 2;
+        n++;
+    }
+    CHECK(n == 100);
+    CHECK(r.chunks_decoded() == 1);
+
+    n = 0;
+    for (auto& row : r.query(CHANNEL_VITALS, 0, 2000)) {
+        CHECK(row.ints[3] >= 60);
+        n++;
+    }
+    CHECK(n == 10);
+
+    n = 0;
+    for (auto& row : r.query(CHANNEL_INT_PULSE, 100000, 200000)) {(void)row; n++;}
+    CHECK(n == 0);
+    remove(path);
+}
+
+TEST_CASE("a store without footer is indexed by scanning") {
+    const char* path = "store_test_crash.cts";
+    write_session(path);
+    //drop the footer as if the app died before closing the store
+    uint8_t tail[20];
+    FILE* f = fopen(path, "rb");
+    fseek(f, -20, SEEK_END);
+    REQUIRE(fread(tail, 1, 20, f) == 20);
+    fclose(f);
+    uint64_t footer = 0;
+    for (int i = 0; i < 8; i++) footer |= (uint64_t)tail[4 + i] << (8 * i);
+    std::filesystem::resize_file(path, footer);
+    SessionReader r;
+    REQUIRE(r.open(path));
+    size_t n = 0;
+    for (auto& row : r.query(CHANNEL_INT_PULSE, 0, 39998)) {(void)row; n++;}
+    CHECK(n == 20000);
+    remove(path);
+}
@@ -0,0 +1,71 @@
+#include <doctest.h>
+#include <thread>
+#include "stream_stats.hpp"
+
+TEST_CASE("stream counters from several threads are summed and gaps detected") {
+    StreamStats stats;
+    //4 ms sample cadence learned from the packets, a 40 ms hole counts as one gap
+    auto feed = [&stats](long long start) {
+        for (int p = 0; p < 10; p++)
+            stats.record(STREAM_INT_PULSE, 5, 60, start + p * 20, start + p * 20 + 16, 0);
+        stats.record(STREAM_INT_PULSE, 5, 60, start + 240, start + 256, 0);
+    };
+    std::thread other([&]{feed(100000);});
+    feed(0);
+    other.join();
+    stats.record(STREAM_CUFF, 1, 16, 10, 10, 0);
+    stats.record(STREAM_CUFF, 1, 16, 500, 500, 0);
+
+    REQUIRE(stats.aggregate(0));
+    StreamRates r[STREAM_COUNT];
+    stats.snapshot(r);
+    CHECK(r[STREAM_INT_PULSE].gaps == 2);
+    CHECK(r[STREAM_INT_PULSE].dropped == 2 * 10);
+    CHECK(r[STREAM_CUFF].gaps == 0);
+    CHECK(stats.total_gaps() == 2);
+    CHECK(r[STREAM_INT_PULSE].samples_per_s > 0);
+    CHECK(r[STREAM_VITALS].packets_per_s == 0);
+}
+
+TEST_CASE("latency is measured against the best receive offset") {
+    StreamStats stats;
+    using namespace std::chrono;
+    long now = (long)(duration_cast<milliseconds>(system_clock::now().time_since_epoch()).count() % 1000000000);
+    stats.record(STREAM_VITALS, 1, 32, 0, 0, now);
+    stats.record(STREAM_VITALS, 1, 32, 1000, 1000, now - 50);
+    REQUIRE(stats.aggregate(0));
+    StreamRates r[STREAM_COUNT];
+    stats.snapshot(r);
+    CHECK(r[STREAM_VITALS].latency_max_ms >= 50);
+    CHECK(r[STREAM_VITALS].latency_avg_ms >= 25);
+}
+
+TEST_CASE("the device sample rate is checked against the stream table") {
+    StreamStats stats;
+    std::string problem;
+    //50 samples 2 ms apart per packet, one dropped packet in between is left out of the rate
+    long long t = 0;
+    for (int p = 0; p < 100; p++) {
+        if (p == 50) t += 1000;
+        stats.record(STREAM_INT_PULSE, 50, 500, t, t + 98, 0);
+        t += 100;
+    }
+    REQUIRE(stats.aggregate(0));
+    CHECK_FALSE(stats.check_sample_rates(problem)); //under 10 s of device time yet
+    StreamRates r[STREAM_COUNT];
+    stats.snapshot(r);
+    CHECK(r[STREAM_INT_PULSE].device_hz == doctest::Approx(500));
+    CHECK(r[STREAM_INT_PULSE].device_s == doctest::Approx(9.996));
+
+    stats.record(STREAM_INT_PULSE, 50, 500, t, t + 98, 0);
+    REQUIRE(stats.aggregate(0));
+    CHECK(stats.check_sample_rates(problem));
+    CHECK(problem.empty());
+
+    //the same packets 1 ms apart are a 1 kHz stream, which the exports would write at half speed
+    StreamStats fast;
+    for (int p = 0; p < 300; p++) fast.record(STREAM_INT_PULSE, 50, 500, p * 50, p * 50 + 49, 0);
+    REQUIRE(fast.aggregate(0));
+    CHECK(fast.check_sample_rates(problem));
+    CHECK(problem == "int pulse runs at 1000.0 Hz, exports assume 500 Hz");
+}
@@ -0,0 +1,103 @@
+#include <doctest.h>
+#include "stream_table.hpp"
+#include "session_store.hpp"
+#include <cstring>
+#include <vector>
+
+namespace {
+struct RecordingSink {
+    std::vector<std::pair<STREAM_ID, StreamRow>> rows;
+    std::vector<std::pair<STREAM_ID, StreamPacket>> packets;
+    void row(STREAM_ID s, const StreamRow& r) {rows.push_back({s, r});}
+    void packet(STREAM_ID s, const StreamPacket& p) {packets.push_back({s, p});}
+};
+}
+
+TEST_CASE("the table describes every stream with store compatible layouts") {
+    int fields = 0;
+    for (int s = 0; s < STREAM_COUNT; s++) {
+        const StreamDesc& d = stream_desc(s);
+        CHECK(d.first_field == fields);
+        CHECK(d.int_fields + d.float_fields == d.field_count);
+        fields += d.field_count;
+        const ChannelLayout* l = channel_layout(d.channel);
+        REQUIRE(l);
+        CHECK(l->stream == s);
+        CHECK(l->int_columns == d.int_fields);
+        CHECK(l->float_columns == d.float_fields);
+        CHECK(d.sample_hz <= d.nominal_hz); //the budget covers the real rate
+    }
+    //libct documents int pulse at 500 Hz; the 1000 it is budgeted at is not a rate to export
+    CHECK(stream_desc(STREAM_INT_PULSE).sample_hz == 500);
+    CHECK(fields == FIELD_COUNT);
+    //channels already in recorded files keep their ids and columns
+    CHECK(stream_desc(STREAM_VITALS2).channel == CHANNEL_VITALS2);
+    CHECK(std::strcmp(channel_layout(CHANNEL_VITALS2)->columns[4], "stroke_volume") == 0);
+    CHECK(stream_csv_header(STREAM_CUFF) == "timestamp,target,snr,value");
+    CHECK(field_desc(FIELD_CUFF_value).slot == 0);
+    CHECK(field_desc(FIELD_CUFF_snr).slot == 1);
+}
+
+TEST_CASE("ingest walks every stream shape and skips invalid rows") {
+    short samples[3] = {10, 11, 12};
+    long long ts[3] = {100, 101, 102};
+    libct_vitals_t vitals[2] = {};
+    vitals[0].valid = true;
+    vitals[0].systolic = 120;
+    vitals[0].timestamp = 90;
+    vitals[1].systolic = 999; //not valid
+    libct_cal_curve_t cal = {};
+    cal.valid = true;
+    cal.data_id = 4;
+    cal.val2 = 1.5f;
+    libct_stream_data_t data = {};
+    data.int_pulse.samples = samples;
+    data.int_pulse.timestamps = ts;
+    data.int_pulse.count = 3;
+    data.vitals.datapoints = vitals;
+    data.vitals.count = 2;
+    data.device_status.valid = true;
+    data.device_status.motion_event = true;
+    data.device_status.timestamp = 95;
+    data.cal_curve.datapoints = &cal;
+    data.cal_curve.count = 1;
+    data.receive_time = 5000;
+
+    RecordingSink sink;
+    ingest_streams(&data, sink);
+    CHECK(sink.rows.size() == 3 + 1 + 1 + 1);
+    REQUIRE(sink.packets.size() == 4);
+    CHECK(sink.packets[0].first == STREAM_INT_PULSE);
+    CHECK(sink.packets[0].second.rows == 3);
+    CHECK(sink.packets[0].second.first_ts == 100);
+    CHECK(sink.packets[0].second.last_ts == 102);
+    CHECK(sink.packets[1].first == STREAM_VITALS);
+    CHECK(sink.packets[1].second.rows == 1);
+    for (auto& r : sink.rows) {
+        if (r.first == STREAM_VITALS) CHECK(r.second.ints[0] == 120);
+        if (r.first == STREAM_DEVICE_STATUS) CHECK(r.second.ints[0] == (int64_t)1 << STATUS_motion_event);
+        if (r.first == STREAM_CAL_CURVE) {
+            CHECK(r.second.timestamp == 5000);
+            CHECK(r.second.ints[0] == 4);
+            CHECK(r.second.floats[1] == 1.5f);
+        }
+    }
+}
+
+TEST_CASE("live values keep the latest row per stream") {
+    LiveValues live;
+    StreamRow row;
+    CHECK_FALSE(live.read(STREAM_CUFF, row));
+    StreamRow in;
+    in.timestamp = 42;
+    in.ints[0] = 180;
+    in.floats[0] = 61.5f;
+    live.update(STREAM_CUFF, in);
+    REQUIRE(live.read(STREAM_CUFF, row));
+    CHECK(row.timestamp == 42);
+    char text[32];
+    format_field(FIELD_CUFF_value, row, text, sizeof(text));
+    CHECK(std::string(text) == "61.500000");
+    format_field(FIELD_CUFF_target, row, text, sizeof(text));
+    CHECK(std::string(text) == "180");
+}
@@ -0,0 +1,32 @@
+#include <doctest.h>
+#include <thread>
+#include "thread_roles.hpp"
+
+TEST_CASE("thread roles are applied to registered threads and reported") {
+    std::vector<std::string> lines;
+    std::thread writer([]{register_thread(ROLE_WRITER);});
+    writer.join();
+    register_thread(ROLE_MAIN);
+    register_thread(ROLE_GUI); //a thread keeps its first role
+
+    ThreadPolicy policies[ROLE_COUNT];
+    policies[ROLE_MAIN].policy = "nice";
+    policies[ROLE_MAIN].priority = 0;
+    configure_thread_roles(policies, [&](std::string s){lines.push_back(s);});
+    //the writer thread has exited, only main is touched
+    REQUIRE(lines.size() == 1);
+    CHECK(lines[0].find("Scheduling main thread") == 0);
+    CHECK(lines[0].find("nice 0") != std::string::npos);
+
+    std::string report = thread_roles_report();
+    CHECK(report.find("main thread") != std::string::npos);
+    CHECK(report.find("writer thread") == std::string::npos);
+    CHECK(report.find("gui thread") == std::string::npos);
+
+    policies[ROLE_IO].policy = "bogus";
+    configure_thread_roles(policies, [&](std::string s){lines.push_back(s);});
+    std::thread io([]{register_thread(ROLE_IO);});
+    io.join();
+    REQUIRE(lines.size() == 3);
+    CHECK(lines[2].find("unknown policy bogus") != std::string::npos);
+}
@@ -0,0 +1,91 @@
+#include <doctest.h>
+#include "trace.hpp"
+#include "json_value.hpp"
+#include <atomic>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <thread>
+
+static JsonValue read_trace(const char* path) {
+    std::ifstream in(path);
+    std::stringstream ss;
+    ss << in.rdbuf();
+    return json_parse(ss.str());
+}
+
+static std::vector<const JsonValue*> spans(const JsonValue& trace, const std::string& prefix) {
+    std::vector<const JsonValue*> out;
+    for (auto& e : trace.at("traceEvents").as_array())
+        if (e.at("ph").as_string() == "X" && e.at("name").as_string().compare(0, prefix.size(), prefix) == 0) out.push_back(&e);
+    return out;
+}
+
+TEST_CASE("trace dump holds every thread's spans and names") {
+    const char* path = "trace_test.json";
+    std::thread worker([]{
+        trace_thread_name("trace test worker");
+        trace_record("worker span", 1000, 3000);
+    });
+    worker.join();
+    trace_record("main span", 5000, 5500);
+    long written = trace_dump(path);
+    JsonValue trace = read_trace(path);
+    remove(path);
+
+    auto events = trace.at("traceEvents").as_array();
+    long complete = 0;
+    int worker_tid = -1;
+    for (auto& e : events) {
+        if (e.at("ph").as_string() == "X") complete++;
+        else if (e.at("args").at("name").as_string() == "trace test worker") worker_tid = (int)e.at("tid").as_int();
+    }
+    CHECK(written == complete);
+    auto w = spans(trace, "worker span");
+    REQUIRE(w.size() == 1);
+    CHECK(w[0]->at("ts").as_real() == doctest::Approx(1.0));
+    CHECK(w[0]->at("dur").as_real() == doctest::Approx(2.0));
+    CHECK(w[0]->at("tid").as_int() == worker_tid);
+    auto m = spans(trace, "main span");
+    REQUIRE(m.size() == 1);
+    CHECK(m[0]->at("tid").as_int() != worker_tid);
+}
+
+TEST_CASE("a full trace ring keeps the newest spans") {
+    const char* path = "trace_test.json";
+    const uint64_t extra = 100;
+    std::thread worker([&]{
+        for (uint64_t i = 0; i < TraceBuffer::CAPACITY + extra; i++) trace_record("wrap span", i * 1000, i * 1000 + 1000);
+    });
+    worker.join();
+    trace_dump(path);
+    JsonValue trace = read_trace(path);
+    remove(path);
+    auto w = spans(trace, "wrap span");
+    //the oldest slot is the next one written, a dump cannot tell it is not being written now
+    REQUIRE(w.size() == TraceBuffer::CAPACITY - 1);
+    CHECK(w.front()->at("ts").as_real() == doctest::Approx((double)(extra + 1)));
+    CHECK(w.back()->at("ts").as_real() == doctest::Approx((double)(TraceBuffer::CAPACITY + extra - 1)));
+}
+
+TEST_CASE("spans overwritten while dumping are dropped, not torn") {
+    const char* path = "trace_test.json";
+    static const char* names[] = {"race span 0", "race span 1", "race span 2"};
+    std::atomic<bool> stop{false};
+    //every field of span i is derived from i, a torn slot mixes two of them
+    std::thread writer([&]{
+        for (int64_t i = 0; !stop; i++) trace_record(names[i % 3], i * 1000, i * 2000);
+    });
+    for (int pass = 0; pass < 10; pass++) {
+        trace_dump(path);
+        JsonValue trace = read_trace(path);
+        for (const JsonValue* e : spans(trace, "race span")) {
+            int64_t i = (int64_t)e->at("ts").as_real();
+            CHECK(e->at("dur").as_real() == doctest::Approx((double)i));
+            CHECK(e->at("name").as_string() == names[i % 3]);
+        }
+    }
+    stop = true;
+    writer.join();
+    remove(path);
+}
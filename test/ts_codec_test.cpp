@@ -0,0 +1,62 @@
+#include <doctest.h>
+#include "ts_codec.hpp"
+#include <cmath>
+
+TEST_CASE("zigzag varints round trip") {
+    std::vector<uint8_t> buf;
+    int64_t values[] = {0, 1, -1, 63, -64, 300, -300, INT64_MAX, INT64_MIN};
+    for (int64_t v : values) put_varint(buf, zigzag_encode(v));
+    const uint8_t* p = buf.data();
+    for (int64_t v : values) CHECK(zigzag_decode(get_varint(p, buf.data() + buf.size())) == v);
+    CHECK(p == buf.data() + buf.size());
+}
+
+TEST_CASE("waveform chunk is compact and lossless") {
+    ChunkEncoder enc(CHANNEL_INT_PULSE, 1, 0);
+    std::vector<int64_t> ts, samples;
+    for (int i = 0; i < 4096; i++) {
+        ts.push_back(1000000 + i * 2 + (i % 97 == 0 ? 1 : 0));
+        samples.push_back((int64_t)(1000 * std::sin(i / 50.0)));
+        enc.add_row(ts.back(), &samples.back(), nullptr);
+    }
+    std::vector<uint8_t> out;
+    enc.finish(out);
+    //decimal text would be roughly 12 bytes per row
+    CHECK(out.size() < 4096 * 3);
+
+    size_t row = 0;
+    bool ok = ChunkDecoder::decode(out.data(), out.size(), [&](int64_t t, const int64_t* ints, const float*) {
+        CHECK(t == ts[row]);
+        CHECK(ints[0] == samples[row]);
+        row++;
+    });
+    CHECK(ok);
+    CHECK(row == ts.size());
+}
+
+TEST_CASE("float columns survive xor encoding") {
+    ChunkEncoder enc(CHANNEL_VITALS2, 1, 2);
+    std::vector<float> a, b;
+    for (int i = 0; i < 300; i++) {
+        a.push_back(i % 5 == 0 ? 0.75f : 0.75f + i * 0.001f);
+        b.push_back(-12.5f * (i / 10));
+        int64_t v = i;
+        float f[2] = {a.back(), b.back()};
+        enc.add_row(i * 1000, &v, f);
+    }
+    std::vector<uint8_t> out;
+    enc.finish(out);
+    ChunkHeader h;
+    REQUIRE(ChunkDecoder::read_header(out.data(), out.size(), h));
+    CHECK(h.count == 300);
+    CHECK(h.t_min == 0);
+    CHECK(h.t_max == 299000);
+    size_t row = 0;
+    ChunkDecoder::decode(out.data(), out.size(), [&](int64_t, const int64_t* ints, const float* f) {
+        CHECK(ints[0] == (int64_t)row);
+        CHECK(f[0] == a[row]);
+        CHECK(f[1] == b[row]);
+        row++;
+    });
+    CHECK(row == 300);
+}
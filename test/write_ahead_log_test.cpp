@@ -0,0 +1,159 @@
+#include <doctest.h>
+#include "write_ahead_log.hpp"
+#include <filesystem>
+#include <thread>
+#include <fstream>
+#include <sstream>
+
+TEST_CASE("wal records round trip and reject corruption") {
+    WalRecord r;
+    r.seq = 7;
+    r.trigger = 3;
+    r.ct_timestamp = 123456789;
+    r.pc_timestamp = 1700000000000;
+    snprintf(r.label, sizeof(r.label), "systolic");
+    snprintf(r.value, sizeof(r.value), "118");
+    r.extra = 42;
+    uint8_t buf[WAL_RECORD_SIZE];
+    wal_serialise(r, buf);
+
+    WalRecord back;
+    REQUIRE(wal_parse(buf, back));
+    CHECK(back.seq == 7);
+    CHECK(back.trigger == 3);
+    CHECK(back.ct_timestamp == 123456789);
+    CHECK(std::string(back.label) == "systolic");
+    CHECK(std::string(back.value) == "118");
+    CHECK(back.extra == 42);
+
+    buf[20] ^= 0x40;
+    CHECK_FALSE(wal_parse(buf, back));
+}
+
+TEST_CASE("an unclosed session is rebuilt from the log") {
+    const char* path = "wal_test.wal";
+    {
+        FILE* f = fopen(path, "wb");
+        uint8_t buf[WAL_RECORD_SIZE];
+        WalRecord open;
+        open.type = WAL_SESSION_OPEN;
+        snprintf(open.label, sizeof(open.label), "wal_test_session");
+        wal_serialise(open, buf);
+        fwrite(buf, 1, WAL_RECORD_SIZE, f);
+        //state changes are journalled beside the rows but are not part of the CSV
+        WalRecord change;
+        change.type = WAL_TRANSITION;
+        snprintf(change.label, sizeof(change.label), "CONNECTED");
+        snprintf(change.value, sizeof(change.value), "RUNNING");
+        wal_serialise(change, buf);
+        fwrite(buf, 1, WAL_RECORD_SIZE, f);
+        for (int i = 0; i < 3; i++) {
+            WalRecord row;
+            row.trigger = 2;
+            row.ct_timestamp = 1000 + i;
+            row.pc_timestamp = 5000 + i;
+            snprintf(row.label, sizeof(row.label), "heart_rate");
+            snprintf(row.value, sizeof(row.value), "%d", 60 + i);
+            wal_serialise(row, buf);
+            fwrite(buf, 1, WAL_RECORD_SIZE, f);
+        }
+        //half written record from the crash
+        fwrite(buf, 1, WAL_RECORD_SIZE / 2, f);
+        fclose(f);
+    }
+    std::string rebuilt = WriteAheadLog::recover(path, [](std::string){});
+    REQUIRE(rebuilt == "wal_test_session.csv");
+    std::ifstream in(rebuilt);
+    std::stringstream ss;
+    ss << in.rdbuf();
+    CHECK(ss.str() == "trigger,datatype,recent value,ct timestamp,computer timestamp\n"
+                      "2,heart_rate,60,1000,5000\n2,heart_rate,61,1001,5001\n2,heart_rate,62,1002,5002");
+    in.close();
+    remove(rebuilt.c_str());
+
+    //a cleanly closed session needs no recovery
+    {
+        WriteAheadLog wal(10);
+        REQUIRE(wal.open(path, "wal_test_session"));
+        wal.append(1, "map", "90", 1, 2);
+        wal.close();
+        CHECK(wal.stats().records == 3);
+        CHECK(wal.stats().syncs >= 1);
+    }
+    CHECK(WriteAheadLog::recover(path, [](std::string){}) == "");
+    remove(path);
+}
+
+TEST_CASE("recovery rebuilds a long session path beside the log") {
+    namespace fs = std::filesystem;
+    fs::path dir = "wal_test_dir/a directory name longer than any one journal field";
+    fs::create_directories(dir);
+    std::string wal_path = (dir / "caretaker.wal").string();
+    std::string crashed = (dir / "crashed.wal").string();
+    std::string session = (dir / "2026-10-19_12-34-56_with_a_long_suffix").string();
+    {
+        WriteAheadLog wal(10);
+        REQUIRE(wal.open(wal_path, session));
+        wal.append(4, "systolic", "120", 7, 8);
+        for (int i = 0; i < 2000 && fs::file_size(wal_path) < 2 * WAL_RECORD_SIZE; i++) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        REQUIRE(fs::file_size(wal_path) == 2 * WAL_RECORD_SIZE);
+        //the journal as a crash would leave it, before the close record
+        fs::copy_file(wal_path, crashed);
+    }
+    std::string rebuilt = WriteAheadLog::recover(crashed, [](std::string){});
+    CHECK(rebuilt == session + ".csv");
+    CHECK(fs::exists(rebuilt));
+
+    WriteAheadLog wal;
+    CHECK_FALSE(wal.open(wal_path, std::string(60, 'x'))); //a name the open record cannot hold
+    fs::remove_all("wal_test_dir");
+}
+
+TEST_CASE("recovery never overwrites the live CSV") {
+    const char* path = "wal_test_live.wal";
+    {
+        FILE* f = fopen(path, "wb");
+        REQUIRE(f);
+        uint8_t buf[WAL_RECORD_SIZE];
+        WalRecord open;
+        open.type = WAL_SESSION_OPEN;
+        snprintf(open.label, sizeof(open.label), "wal_test_live");
+        wal_serialise(open, buf);
+        fwrite(buf, 1, WAL_RECORD_SIZE, f);
+        for (int i = 0; i < 2; i++) {
+            WalRecord row;
+            row.trigger = 1;
+            row.ct_timestamp = -1;
+            row.pc_timestamp = 5000 + i;
+            snprintf(row.label, sizeof(row.label), "map");
+            snprintf(row.value, sizeof(row.value), "%d", 90 + i);
+            wal_serialise(row, buf);
+            fwrite(buf, 1, WAL_RECORD_SIZE, f);
+        }
+        fclose(f);
+    }
+    const std::string header = "trigger,datatype,recent value,ct timestamp,computer timestamp";
+    auto read = [](const std::string& name) {
+        std::ifstream in(name);
+        std::stringstream ss;
+        ss << in.rdbuf();
+        return ss.str();
+    };
+
+    //the live file is ahead of the journal, it is left alone
+    std::string live = header + "\n1,map,90,-1,5000\n1,map,91,-1,5001\n1,map,92,-1,5002";
+    std::ofstream("wal_test_live.csv") << live;
+    CHECK(WriteAheadLog::recover(path, [](std::string){}) == "");
+    CHECK(read("wal_test_live.csv") == live);
+
+    //a shorter live file is kept and the journal's rows go beside it
+    std::string partial = header + "\n1,map,90,-1,5000";
+    std::ofstream("wal_test_live.csv", std::ios::trunc) << partial;
+    REQUIRE(WriteAheadLog::recover(path, [](std::string){}) == "wal_test_live.recovered.csv");
+    CHECK(read("wal_test_live.csv") == partial);
+    CHECK(read("wal_test_live.recovered.csv") == header + "\n1,map,90,-1,5000\n1,map,91,-1,5001");
+
+    remove("wal_test_live.csv");
+    remove("wal_test_live.recovered.csv");
+    remove(path);
+}